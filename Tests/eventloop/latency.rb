@@ -0,0 +1,110 @@
+# Event loop latency under busy Ruby threads.
+#
+# Two threads burn CPU and one wakes every few milliseconds, like a worker
+# polling something. Meanwhile three things are measured:
+#
+#  * timer: how late an every(0.05) timer's callbacks run
+#  * thread post: a Shoes.worker posts progress from its Ruby thread every
+#    20ms (Shoes.notify_worker, which wakes the loop), and the on_progress
+#    block notes how long the post took to arrive
+#  * input: keypresses are sent with xdotool and the keypress block notes
+#    how long each took to arrive. Without xdotool, hold down a key instead
+#    and the spread of the auto-repeat gaps is reported.
+#
+# Before the event loop rework the lateness could reach half a second;
+# it should now stay within a frame or two.
+Shoes.app width: 520, height: 200, title: "Event loop latency" do
+  SAMPLES = 100
+  INTERVAL = 0.05
+  @late = {timer: [], post: [], input: []}
+  @busy = true
+  @xdotool = system("which xdotool > /dev/null 2>&1")
+
+  stack margin: 10 do
+    @status = para "measuring..."
+    @poke = para ""
+    @hint = para(@xdotool ? "keep this window focused" :
+      "no xdotool here: hold down a key for a few seconds")
+  end
+
+  def report
+    return unless @late.values.all? { |l| l.size >= SAMPLES }
+    @busy = false
+    msg = @late.map do |name, l|
+      l = l.sort
+      "#{name} ms: median %.1f  p95 %.1f  max %.1f" %
+        [l[l.size / 2], l[(l.size * 95) / 100], l.last]
+    end.join("\n")
+    @status.text = msg
+    @hint.text = ""
+    $stderr.puts msg
+  end
+
+  2.times do
+    Thread.new { x = 0; x += 1 while @busy }
+  end
+  Thread.new { sleep 0.003 while @busy }
+  Thread.new do
+    n = 0
+    while @busy
+      sleep 0.1
+      @poke.text = "poked from a thread #{n += 1}"
+    end
+  end
+
+  # timer
+  @last = Time.now
+  @every = every INTERVAL do
+    now = Time.now
+    @late[:timer] << ((now - @last) - INTERVAL) * 1000.0 if @late[:timer].size < SAMPLES
+    @last = now
+    if @late[:timer].size == SAMPLES
+      @every.stop
+      report
+    end
+  end
+
+  # thread post, progress carries the time it was posted
+  # progress that piles up is merged, so keep posting until enough arrived
+  w = worker do |job|
+    while @late[:post].size < SAMPLES
+      sleep 0.02
+      job.progress = Time.now
+    end
+  end
+  w.on_progress do |sent|
+    @late[:post] << (Time.now - sent) * 1000.0 if @late[:post].size < SAMPLES
+    report if @late[:post].size == SAMPLES
+  end
+
+  # input. With xdotool the time includes starting xdotool itself; with
+  # auto-repeat it is how far each gap strays from the median gap.
+  @sent = nil
+  @gaps = []
+  keypress do |k|
+    now = Time.now
+    next if @late[:input].size >= SAMPLES
+    if @xdotool
+      @late[:input] << (now - @sent) * 1000.0 if @sent
+      @sent = nil
+    else
+      @gaps << now - @key_at if @key_at
+      @key_at = now
+      if @gaps.size > 5
+        mid = @gaps.sort[@gaps.size / 2]
+        @late[:input] << (@gaps.last - mid).abs * 1000.0
+      end
+    end
+    report if @late[:input].size == SAMPLES
+  end
+  if @xdotool
+    Thread.new do
+      sleep 1
+      while @busy && @late[:input].size < SAMPLES
+        @sent = Time.now
+        system("xdotool key --clearmodifiers space")
+        sleep 0.05
+      end
+    end
+  end
+end
@@ -0,0 +1,24 @@
+# streaming series - 50 samples a second into a 2000 value ring
+Shoes.app width: 700, height: 480 do
+  stack do
+    flow do
+      button "quit" do Shoes.quit end
+      button "burst" do
+        # one packed push of 500 samples
+        @cs.push_many(Array.new(500) { |i| Math.sin((@n + i) / 40.0) * 10 }.pack("d*"))
+        @n += 500
+      end
+      @status = para ""
+    end
+    @grf = plot 660, 400, title: "Telemetry", caption: "streaming: true",
+      font: "Helvetica", auto_grid: true, chart: "timeseries"
+  end
+  # no min:/max: so the y axis follows the data in the ring
+  @cs = @grf.add name: "sensor", streaming: true, capacity: 2000, color: dodgerblue
+  @n = 0
+  every(0.02) do
+    @cs.push(Math.sin(@n / 40.0) * 10 + rand)
+    @n += 1
+    @status.text = "#{@cs.size} of #{@n} samples" if @n % 50 == 0
+  end
+end
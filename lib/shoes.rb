@@ -28,6 +28,7 @@ require 'optparse'
 require 'resolv-replace' if RUBY_PLATFORM =~ /win/
 require_relative 'shoes/inspect'
 require_relative 'shoes/image' if Object.const_defined? :Shoes
+require_relative 'shoes/worker' if Object.const_defined? :Shoes
 
 def Shoes.hook; end
 
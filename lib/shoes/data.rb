@@ -1,35 +1,164 @@
-require 'sdbm'
-data_file = File.join(LIB_DIR, "sdbm-img-cache")
-
-DATABASE = SDBM.new(data_file)
-
-class << DATABASE
-  def check_cache_for url
-    t = DATABASE[url]
-    return nil unless t
-    flds = t.split('|')
-    hsh = {:etag => flds[0], :hash => flds[1], :saved => Time.parse(flds[2]).to_i}
-    return hsh
-  end
-  
-  def notify_cache_of url, etag, hash
-    if !etag || etag == ''
-      etag = 'numpty'
+require 'fileutils'
+require 'uri'
+
+class Shoes
+  # Index of the remote images kept under CACHE_DIR. The files are named
+  # after the SHA1 of their contents (see Shoes.image_cache_path), the
+  # index maps each url to its file, etag, size and when it was saved and
+  # last used. It lives in one small binary file that is replaced
+  # atomically. Once the files outgrow the budget the least recently used
+  # ones are deleted.
+  class ImageCache
+    MAGIC = "SIC1"
+    HEADER = "a4Q>N"           # magic, budget, entry count
+    HEADER_SIZE = 4 + 8 + 4
+    RECORD = "a20NNQ>nnC"      # sha1, saved, used, size, url/etag/ext lengths
+    RECORD_SIZE = 20 + 4 + 4 + 8 + 2 + 2 + 1
+    DEFAULT_BUDGET = 256 * 1024 * 1024
+    STALE_TEMP = 24 * 60 * 60
+
+    Entry = Struct.new(:url, :etag, :hash, :ext, :saved, :used, :size)
+
+    attr_reader :budget
+
+    def initialize dir
+      @dir = dir
+      @path = File.join(dir, "index")
+      @budget = DEFAULT_BUDGET
+      @entries = {}
+      @dirty = false
+      load_index
+      sweep_temp
     end
-    val = [etag, hash, Time.now].join('|')
-    DATABASE[url] = val
-  end
-  
-  def delete_cache 
-    DATABASE.each do |k, val|
-      v = val.split('|')
-      path = Shoes::image_cache_path v[1], File.extname(k)
-      $stderr.puts "ext cache delete: #{path}"
+
+    def check_cache_for url
+      e = @entries[url]
+      return nil unless e
+      unless File.exist?(file_for(e))
+        @entries.delete(url)
+        @dirty = true
+        return nil
+      end
+      e.used = Time.now.to_i
+      @dirty = true
+      {:etag => e.etag, :hash => e.hash, :saved => e.saved}
+    end
+
+    # Returns where the downloaded file belongs, or nil if it is over budget
+    # on its own and was evicted straight away.
+    def notify_cache_of url, etag, hash, size = nil
+      etag = 'numpty' if !etag || etag == ''
+      now = Time.now.to_i
+      old = @entries[url]
+      ext = File.extname(URI(url).path).downcase rescue File.extname(url)
+      @entries[url] = Entry.new(url, etag, hash, ext, now, now, size || 0)
+      drop_file(old) if old && old.hash != hash
+      evict
+      save
+      e = @entries[url]
+      e && file_for(e)
+    end
+
+    def delete_cache
+      @entries.each_value do |e|
+        path = file_for(e)
+        $stderr.puts "ext cache delete: #{path}"
+        File.delete path if File.exist? path
+      end
+      @entries.clear
+      @dirty = true
+      save
+    end
+
+    def budget= bytes
+      @budget = bytes.to_i
+      @dirty = true
+      evict
+      save
+    end
+
+    # bytes of cached files
+    def size
+      @entries.values.uniq { |e| e.hash }.inject(0) { |sum, e| sum + e.size }
+    end
+
+    def save
+      return unless @dirty
+      out = [MAGIC, @budget, @entries.size].pack(HEADER)
+      @entries.each_value do |e|
+        url, etag, ext = e.url.b, e.etag.to_s.b, e.ext.to_s.b
+        out << [[e.hash].pack("H*"), e.saved, e.used, e.size,
+                url.bytesize, etag.bytesize, ext.bytesize].pack(RECORD)
+        out << url << etag << ext
+      end
+      tmp = "#{@path}.#{$$}"
+      File.open(tmp, "wb") { |f| f.write out }
+      File.rename(tmp, @path)
+      @dirty = false
+    rescue SystemCallError => e
+      $stderr.puts "image cache index not saved: #{e}"
+    end
+
+    private
+
+    def file_for e
+      Shoes.image_cache_path(e.hash, e.ext)
+    end
+
+    def load_index
+      data = File.binread(@path) rescue nil
+      return start_over unless data && data.bytesize >= HEADER_SIZE
+      magic, @budget, count = data.unpack(HEADER)
+      return start_over unless magic == MAGIC
+      pos = HEADER_SIZE
+      count.times do
+        sha, saved, used, size, ul, el, xl = data.byteslice(pos, RECORD_SIZE).unpack(RECORD)
+        pos += RECORD_SIZE
+        url = data.byteslice(pos, ul).force_encoding("UTF-8"); pos += ul
+        etag = data.byteslice(pos, el); pos += el
+        ext = data.byteslice(pos, xl); pos += xl
+        @entries[url] = Entry.new(url, etag, sha.unpack("H*").first, ext, saved, used, size)
+      end
+    rescue ArgumentError, TypeError, NoMethodError
+      start_over
+    end
+
+    # no usable index, so nothing in the cache can be found again
+    def start_over
+      @entries.clear
+      @budget ||= DEFAULT_BUDGET
+      Dir[File.join(@dir, "??", "*")].each { |f| File.delete f rescue nil }
+      @dirty = true
+    end
+
+    def sweep_temp
+      Dir[File.join(@dir, "tmp-*")].each do |f|
+        File.delete f if Time.now - File.mtime(f) > STALE_TEMP rescue nil
+      end
+    end
+
+    def drop_file e
+      return if @entries.each_value.any? { |o| o.hash == e.hash }
+      path = file_for(e)
       File.delete path if File.exist? path
-    end        
-    DATABASE.clear
-    DATABASE.close
-    # TODO: reopen - somehow.
+    end
+
+    def evict
+      total = size
+      return if total <= @budget
+      @entries.values.sort_by { |e| e.used }.each do |e|
+        break if total <= @budget
+        @entries.delete(e.url)
+        unless @entries.each_value.any? { |o| o.hash == e.hash }
+          total -= e.size
+          path = file_for(e)
+          File.delete path if File.exist? path
+        end
+        @dirty = true
+      end
+    end
   end
 end
 
+DATABASE = Shoes::ImageCache.new(CACHE_DIR)
+at_exit { DATABASE.save }
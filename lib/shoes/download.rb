@@ -12,6 +12,8 @@ class Shoes
     # thread is used by packager to sync download
     attr_reader :thread
     UPDATE_STEPS = 100
+    # :chunk callbacks get the body in pieces of this size
+    CHUNK_SIZE = 16384
     
     def initialize(url, opts = {}, &blk)
       @opts = opts
@@ -26,6 +28,7 @@ class Shoes
     
     def start_download(url)
       puts "download method: starting for #{url}"
+      return start_upload(url) if @opts[:upload_io]
       #require 'open-uri'
       @thread = Thread.new do
         uri_opts = {}
@@ -45,6 +48,31 @@ class Shoes
       end
     end
       
+    # open-uri can only GET, so an upload streams :upload_io through Net::HTTP
+    def start_upload(url)
+      require 'net/http'
+      @thread = Thread.new do
+        uri = URI(url)
+        io = @opts[:upload_io]
+        klass = Net::HTTP.const_get((@opts[:method] || "PUT").capitalize)
+        req = klass.new(uri.request_uri, @opts[:headers] || {})
+        req.body_stream = io
+        if io.respond_to?(:size)
+          req.content_length = io.size - (io.respond_to?(:pos) ? io.pos : 0)
+        else
+          req['Transfer-Encoding'] = 'chunked'
+        end
+        Net::HTTP.start(uri.host, uri.port, :use_ssl => uri.scheme == 'https') do |http|
+          http.request(req) do |res|
+            download_started(res.content_length.to_i)
+            @response.status = res.code.to_i
+            @response.headers = res.to_hash
+            finish_download res
+          end
+        end
+      end
+    end
+
     def content_length_proc
       lambda do |content_length|
         download_started(content_length)
@@ -66,19 +94,34 @@ class Shoes
       end
     end
 
+    # f is the open-uri tempfile or a Net::HTTPResponse (uploads). Only
+    # plain downloads keep the body in memory.
     def finish_download(f)
       puts "download method finishing"
       @finished = true
-      @response.body = f.read
-      @response.status = f.status[0]
-      @response.headers = f.meta
+      if f.respond_to?(:read_body)
+        @response.body = ""
+        f.read_body { |buf| receive_chunk(buf) }
+        @outf.close if @outf
+      else
+        @response.status = f.status[0]
+        @response.headers = f.meta
+        if @opts[:save]
+          IO.copy_stream(f, @opts[:save])
+        elsif @opts[:chunk]
+          while (buf = f.read(CHUNK_SIZE))
+            receive_chunk(buf)
+          end
+        else
+          @response.body = f.read
+        end
+      end
       #puts "Calling finishers #{f.size}"
       # The download thread needs to quit.
       #@thread.exit if @opts[:save]
       # call :progress with 100%, just in case
       @percent = 1.0
       eval_block(@opts[:progress], self) if @opts[:progress]
-      save_to_file(@opts[:save]) if @opts[:save]
       # :finish and block are mutully exclusive (see manual)
       if @opts[:finish]
         eval_block(@opts[:finish], self) 
@@ -93,11 +136,19 @@ class Shoes
       # @gui.eval_block(blk, result)
     end
 
-    def save_to_file(str)
-      #puts "Saving to #{str}"
-      @outf = open(str, 'wb')  
-      @outf.print(@response.body)
-      @outf.close
+    def receive_chunk(buf)
+      @transferred += buf.bytesize
+      chunk = @opts[:chunk]
+      if chunk.respond_to?(:call)
+        chunk.call self, buf
+      elsif chunk.respond_to?(:write)
+        chunk.write buf
+      elsif @opts[:save]
+        @outf ||= open(@opts[:save], 'wb')
+        @outf.write buf
+      else
+        @response.body << buf
+      end
     end
 
     def download_started(content_length)
@@ -112,12 +163,14 @@ class Shoes
   end
 end
 
-# Monkey patch over the 'C' code. 
-class Shoes::Types::App
-  # Shoes::Types::App seems wrong but it works. 
-  def download (url, options = {}, &blk)
-    #puts "download #{url} #{options} "
-    Shoes::Download.new(url, options, &blk)
+# Monkey patch over the 'C' code, unless it has a native download engine.
+unless Shoes::Types::Download.const_defined?(:ENGINE)
+  class Shoes::Types::App
+    # Shoes::Types::App seems wrong but it works. 
+    def download (url, options = {}, &blk)
+      #puts "download #{url} #{options} "
+      Shoes::Download.new(url, options, &blk)
+    end
   end
 end
 
@@ -4,8 +4,9 @@ require 'openssl'
 require 'digest/sha1'
 
 class Shoes
+  # downloads land next to the cache so moving them in is a plain rename
   def self.image_temp_path uri, uext
-    File.join(Dir::tmpdir, "#{uri.host}-#{Time.now.usec}" + uext)
+    File.join(CACHE_DIR, "tmp-#{uri.host}-#{$$}-#{Time.now.usec}" + uext)
   end
   
   def self.image_cache_path hash, ext
@@ -0,0 +1,167 @@
+# Shoes.worker runs a block on a Ruby thread so the window stays responsive,
+# and hands its progress and result back on the GUI thread:
+#
+#   w = Shoes.worker(path) do |job, path|
+#     File.foreach(path).with_index do |line, i|
+#       job.check!                  # stops here if w.cancel was called
+#       job.progress = i
+#     end
+#   end
+#   w.on_progress { |n| @status.text = "#{n} lines" }
+#   w.on_done { |result| @status.text = "done" }
+#
+# The block runs at a lower thread priority. check! and progress= also give
+# other threads (the GUI among them) a turn. Only the on_* blocks should touch
+# the window. On OS X Shoes.notify_worker hands over right away, so there the
+# on_* blocks run on the worker's thread.
+class Shoes
+  class Worker
+    class Cancelled < StandardError; end
+
+    # running workers, so they and their callbacks outlive the caller's
+    # reference until the last event is handed over and no notify is queued
+    ACTIVE = []
+    ACTIVE_LOCK = Mutex.new
+
+    attr_reader :value, :exception, :progress, :state
+
+    def initialize(*args, &blk)
+      raise ArgumentError, "Shoes.worker needs a block" unless blk
+      @events = Queue.new
+      @notify = Mutex.new
+      @notified = false           # a notify is queued for the GUI thread
+      @callbacks = Hash.new { |h, k| h[k] = [] }
+      @cancelled = false
+      @state = :running
+      ACTIVE_LOCK.synchronize { ACTIVE << self }
+      @thread = Thread.new do
+        Thread.current.priority = -1
+        begin
+          post :done, blk.call(self, *args)
+        rescue Cancelled
+          post :cancelled, nil
+        rescue Exception => e
+          post :error, e
+        end
+      end
+    end
+
+    # -- called from the worker block
+
+    def progress=(v)
+      post :progress, v
+      Thread.pass
+    end
+
+    def check!
+      raise Cancelled if @cancelled
+      Thread.pass
+    end
+
+    def cancelled?
+      @cancelled
+    end
+
+    # -- called from the app
+
+    def on_done(&blk) listen(:done, blk) end
+    def on_progress(&blk) listen(:progress, blk) end
+    def on_error(&blk) listen(:error, blk) end
+    def on_cancel(&blk) listen(:cancelled, blk) end
+
+    def cancel
+      @cancelled = true
+      self
+    end
+
+    def done?
+      @state != :running
+    end
+
+    # blocks the GUI until the worker finishes; mostly for scripts and tests
+    def wait
+      @thread.join
+      drain
+      @value
+    end
+
+    # Shoes.notify_worker's message, on the GUI thread
+    def notified
+      @notify.synchronize { @notified = false }
+      drain
+    end
+
+    # Progress is only reported at its latest value.
+    def drain
+      events = []
+      events << @events.pop(true) until @events.empty?
+      last_progress = events.rindex { |kind, _| kind == :progress }
+      events.each_with_index do |(kind, v), i|
+        next if kind == :progress && i != last_progress
+        case kind
+        when :progress  then @progress = v
+        when :done      then @value = v
+        when :error     then @exception = v
+        end
+        @state = kind unless kind == :progress
+        fire kind, v
+      end
+    rescue ThreadError
+      # emptied by a concurrent drain from wait
+    ensure
+      forget
+    end
+
+    private
+
+    # One notify at a time is enough, the drain it triggers takes every
+    # event queued before it.
+    def post(kind, v)
+      @events << [kind, v]
+      notify = @notify.synchronize { !@notified && (@notified = true) }
+      Shoes.notify_worker(self) if notify
+    end
+
+    # the queued message holds no reference of its own, so keep the worker
+    # in ACTIVE until it has arrived
+    def forget
+      return unless done?
+      ACTIVE_LOCK.synchronize do
+        ACTIVE.delete self unless @notify.synchronize { @notified }
+      end
+    end
+
+    def listen(kind, blk)
+      @callbacks[kind] << blk
+      # finished before anyone asked
+      if @state == kind
+        call blk, (kind == :done ? @value : @exception)
+      end
+      self
+    end
+
+    def fire(kind, v)
+      if kind == :error && @callbacks[:error].empty?
+        error(v)
+        return
+      end
+      @callbacks[kind].each { |blk| call blk, v }
+    end
+
+    def call(blk, v)
+      blk.call v
+    rescue => e
+      error(e)
+    end
+  end
+
+  def self.worker(*args, &blk)
+    Worker.new(*args, &blk)
+  end
+end
+
+class Shoes::Types::App
+  def worker(*args, &blk)
+    Shoes::Worker.new(*args, &blk)
+  end
+end
@@ -27,6 +27,8 @@ larch = "#{ShoesDeps}/lib/#{arch}"
 CC = "gcc"
 pkgruby ="#{EXT_RUBY}/lib/pkgconfig/ruby-2.3.pc"
 pkggtk ="#{ularch}/pkgconfig/gtk+-3.0.pc" 
+# Use Ruby or curl for downloads
+RUBY_HTTP = false
 
 ADD_DLL = []
 
@@ -43,7 +45,7 @@ else
 end
 
 LINUX_CFLAGS << " -DSHOES_GTK -Wno-unused-but-set-variable -Wno-unused-variable"
-LINUX_CFLAGS << " -DRUBY_HTTP" 
+LINUX_CFLAGS << " -DRUBY_HTTP" if RUBY_HTTP
 LINUX_CFLAGS << " -I#{ShoesDeps}/usr/include "
 LINUX_CFLAGS << `pkg-config --cflags "#{pkgruby}"`.strip+" "
 LINUX_CFLAGS << `pkg-config --cflags "#{pkggtk}"`.strip+" "
@@ -59,9 +61,10 @@ RUBY_LDFLAGS = "-rdynamic -Wl,-export-dynamic "
 RUBY_LDFLAGS << "-L#{EXT_RUBY}/lib -lruby "
 RUBY_LDFLAGS << "-L#{ularch} -lrt -ldl -lcrypt -lm "
 
+CURL_LDFLAGS = `pkg-config --libs libcurl`.strip
 LINUX_LIBS =  %W[ungif jpeg].map { |x| "-l#{x}" }.join(' ')
 
-LINUX_LIBS << " #{RUBY_LDFLAGS} #{CAIRO_LIB} #{PANGO_LIB} #{MISC_LIB}"
+LINUX_LIBS << " #{CURL_LDFLAGS if !RUBY_HTTP} #{RUBY_LDFLAGS} #{CAIRO_LIB} #{PANGO_LIB} #{MISC_LIB}"
 
 SOLOCS = {}
 SOLOCS['ungif'] = "#{uldir}/libungif.so.4"
@@ -73,3 +76,4 @@ SOLOCS['ssl'] = "#{ularch}/libssl.so.1.0.0"
 SOLOCS['sqlite'] = "#{ularch}/libsqlite3.so.0.8.6"
 SOLOCS['ffi'] = "#{ularch}/libffi.so" 
 SOLOCS['rsvg2'] = "#{ularch}/librsvg-2.so"
+SOLOCS['curl'] = "#{ularch}/libcurl.so.4" if !RUBY_HTTP
@@ -14,7 +14,9 @@ end
 # figure out which ruby we need.
 rv =  RUBY_VERSION[/\d.\d/]
 
-LINUX_CFLAGS << " -DRUBY_HTTP"
+# Use Ruby or curl for downloads
+RUBY_HTTP = false
+LINUX_CFLAGS << " -DRUBY_HTTP" if RUBY_HTTP
 LINUX_CFLAGS << " -DRUBY_1_9"
 LINUX_CFLAGS << " -DDEBUG" if ENV['DEBUG']
 LINUX_CFLAGS << " -DSHOES_GTK -fPIC -shared -Wno-unused-but-set-variable"
@@ -70,6 +72,7 @@ LINUX_CFLAGS << " #{RUBY_CFLAGS} #{GTK_FLAGS} #{CAIRO_CFLAGS} #{PANGO_CFLAGS} #{
 # collect link settings together. Does order matter?
 LINUX_LIBS = "#{RUBY_LIB} #{GTK_LIB}  #{CAIRO_LIB} #{PANGO_LIB} #{MISC_LIB}"
 LINUX_LIBS << " -lfontconfig" # if APP['GTK'] == "gtk+-3.0"
+LINUX_LIBS << " #{`pkg-config --libs libcurl`.strip}" if !RUBY_HTTP
 # the following is only used to link the shoes code with main.o
 LINUX_LDFLAGS = "-L. -rdynamic -Wl,-export-dynamic"
 
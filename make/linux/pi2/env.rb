@@ -27,7 +27,7 @@ CC = "gcc"
 pkgruby ="#{EXT_RUBY}/lib/pkgconfig/ruby-2.3.pc"
 pkggtk ="#{ularch}/pkgconfig/gtk+-3.0.pc" 
 # Use Ruby or curl for downloads
-RUBY_HTTP = true
+RUBY_HTTP = false
 
 ADD_DLL = []
 
@@ -44,7 +44,8 @@ if APP['GDB']
 else
   LINUX_CFLAGS = " -O -Wall"
 end
-LINUX_CFLAGS << " -DRUBY_HTTP -DGNOTE" 
+LINUX_CFLAGS << " -DRUBY_HTTP" if RUBY_HTTP
+LINUX_CFLAGS << " -DGNOTE" 
 LINUX_CFLAGS << " -DSHOES_GTK -fPIC -Wno-unused-but-set-variable -Wno-unused-variable"
 LINUX_CFLAGS << " -I#{ShoesDeps}/usr/include "
 LINUX_CFLAGS << `pkg-config --cflags "#{pkgruby}"`.strip+" "
@@ -67,6 +68,7 @@ RUBY_LDFLAGS = "-rdynamic -Wl,-export-dynamic "
 RUBY_LDFLAGS << "-L#{EXT_RUBY}/lib -lruby "
 RUBY_LDFLAGS << "-L#{ularch} -lrt -ldl -lcrypt -lm "
 
+CURL_LDFLAGS = `pkg-config --libs libcurl`.strip
 LINUX_LIBS = LINUX_LIB_NAMES.map { |x| "-l#{x}" }.join(' ')
 
 LINUX_LIBS << " #{CURL_LDFLAGS if !RUBY_HTTP} #{RUBY_LDFLAGS} #{CAIRO_LIB} #{PANGO_LIB} #{MISC_LIB}"
@@ -76,6 +76,9 @@ CAIRO_CFLAGS = `pkg-config --cflags "#{ularch}/pkgconfig/cairo.pc"`.strip
 CAIRO_LIB = `pkg-config --libs "#{ularch}/pkgconfig/cairo.pc"`.strip
 PANGO_CFLAGS = `pkg-config --cflags "#{ularch}/pkgconfig/pango.pc"`.strip
 PANGO_LIB = `pkg-config --libs "#{ularch}/pkgconfig/pango.pc"`.strip
+# Use Ruby or curl for downloads
+RUBY_HTTP = false
+CURL_LDFLAGS = `pkg-config --libs "#{ularch}/pkgconfig/libcurl.pc"`.strip
 
 png_lib = 'png'
 
@@ -85,7 +88,7 @@ else
 #  LINUX_CFLAGS = " -O -Wall"
   LINUX_CFLAGS = " -O"
 end
-LINUX_CFLAGS << " -DRUBY_HTTP" 
+LINUX_CFLAGS << " -DRUBY_HTTP" if RUBY_HTTP
 LINUX_CFLAGS << " -DSHOES_GTK " 
 LINUX_CFLAGS << " -DGTK3 " unless APP['GTK'] == 'gtk+-2.0'
 LINUX_CFLAGS << xfixrvmp(`pkg-config --cflags "#{pkgruby}"`.strip)+" "
@@ -108,7 +111,7 @@ RUBY_LDFLAGS << "-L#{EXT_RUBY}/lib -lruby "
 LINUX_LIBS = "--sysroot=#{ShoesDeps} -L/usr/lib "
 LINUX_LIBS << LINUX_LIB_NAMES.map { |x| "-l#{x}" }.join(' ')
 
-LINUX_LIBS << " #{RUBY_LDFLAGS} #{CAIRO_LIB} #{PANGO_LIB} #{MISC_LIB}"
+LINUX_LIBS << " #{CURL_LDFLAGS if !RUBY_HTTP} #{RUBY_LDFLAGS} #{CAIRO_LIB} #{PANGO_LIB} #{MISC_LIB}"
 
 # This chould be used in pre_build instead of 
 # copy_deps_to_dist, although either would work. 
@@ -120,3 +123,4 @@ SOLOCS['libyaml'] = "#{ularch}/libyaml-0.so.2"
 SOLOCS['crypto'] = "#{ularch}/libcrypto.so.1.0.0"
 SOLOCS['ssl'] = "#{ularch}/libssl.so.1.0.0"
 SOLOCS['sqlite'] = "#{ularch}/libsqlite3.so.0.8.6"
+SOLOCS['curl'] = "#{ularch}/libcurl.so.4" if !RUBY_HTTP
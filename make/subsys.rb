@@ -86,6 +86,8 @@ dnl_obj = []
 mkdir_p "#{tp}/http", verbose: false
 if RUBY_PLATFORM =~ /darwin/
   dnl_src = ["shoes/http/nsurl.m"]
+elsif defined?(RUBY_HTTP) && !RUBY_HTTP
+  dnl_src = ["shoes/http/curl.c"]
 else
   dnl_src = ["shoes/http/rbload.c"]
 end
@@ -25,6 +25,7 @@ static void shoes_app_mark(shoes_app *app) {
     rb_gc_mark_maybe(app->styles);
     rb_gc_mark_maybe(app->groups);
     rb_gc_mark_maybe(app->owner);
+    rb_gc_mark_maybe(app->hover_target);
 }
 
 static void shoes_app_free(shoes_app *app) {
@@ -41,6 +42,7 @@ VALUE shoes_app_alloc(VALUE klass) {
     app->slot->owner = app;
     app->started = FALSE;
     app->owner = Qnil;
+    app->hover_target = Qnil;
     app->location = Qnil;
     app->canvas = shoes_canvas_new(cShoes, app);
     app->keypresses = rb_hash_new();
@@ -341,6 +343,19 @@ VALUE shoes_app_clear_cache(VALUE app, VALUE opts) {
 }
 
 
+VALUE shoes_app_get_cache_budget(VALUE app) {
+  rb_require("shoes/data");
+  return rb_funcall(rb_const_get(rb_cObject, rb_intern("DATABASE")), rb_intern("budget"), 0);
+}
+
+VALUE shoes_app_set_cache_budget(VALUE app, VALUE bytes) {
+  if (NUM2LL(bytes) < 0)
+    rb_raise(rb_eArgError, "cache budget must not be negative");
+  rb_require("shoes/data");
+  rb_funcall(rb_const_get(rb_cObject, rb_intern("DATABASE")), rb_intern("budget="), 1, bytes);
+  return bytes;
+}
+
 shoes_code shoes_app_start(VALUE allapps, char *uri) {
     int i;
     shoes_code code;
@@ -496,7 +511,7 @@ shoes_code shoes_app_paint(shoes_app *app) {
 shoes_code shoes_app_motion(shoes_app *app, int x, int y) {
     app->mousex = x;
     app->mousey = y;
-    shoes_canvas_send_motion(app->canvas, x, y, Qnil);
+    shoes_canvas_send_app_motion(app, x, y);
     return SHOES_OK;
 }
 
@@ -15,6 +15,8 @@
 #include "shoes/types/shape.h"
 #include "shoes/types/textblock.h"
 #include "shoes/http.h"
+#include <math.h>
+#include <sys/time.h>
 
 const double SHOES_PIM2   = 6.28318530717958647693;
 const double SHOES_PI     = 3.14159265358979323846;
@@ -210,6 +212,7 @@ void shoes_undo_transformation(cairo_t *cr, shoes_transform *st, shoes_place *pl
 
 VALUE shoes_add_ele(shoes_canvas *canvas, VALUE ele) {
     if (NIL_P(ele)) return ele;
+    if (canvas->app != NULL) canvas->app->hover_target = Qnil;
     if (canvas->insertion <= -1)
         rb_ary_push(canvas->contents, ele);
     else {
@@ -273,6 +276,7 @@ VALUE shoes_canvas_new(VALUE klass, shoes_app *app) {
 static void shoes_canvas_empty(shoes_canvas *canvas, int extras) {
     unsigned char stage = canvas->stage;
     canvas->stage = CANVAS_EMPTY;
+    if (canvas->app != NULL) canvas->app->hover_target = Qnil;
     shoes_ele_remove_all(canvas->contents);
     if (extras) shoes_extras_remove_all(canvas);
     canvas->stage = stage;
@@ -431,6 +435,7 @@ void shoes_canvas_remove_item(VALUE self, VALUE item, char c, char t) {
     long i;
     shoes_canvas *self_t;
     Data_Get_Struct(self, shoes_canvas, self_t);
+    if (self_t->app != NULL) self_t->app->hover_target = Qnil;
     shoes_native_remove_item(self_t->slot, item, c);
     if (t) {
         i = rb_ary_index_of(self_t->app->extras, item);
@@ -872,15 +877,48 @@ VALUE shoes_canvas_get_app(VALUE self) {
     return app;
 }
 
+static int shoes_repaint_held = 0;
+static VALUE shoes_repaint_pending = Qnil;
+
 void shoes_canvas_repaint_all(VALUE self) {
     shoes_canvas *canvas;
     self = shoes_find_canvas(self);
     Data_Get_Struct(self, shoes_canvas, canvas);
     if (canvas->stage == CANVAS_EMPTY) return;
+    if (shoes_repaint_held) {
+        if (!RTEST(rb_ary_includes(shoes_repaint_pending, self)))
+            rb_ary_push(shoes_repaint_pending, self);
+        return;
+    }
     shoes_canvas_compute(self);
     shoes_slot_repaint(canvas->slot);
 }
 
+// While held (e.g. during an animation tick) repaint_all only notes the
+// canvas, and the release lays out and repaints each one once.
+void shoes_canvas_repaint_hold() {
+    if (NIL_P(shoes_repaint_pending)) {
+        shoes_repaint_pending = rb_ary_new();
+        rb_gc_register_address(&shoes_repaint_pending);
+    }
+    shoes_repaint_held++;
+}
+
+void shoes_canvas_repaint_release() {
+    long i;
+    if (shoes_repaint_held == 0 || --shoes_repaint_held > 0) return;
+    for (i = 0; i < RARRAY_LEN(shoes_repaint_pending); i++) {
+        shoes_canvas *canvas;
+        VALUE c = rb_ary_entry(shoes_repaint_pending, i);
+        Data_Get_Struct(c, shoes_canvas, canvas);
+        // its window was closed while held
+        if (!RTEST(rb_ary_includes(shoes_world->apps, canvas->app->self)))
+            continue;
+        shoes_canvas_repaint_all(c);
+    }
+    rb_ary_clear(shoes_repaint_pending);
+}
+
 void shoes_canvas_ccall(VALUE self, ccallfunc func, ccallfunc2 func2, unsigned char check) {
     shoes_canvas *self_t, *pc;
     Data_Get_Struct(self, shoes_canvas, self_t);
@@ -945,13 +983,25 @@ EVENT_HANDLER(click);
 EVENT_HANDLER(hover);
 EVENT_HANDLER(leave);
 EVENT_HANDLER(release);
-EVENT_HANDLER(motion);
 EVENT_HANDLER(keydown);
 EVENT_HANDLER(keypress);
 EVENT_HANDLER(keyup);
 //EVENT_HANDLER(start);
 EVENT_HANDLER(finish);
 
+// motion(seconds) { |left, top| ... } throttles the block
+VALUE shoes_canvas_motion(int argc, VALUE *argv, VALUE self) {
+    VALUE val, block;
+    SETUP_CANVAS();
+    rb_scan_args(argc, argv, "01&", &val, &block);
+    if (!NIL_P(block) && !NIL_P(val)) {
+        ATTRSET(canvas->attr, motion, block);
+        canvas->attr = shoes_hash_set(canvas->attr, rb_intern("throttle"), rb_Float(val));
+    } else
+        ATTRSET(canvas->attr, motion, NIL_P(block) ? val : block);
+    return self;
+}
+
 VALUE shoes_canvas_start(int argc, VALUE *argv, VALUE self) {
     VALUE val, block;
     SETUP_CANVAS();
@@ -1148,6 +1198,98 @@ void shoes_canvas_send_release(VALUE self, int button, int x, int y) {
     }
 }
 
+static double shoes_canvas_ms() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000. + tv.tv_usec / 1000.;
+}
+
+// Runs the slot's motion block, at most once per `throttle` seconds if
+// that style is set. Only slots have motion blocks; hover and leave, on
+// slots and elements alike, run on the edge through CHECK_HOVER and so
+// are left alone. A position that arrives too soon is kept and handed
+// over later by shoes_canvas_send_held_motion, so the block always sees
+// where the pointer came to rest.
+static void shoes_canvas_motion_block(VALUE self, shoes_canvas *self_t, VALUE motion, int x, int y) {
+    VALUE throttle = shoes_hash_get(self_t->attr, rb_intern("throttle"));
+    double now = 0.;
+    if (!NIL_P(throttle)) {
+        now = shoes_canvas_ms();
+        if (now - self_t->motion_at < NUM2DBL(throttle) * 1000.) {
+            self_t->motionx = x;
+            self_t->motiony = y;
+            self_t->motion_held = 1;
+            return;
+        }
+    }
+    self_t->motion_at = now;
+    self_t->motion_held = 0;
+    shoes_safe_block(self, motion, rb_ary_new3(2, INT2NUM(x), INT2NUM(y)));
+}
+
+// Delivers held motion whose throttle has run out. Returns how many ms
+// until the next held one is due, or -1 if nothing is held.
+int shoes_canvas_send_held_motion(VALUE self) {
+    long i;
+    int wait = -1, w;
+    shoes_canvas *self_t;
+    Data_Get_Struct(self, shoes_canvas, self_t);
+
+    if (self_t->motion_held) {
+        VALUE motion = ATTR(self_t->attr, motion);
+        VALUE throttle = shoes_hash_get(self_t->attr, rb_intern("throttle"));
+        if (NIL_P(motion) || NIL_P(throttle)) {
+            self_t->motion_held = 0;
+        } else {
+            double left = NUM2DBL(throttle) * 1000. - (shoes_canvas_ms() - self_t->motion_at);
+            if (left <= 0.)
+                shoes_canvas_motion_block(self, self_t, motion, self_t->motionx, self_t->motiony);
+            else
+                wait = (int)ceil(left);
+        }
+    }
+
+    for (i = 0; i < RARRAY_LEN(self_t->contents); i++) {
+        VALUE ele = rb_ary_entry(self_t->contents, i);
+        if (rb_obj_is_kind_of(ele, cCanvas)) {
+            w = shoes_canvas_send_held_motion(ele);
+            if (w >= 0 && (wait < 0 || w < wait)) wait = w;
+        }
+    }
+    return wait;
+}
+
+// What the last walk found under the pointer, for shoes_canvas_send_app_motion.
+static long shoes_hover_hits;
+static VALUE shoes_hover_last;
+
+// Whether an element is under the pointer once its motion has been sent.
+// A textblock counts anywhere in its box, its links are its own business.
+static char shoes_canvas_ele_under(VALUE ele, int x, int y) {
+    if (rb_obj_is_kind_of(ele, cImage)) {
+        shoes_image *e;
+        Data_Get_Struct(ele, shoes_image, e);
+        return e->hover & HOVER_MOTION;
+    } else if (rb_obj_is_kind_of(ele, cSvg)) {
+        shoes_svg *e;
+        Data_Get_Struct(ele, shoes_svg, e);
+        return e->hover & HOVER_MOTION;
+    } else if (rb_obj_is_kind_of(ele, cPlot)) {
+        shoes_plot *e;
+        Data_Get_Struct(ele, shoes_plot, e);
+        return e->hover & HOVER_MOTION;
+    } else if (rb_obj_is_kind_of(ele, cShape)) {
+        shoes_shape *e;
+        Data_Get_Struct(ele, shoes_shape, e);
+        return e->hover & HOVER_MOTION;
+    } else if (rb_obj_is_kind_of(ele, cTextBlock)) {
+        shoes_textblock *e;
+        Data_Get_Struct(ele, shoes_textblock, e);
+        return IS_INSIDE(e, x, y);
+    }
+    return 0;
+}
+
 VALUE shoes_canvas_send_motion(VALUE self, int x, int y, VALUE url) {
     char oh, ch = 0, h = 0, *n = 0;
     long i;
@@ -1158,6 +1300,7 @@ VALUE shoes_canvas_send_motion(VALUE self, int x, int y, VALUE url) {
     oh = self_t->hover;
     ch = h = IS_INSIDE(self_t, x, y);
     CHECK_HOVER(self_t, h, n);
+    if (self_t->hover & HOVER_MOTION) shoes_hover_hits++;
 
     if (ORIGIN(self_t->place)) {
         y += self_t->slot->scrolly;
@@ -1170,9 +1313,8 @@ VALUE shoes_canvas_send_motion(VALUE self, int x, int y, VALUE url) {
     h = 0;
     if (ATTR(self_t->attr, hidden) != Qtrue) {
         VALUE motion = ATTR(self_t->attr, motion);
-        if (!NIL_P(motion)) {
-            shoes_safe_block(self, motion, rb_ary_new3(2, INT2NUM(x), INT2NUM(y)));
-        }
+        if (!NIL_P(motion))
+            shoes_canvas_motion_block(self, self_t, motion, x, y);
 
         for (i = RARRAY_LEN(self_t->contents) - 1; i >= 0; i--) {
             VALUE urll = Qnil;
@@ -1193,6 +1335,11 @@ VALUE shoes_canvas_send_motion(VALUE self, int x, int y, VALUE url) {
                 urll = shoes_shape_motion(ele, ox, oy, NULL);
             }
 
+            if (!rb_obj_is_kind_of(ele, cCanvas) && shoes_canvas_ele_under(ele, ox, oy)) {
+                shoes_hover_hits++;
+                shoes_hover_last = ele;
+            }
+
             if (NIL_P(url)) url = urll;
         }
 
@@ -1209,6 +1356,98 @@ VALUE shoes_canvas_send_motion(VALUE self, int x, int y, VALUE url) {
     return url;
 }
 
+// Pointer motion for the whole window. Walking every slot and element on
+// each move is what hover and leave need in general, but most moves stay on
+// the same thing. So when a walk finds a single image, svg, plot or shape
+// under the pointer (with nothing else but the slots it sits in), that is
+// kept as the app's hover target and later moves re-test only it and its
+// slots, until it misses. Adding or removing anything drops the target.
+#define SHOES_HOVER_DEPTH 32
+
+static int shoes_canvas_target_motion(shoes_app *app, int x, int y) {
+    VALUE chain[SHOES_HOVER_DEPTH], target = app->hover_target, url = Qnil, c;
+    int mx[SHOES_HOVER_DEPTH], my[SHOES_HOVER_DEPTH], n = 0, i;
+    shoes_basic *basic;
+    shoes_canvas *canvas;
+
+    if (NIL_P(target)) return FALSE;
+    Data_Get_Struct(target, shoes_basic, basic);
+    for (c = basic->parent; !NIL_P(c); c = canvas->parent) {
+        if (n == SHOES_HOVER_DEPTH) return FALSE;
+        chain[n++] = c;
+        Data_Get_Struct(c, shoes_canvas, canvas);
+    }
+    if (n == 0 || chain[n - 1] != app->canvas) return FALSE;
+
+    // the same sums shoes_canvas_send_motion does on the way in
+    for (i = n - 1; i >= 0; i--) {
+        Data_Get_Struct(chain[i], shoes_canvas, canvas);
+        if (!IS_INSIDE(canvas, x, y) || ATTR(canvas->attr, hidden) == Qtrue)
+            return FALSE;
+        if (ORIGIN(canvas->place)) {
+            y += canvas->slot->scrolly;
+            mx[i] = x;
+            my[i] = y;
+            x = x - canvas->place.ix + canvas->place.dx;
+            y = y - (canvas->place.iy + canvas->place.dy);
+            if (y < canvas->slot->scrolly || x < 0 || y > canvas->slot->scrolly + canvas->place.ih || x > canvas->place.iw)
+                return FALSE;
+        } else {
+            mx[i] = x;
+            my[i] = y;
+        }
+    }
+
+    if (rb_obj_is_kind_of(target, cImage))
+        url = shoes_image_motion(target, x, y, NULL);
+    else if (rb_obj_is_kind_of(target, cSvg))
+        url = shoes_svg_motion(target, x, y, NULL);
+    else if (rb_obj_is_kind_of(target, cPlot))
+        url = shoes_plot_motion(target, x, y, NULL);
+    else if (rb_obj_is_kind_of(target, cShape))
+        url = shoes_shape_motion(target, x, y, NULL);
+    // if it was left, its leave has run and the walk does the rest
+    if (!shoes_canvas_ele_under(target, x, y)) return FALSE;
+
+    for (i = n - 1; i >= 0; i--) {
+        VALUE motion;
+        Data_Get_Struct(chain[i], shoes_canvas, canvas);
+        motion = ATTR(canvas->attr, motion);
+        if (!NIL_P(motion))
+            shoes_canvas_motion_block(chain[i], canvas, motion, mx[i], my[i]);
+    }
+    if (NIL_P(url) && app->cursor == s_link)
+        shoes_app_cursor(app, s_arrow);
+    return TRUE;
+}
+
+void shoes_canvas_send_app_motion(shoes_app *app, int x, int y) {
+    VALUE target, c;
+    long depth = 0;
+    shoes_basic *basic;
+    shoes_canvas *canvas;
+
+    if (shoes_canvas_target_motion(app, x, y)) return;
+
+    app->hover_target = Qnil;
+    shoes_hover_hits = 0;
+    shoes_hover_last = Qnil;
+    shoes_canvas_send_motion(app->canvas, x, y, Qnil);
+    target = shoes_hover_last;
+    shoes_hover_last = Qnil;
+
+    if (NIL_P(target) || !(rb_obj_is_kind_of(target, cImage) || rb_obj_is_kind_of(target, cSvg) ||
+                           rb_obj_is_kind_of(target, cPlot) || rb_obj_is_kind_of(target, cShape)))
+        return;
+    Data_Get_Struct(target, shoes_basic, basic);
+    for (c = basic->parent; !NIL_P(c); c = canvas->parent) {
+        Data_Get_Struct(c, shoes_canvas, canvas);
+        depth++;
+    }
+    if (shoes_hover_hits == depth + 1)
+        app->hover_target = target;
+}
+
 void shoes_canvas_wheel_way(shoes_canvas *self_t, ID dir) {
     if (dir == s_up)
         shoes_slot_scroll_to(self_t, -32, 1);
@@ -130,9 +130,25 @@ typedef enum {
     SHOES_IMAGE_NONE,
     SHOES_IMAGE_PNG,
     SHOES_IMAGE_JPEG,
-    SHOES_IMAGE_GIF
+    SHOES_IMAGE_GIF,
+    SHOES_IMAGE_BMP,
+    SHOES_IMAGE_OTHER
 } shoes_image_format;
 
+//
+// image codec, matched on magic bytes. size() only reads the header,
+// load() decodes into an ARGB32 surface. Both get the whole file.
+//
+#define SHOES_IMAGE_CODECS_MAX 16
+typedef struct {
+    const char *name;
+    shoes_image_format format;
+    const char *magic;
+    int magic_len, magic_offset;
+    int (*size)(const unsigned char *data, size_t len, int *width, int *height);
+    cairo_surface_t *(*load)(const unsigned char *data, size_t len, int *width, int *height);
+} shoes_image_codec;
+
 typedef struct {
     cairo_surface_t *surface;
     cairo_pattern_t *pattern;
@@ -149,6 +165,26 @@ typedef struct {
     shoes_cached_image *image;
 } shoes_cache_entry;
 
+//
+// a parsed svg, shared by every svghandle made from the same file (path and
+// mtime) or the same content. See shoes/types/svg.c
+//
+#define SHOES_SVGDOC_PARSING 0
+#define SHOES_SVGDOC_READY   1
+#define SHOES_SVGDOC_FAILED  2
+
+typedef struct {
+    char *key;              // in shoes_world->svg_cache, NULL once private
+    char *path, *data;      // the source, data is a copy of the content
+    long len;
+    RsvgHandle *handle;     // set by the parser before state leaves PARSING
+    volatile gint state;
+    int refs;               // svghandles and a pending parse, GUI thread only
+    GHashTable *rasters;    // screen renderings by group and scale, GUI thread only
+} shoes_svgdoc;
+
+void shoes_svgdoc_parsed(shoes_svgdoc *);
+
 //
 // image struct
 //
@@ -185,13 +221,30 @@ typedef struct {
 typedef struct {
     VALUE maxv;
     VALUE minv;
-    VALUE values;
+    VALUE values;   // Array the data was loaded from (or materialized to), or nil
     VALUE name;
     VALUE desc;
-    VALUE labels;
+    VALUE labels;   // nil when we make up "1", "2", ... on demand
     VALUE strokes;
     VALUE point_type;
     VALUE color;
+    VALUE plot;     // plot it was last added to, or nil
+    double *data;   // what gets drawn, NAN for a missing (nil) value
+    long count;
+    long capa;
+    double *buf;    // allocation behind data
+    long ring;      // streaming: capacity of the ring, else 0
+    long head;      // streaming: slot of the oldest value
+    long total;     // values ever added, numbers the made up labels
+    double lo, hi;  // extent of data, NAN when there's nothing
+    char stale;     // lo/hi need a rescan
+    double *pyramid; // lo/hi of each block of values and of each pair above, see chart_series.c
+    long blocks;    // blocks the pyramid was built for
+    char unindexed; // pyramid is out of date
+    long version;   // bumped by every change to data
+    double *keys;   // when labels is nil, they are made from these (seconds
+    long nkeys;     // through keyfmt, or numbers); NAN or past nkeys numbers it
+    char *keyfmt;
 } shoes_chart_series;
 
 //
@@ -217,9 +270,11 @@ typedef struct {
     int x_ticks;   // number of x_axis (which means a vertical grid line draw)
     int y_ticks;   // number of (left side) y axis horizontial grid lines)
     double radar_label_mult; // radius multipler (1.1 ex)
+    long density;  // scatter: binned into a heatmap from this many points, 0 never
     char  *fontname; // not a Shoes name, cairo "toy" name - might be the same
     int beg_idx;  //used for zooming in
     int end_idx;  // and zooming out
+    char autoscale; // zoom fits the vertical scale to the values in view
     int title_h;
     PangoFontDescription *title_pfd;
     int caption_h;
@@ -235,6 +290,11 @@ typedef struct {
     int graph_y;
     char hover;
     shoes_transform *st;
+    int layer;    // what the painters draw this pass, see PLOT_LAYER_* in plot.h
+    cairo_surface_t *static_layer;  // everything but the data, reused between paints
+    double static_key[20];          // what it was drawn for (size, range, scales)
+    char static_dirty;
+    void *near_grid;  // scatter: points by grid cell for near(), see plot_near.c
 } shoes_plot;
 
 //
@@ -255,6 +315,9 @@ typedef struct {
     int topy, fully;          // since we often stack vertically
     int width, height;        // the full height and width used by this box
     char hover;
+    double motion_at;         // when the motion block last ran, in ms
+    int motionx, motiony;     // a throttled position still to be delivered
+    char motion_held;
     struct _shoes_app *app;
     SHOES_SLOT_OS *slot;
     SHOES_GROUP_OS group;
@@ -347,12 +410,16 @@ int shoes_canvas_independent(shoes_canvas *);
 VALUE shoes_find_canvas(VALUE);
 VALUE shoes_canvas_get_app(VALUE);
 void shoes_canvas_repaint_all(VALUE);
+void shoes_canvas_repaint_hold();
+void shoes_canvas_repaint_release();
 void shoes_canvas_compute(VALUE);
 VALUE shoes_canvas_goto(VALUE, VALUE);
 VALUE shoes_canvas_send_click(VALUE, int, int, int);
 VALUE shoes_canvas_send_click2(VALUE self, int button, int x, int y, VALUE *clicked);
 void shoes_canvas_send_release(VALUE, int, int, int);
 VALUE shoes_canvas_send_motion(VALUE, int, int, VALUE);
+void shoes_canvas_send_app_motion(struct _shoes_app *, int, int);
+int shoes_canvas_send_held_motion(VALUE);
 void shoes_canvas_send_wheel(VALUE, ID, int, int);
 void shoes_canvas_wheel_way(shoes_canvas *, ID);
 void shoes_canvas_send_keydown(VALUE, VALUE);
@@ -387,6 +454,10 @@ VALUE shoes_chart_series_new(int, VALUE *, VALUE);
 VALUE shoes_chart_series_alloc(VALUE);
 VALUE shoes_chart_series_values(VALUE);
 VALUE shoes_chart_series_labels(VALUE);
+VALUE shoes_chart_series_values_set(VALUE, VALUE);
+VALUE shoes_chart_series_size(VALUE);
+VALUE shoes_chart_series_push(VALUE, VALUE);
+VALUE shoes_chart_series_push_many(VALUE, VALUE);
 VALUE shoes_chart_series_min(VALUE);
 VALUE shoes_chart_series_min_set(VALUE, VALUE);
 VALUE shoes_chart_series_max(VALUE);
@@ -417,7 +488,10 @@ VALUE shoes_plot_set_first(VALUE, VALUE);
 VALUE shoes_plot_get_last(VALUE);
 VALUE shoes_plot_set_last(VALUE, VALUE);
 VALUE shoes_plot_near(VALUE, VALUE);
-VALUE shoes_plot_zoom(VALUE, VALUE, VALUE);
+VALUE shoes_plot_nearest(VALUE, VALUE, VALUE);
+VALUE shoes_plot_zoom(int, VALUE *, VALUE);
+VALUE shoes_plot_pan(VALUE, VALUE);
+VALUE shoes_plot_load_csv(int, VALUE *, VALUE);
 VALUE shoes_plot_get_actual_width(VALUE);
 VALUE shoes_plot_get_actual_height(VALUE);
 VALUE shoes_plot_get_actual_left(VALUE);
@@ -457,10 +531,28 @@ typedef struct {
     unsigned long status;
     char *cachepath, *filepath, *uripath, *etag;
     char hexdigest[42];
+    char digested;      // hexdigest was taken from the body as it downloaded
     VALUE slot;
 } shoes_image_download_event;
 
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    char mapped;
+#ifdef SHOES_WIN32
+    HANDLE file, map;
+#endif
+} shoes_image_file;
+
 shoes_code shoes_load_imagesize(VALUE, int *, int *);
+int shoes_image_file_open(char *, shoes_image_file *);
+void shoes_image_file_close(shoes_image_file *);
+int shoes_jpeg_dimensions(const unsigned char *, size_t, int *, int *);
+cairo_surface_t *shoes_jpeg_load_region(const unsigned char *, size_t, int, int, int, int, int);
+cairo_surface_t *shoes_jpeg_load_thumbnail(const unsigned char *, size_t, int);
+void shoes_tiled_image_decoded(void *);   // a tile job back from the pool
+void shoes_image_codec_register(shoes_image_codec *);
+shoes_image_codec *shoes_image_codec_find(const unsigned char *, size_t);
 shoes_cached_image *shoes_cached_image_new(int, int, cairo_surface_t *);
 shoes_cached_image *shoes_load_image(VALUE, VALUE, VALUE);
 unsigned char shoes_image_downloaded(shoes_image_download_event *);
@@ -80,6 +80,9 @@ typedef struct {
 
 typedef struct {
     GtkWidget *window;
+    int motionx, motiony;       // latest pointer position, not yet sent on
+    char motion_pending;
+    guint motion_tick, motion_retry;
 } shoes_app_gtk, SHOES_APP_OS;
 
 typedef struct {
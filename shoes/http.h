@@ -8,6 +8,17 @@
 
 #include "shoes/http/common.h"
 
+// SHA1, in shoes/image.c. The image cache names its files by digest.
+typedef struct {
+    unsigned int state[5];
+    unsigned int count[2];
+    unsigned char buffer[64];
+} SHA1_CTX;
+
+void SHA1Init(SHA1_CTX* context);
+void SHA1Update(SHA1_CTX* context, unsigned char* data, unsigned int len);
+void SHA1Final(unsigned char digest[20], SHA1_CTX* context);
+
 typedef struct {
     char *url;
     char *scheme;
@@ -17,6 +28,8 @@ typedef struct {
 
     char *method, *body;
     unsigned long bodylen;
+    int upload_fd;
+    LONG_LONG upload_size;    // -1 when unknown
     SHOES_DOWNLOAD_HEADERS headers;
 
     char *mem;
@@ -26,11 +39,13 @@ typedef struct {
     shoes_http_handler handler;
     void *data;
     unsigned char flags;
+    unsigned char priority;
 } shoes_http_request;
 
 void shoes_download(shoes_http_request *req);
 void shoes_native_download(shoes_http_request *req);
-//void shoes_queue_download(shoes_http_request *req);
+void shoes_queue_download(shoes_http_request *req);
+void shoes_http_prioritize(const char *url, unsigned char priority);
 //shoes_cached_image* shoes_no_cache_queue_download(shoes_http_request *req);
 VALUE shoes_http_err(SHOES_DOWNLOAD_ERROR error);
 SHOES_DOWNLOAD_HEADERS shoes_http_headers(VALUE hsh);
@@ -8,8 +8,17 @@
 #define SHOES_CHUNKSIZE 16384
 
 #define SHOES_DL_REDIRECTS 1
+#define SHOES_DL_STREAM    2   // hand the body over in SHOES_CHUNKSIZE pieces
+#define SHOES_DL_UPLOAD_FD 4   // the request body is read from upload_fd
+#define SHOES_DL_DIGEST    8   // SHA1 the body as it arrives, see SHOES_HTTP_DIGEST
 #define SHOES_DL_DEFAULTS  (SHOES_DL_REDIRECTS)
 
+// priority classes, most urgent first
+#define SHOES_HTTP_PRIORITY_VISIBLE 0
+#define SHOES_HTTP_PRIORITY_NORMAL  1
+#define SHOES_HTTP_PRIORITY_LOW     2
+#define SHOES_HTTP_PRIORITIES       3
+
 #define SHOES_DOWNLOAD_CONTINUE 0
 #define SHOES_DOWNLOAD_HALT 1
 
@@ -17,6 +26,8 @@
 #define SHOES_HTTP_HEADER    4
 #define SHOES_HTTP_CONNECTED 5
 #define SHOES_HTTP_TRANSFER  10
+#define SHOES_HTTP_DATA      12
+#define SHOES_HTTP_DIGEST    14  // body is the 20 byte SHA1, sent just before COMPLETED
 #define SHOES_HTTP_COMPLETED 15
 #define SHOES_HTTP_ERROR     20
 
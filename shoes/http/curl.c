@@ -11,13 +11,20 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 typedef struct {
   char *mem;
   unsigned long memlen;
   FILE *fp;
   char *body;
+  char *chunk;
+  size_t chunklen;
+  int upload_fd;
+  SHA1_CTX *sha1;
   size_t size, total, readpos, bodylen;
   unsigned long status;
   shoes_http_handler handler;
@@ -48,8 +55,9 @@ shoes_curl_header_funk(char *ptr, size_t size, size_t nmemb, void *user)
   }
 
   HTTP_HEADER(ptr, realsize, data->handler, data->data);
-  if ((data->mem != NULL || data->fp != NULL) &&
-      strncmp(ptr, content_len_str, strlen(content_len_str)) == 0)
+  // HTTP/2 sends header names in lower case
+  if ((data->mem != NULL || data->fp != NULL || data->chunk != NULL) &&
+      strncasecmp(ptr, content_len_str, strlen(content_len_str)) == 0)
   {
     data->total = strtoull(ptr + strlen(content_len_str), NULL, 10);
     if (data->mem != NULL && data->total > data->memlen)
@@ -67,6 +75,11 @@ shoes_curl_read_funk(void *ptr, size_t size, size_t nmemb, void *user)
 {
   shoes_curl_data *data = (shoes_curl_data *)user;
   size_t realsize = size * nmemb;
+  if (data->upload_fd >= 0)
+  {
+    ssize_t n = read(data->upload_fd, ptr, realsize);
+    return n < 0 ? CURL_READFUNC_ABORT : (size_t)n;
+  }
   if (realsize > data->bodylen - data->readpos)
     realsize = data->bodylen - data->readpos;
   SHOE_MEMCPY(ptr, &(data->body[data->readpos]), char, realsize);
@@ -74,6 +87,27 @@ shoes_curl_read_funk(void *ptr, size_t size, size_t nmemb, void *user)
   return realsize;
 }
 
+// hands the filled part of the chunk buffer to the handler
+static int
+shoes_curl_flush(shoes_curl_data *data)
+{
+  int halt = 0;
+  if (data->chunklen > 0 && data->handler != NULL)
+  {
+    shoes_http_event *event = SHOE_ALLOC(shoes_http_event);
+    SHOE_MEMZERO(event, shoes_http_event, 1);
+    event->stage = SHOES_HTTP_DATA;
+    event->body = data->chunk;
+    event->bodylen = data->chunklen;
+    event->transferred = data->size;
+    event->total = data->total;
+    halt = data->handler(event, data->data) & SHOES_DOWNLOAD_HALT;
+    SHOE_FREE(event);
+  }
+  data->chunklen = 0;
+  return halt;
+}
+
 size_t
 shoes_curl_write_funk(void *ptr, size_t size, size_t nmemb, void *user)
 {
@@ -83,12 +117,25 @@ shoes_curl_write_funk(void *ptr, size_t size, size_t nmemb, void *user)
   {
     HTTP_EVENT(data->handler, SHOES_HTTP_CONNECTED, data->last, 0, 0, data->total, data->data, NULL, return -1);
   }
+  if (data->chunk != NULL)
+  {
+    size_t done = 0;
+    while (done < realsize)
+    {
+      size_t n = min(realsize - done, SHOES_CHUNKSIZE - data->chunklen);
+      SHOE_MEMCPY(&(data->chunk[data->chunklen]), (char *)ptr + done, char, n);
+      data->chunklen += n;
+      done += n;
+      if (data->chunklen == SHOES_CHUNKSIZE && shoes_curl_flush(data))
+        return -1;
+    }
+  }
   if (data->mem != NULL)
   {
     if (data->size + realsize > data->memlen)
     {
-      while (data->size + realsize > data->memlen)
-        data->memlen += SHOES_BUFSIZE;
+      // no Content-Length to go by, so grow geometrically
+      data->memlen = max(data->memlen * 2, data->size + realsize);
       SHOE_REALLOC_N(data->mem, char, data->memlen);
       if (data->mem == NULL) return -1;
     }
@@ -96,6 +143,8 @@ shoes_curl_write_funk(void *ptr, size_t size, size_t nmemb, void *user)
   }
   if (data->fp != NULL)
     realsize = fwrite(ptr, size, nmemb, data->fp) * size;
+  if (data->sha1 != NULL)
+    SHA1Update(data->sha1, (unsigned char *)ptr, (unsigned int)realsize);
   if (realsize > 0)
     data->size += realsize;
   return realsize;
@@ -113,14 +162,11 @@ shoes_curl_progress_funk(void *user, double dltotal, double dlnow, double ultota
   return 0;
 }
 
-void
-shoes_download(shoes_http_request *req)
+static shoes_curl_data *
+shoes_curl_setup(shoes_http_request *req, CURL *curl)
 {
   char uagent[SHOES_BUFSIZE];
-  CURL *curl = curl_easy_init();
-  CURLcode res;
   shoes_curl_data *cdata = SHOE_ALLOC(shoes_curl_data);
-  if (curl == NULL) return;
 
   sprintf(uagent, "Shoes/0.r%d (%s) %s/%d", SHOES_REVISION, SHOES_PLATFORM,
     SHOES_RELEASE_NAME, SHOES_BUILD_DATE);
@@ -141,18 +187,33 @@ shoes_download(shoes_http_request *req)
   cdata->status = 0;
   cdata->curl = curl;
   cdata->body = NULL;
+  cdata->chunk = NULL;
+  cdata->chunklen = 0;
+  cdata->upload_fd = -1;
+  cdata->sha1 = NULL;
 
   if (req->mem == NULL && req->filepath != NULL)
   {
     cdata->fp = fopen(req->filepath, "wb");
-    if (cdata->fp == NULL) goto done;
-  } 
+    if (cdata->fp == NULL)
+    {
+      SHOE_FREE(cdata);
+      return NULL;
+    }
+  }
+  if (req->flags & SHOES_DL_STREAM)
+    cdata->chunk = SHOE_ALLOC_N(char, SHOES_CHUNKSIZE);
+  if (req->flags & SHOES_DL_DIGEST)
+  {
+    cdata->sha1 = SHOE_ALLOC(SHA1_CTX);
+    SHA1Init(cdata->sha1);
+  }
 
   curl_easy_setopt(curl, CURLOPT_NOSIGNAL, TRUE);
   curl_easy_setopt(curl, CURLOPT_URL, req->url);
   curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, shoes_curl_header_funk);
   curl_easy_setopt(curl, CURLOPT_WRITEHEADER, cdata);
-  if (cdata->mem != NULL || cdata->fp != NULL)
+  if (cdata->mem != NULL || cdata->fp != NULL || cdata->chunk != NULL)
   {
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, shoes_curl_write_funk);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, cdata);
@@ -180,8 +241,21 @@ shoes_download(shoes_http_request *req)
     curl_easy_setopt(curl, CURLOPT_INFILESIZE, cdata->bodylen);
     curl_easy_setopt(curl, CURLOPT_READFUNCTION, shoes_curl_read_funk);
   }
+  else if (req->flags & SHOES_DL_UPLOAD_FD)
+  {
+    // -1 sends the body chunked
+    cdata->upload_fd = req->upload_fd;
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 1);
+    curl_easy_setopt(curl, CURLOPT_INFILE, cdata);
+    curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)req->upload_size);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, shoes_curl_read_funk);
+  }
+  return cdata;
+}
 
-  res = curl_easy_perform(curl);
+static void
+shoes_curl_finish(shoes_http_request *req, shoes_curl_data *cdata, CURLcode res)
+{
   req->size = cdata->size;
   req->mem = cdata->mem;
 
@@ -204,33 +278,388 @@ shoes_download(shoes_http_request *req)
     fclose(cdata->fp);
     cdata->fp = NULL;
   }
+  if (cdata->chunk != NULL && shoes_curl_flush(cdata))
+    goto done;
+  if (cdata->sha1 != NULL && cdata->handler != NULL)
+  {
+    unsigned char digest[20];
+    shoes_http_event *event = SHOE_ALLOC(shoes_http_event);
+    SHA1Final(digest, cdata->sha1);
+    SHOE_MEMZERO(event, shoes_http_event, 1);
+    event->stage = SHOES_HTTP_DIGEST;
+    event->body = (const char *)digest;
+    event->bodylen = 20;
+    cdata->handler(event, cdata->data);
+    SHOE_FREE(event);
+  }
 
   HTTP_EVENT(cdata->handler, SHOES_HTTP_COMPLETED, cdata->last, 100, req->size, req->size, cdata->data, req->mem, goto done);
 
 done:
   if (cdata->fp != NULL)
     fclose(cdata->fp);
+  if (cdata->chunk != NULL)
+    SHOE_FREE(cdata->chunk);
+  if (cdata->sha1 != NULL)
+    SHOE_FREE(cdata->sha1);
+  SHOE_FREE(cdata);
+}
+
+void
+shoes_download(shoes_http_request *req)
+{
+  shoes_curl_data *cdata;
+  CURL *curl = curl_easy_init();
+  if (curl == NULL) return;
+
+  cdata = shoes_curl_setup(req, curl);
   if (cdata != NULL)
-    SHOE_FREE(cdata);
+    shoes_curl_finish(req, cdata, curl_easy_perform(curl));
+  curl_easy_cleanup(curl);
+}
 
+//
+// The download engine. A single thread drives every queued request through
+// one curl multi handle, so connections are kept alive and reused, HTTP/2
+// streams to the same host share a connection, and DNS answers and TLS
+// sessions are shared too. Requests wait in one queue per priority class
+// and are started, most urgent first, as long as the total and per-host
+// limits allow. Handlers report back through the GUI message queue, which
+// runs on the GTK main loop, so the window keeps painting meanwhile.
+// Waiting requests are also kept in a table by URL, so an image that
+// scrolls into view finds its request without walking the queues.
+//
+#define SHOES_HTTP_MAX_ACTIVE 24
+#define SHOES_HTTP_HOST_MAX    6
+#define SHOES_HTTP_BUCKETS   256   // a power of two
+
+typedef struct _shoes_curl_job {
+  shoes_http_request *req;
+  shoes_curl_data *cdata;
+  CURL *curl;
+  struct _shoes_curl_job *next, *prev;   // prev only while waiting
+  struct _shoes_curl_job *hnext;          // same bucket, while waiting
+  unsigned int hash;
+} shoes_curl_job;
+
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  int started;
+  CURLM *multi;
+  CURLSH *share;
+  shoes_curl_job *head[SHOES_HTTP_PRIORITIES], *tail[SHOES_HTTP_PRIORITIES];
+  shoes_curl_job *waiting[SHOES_HTTP_BUCKETS];
+  shoes_curl_job *active;
+  int nactive;
+  int wake[2];   // before curl_multi_wakeup, new requests write here
+} shoes_curl_engine = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+static unsigned int
+shoes_curl_hash(const char *url)
+{
+  unsigned int h = 5381;
+  if (url == NULL) return 0;
+  while (*url) h = h * 33 + (unsigned char)*url++;
+  return h;
+}
+
+// the queue and the table below are only touched with the lock held
+static void
+shoes_curl_enqueue(shoes_curl_job *job, int pri)
+{
+  job->next = NULL;
+  job->prev = shoes_curl_engine.tail[pri];
+  if (job->prev != NULL) job->prev->next = job;
+  else shoes_curl_engine.head[pri] = job;
+  shoes_curl_engine.tail[pri] = job;
+}
+
+static void
+shoes_curl_dequeue(shoes_curl_job *job, int pri)
+{
+  if (job->prev != NULL) job->prev->next = job->next;
+  else shoes_curl_engine.head[pri] = job->next;
+  if (job->next != NULL) job->next->prev = job->prev;
+  else shoes_curl_engine.tail[pri] = job->prev;
+  job->next = job->prev = NULL;
+}
+
+static void
+shoes_curl_unwait(shoes_curl_job *job)
+{
+  shoes_curl_job **j;
+  for (j = &shoes_curl_engine.waiting[job->hash & (SHOES_HTTP_BUCKETS - 1)]; *j != NULL; j = &(*j)->hnext)
+    if (*j == job)
+    {
+      *j = job->hnext;
+      break;
+    }
+  job->hnext = NULL;
+}
+
+static void
+shoes_curl_wakeup()
+{
+#if LIBCURL_VERSION_NUM >= 0x074400
+  curl_multi_wakeup(shoes_curl_engine.multi);
+#else
+  if (shoes_curl_engine.wake[1] >= 0 && write(shoes_curl_engine.wake[1], "w", 1) < 0)
+    return;   // full, so a wakeup is already pending
+#endif
+}
+
+static int
+shoes_curl_pending()
+{
+  int i;
+  for (i = 0; i < SHOES_HTTP_PRIORITIES; i++)
+    if (shoes_curl_engine.head[i] != NULL) return 1;
+  return 0;
+}
+
+static int
+shoes_curl_host_active(const char *host)
+{
+  int n = 0;
+  shoes_curl_job *job;
+  for (job = shoes_curl_engine.active; job != NULL; job = job->next)
+    if (host != NULL && job->req->host != NULL && strcmp(job->req->host, host) == 0)
+      n++;
+  return n;
+}
+
+// start whatever the limits allow, call with the lock held
+static void
+shoes_curl_admit()
+{
+  int i;
+  for (i = 0; i < SHOES_HTTP_PRIORITIES && shoes_curl_engine.nactive < SHOES_HTTP_MAX_ACTIVE; i++)
+  {
+    shoes_curl_job *job = shoes_curl_engine.head[i];
+    while (job != NULL && shoes_curl_engine.nactive < SHOES_HTTP_MAX_ACTIVE)
+    {
+      shoes_curl_job *next = job->next;
+      if (shoes_curl_host_active(job->req->host) >= SHOES_HTTP_HOST_MAX)
+      {
+        job = next;
+        continue;
+      }
+
+      shoes_curl_dequeue(job, i);
+      shoes_curl_unwait(job);
+
+      job->curl = curl_easy_init();
+      job->cdata = job->curl == NULL ? NULL : shoes_curl_setup(job->req, job->curl);
+      if (job->cdata == NULL)
+      {
+        if (job->curl != NULL) curl_easy_cleanup(job->curl);
+        shoes_http_request_free(job->req);
+        free(job->req);
+        SHOE_FREE(job);
+      }
+      else
+      {
+        curl_easy_setopt(job->curl, CURLOPT_PRIVATE, job);
+        curl_easy_setopt(job->curl, CURLOPT_SHARE, shoes_curl_engine.share);
+        curl_easy_setopt(job->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+#if LIBCURL_VERSION_NUM >= 0x072f00
+        curl_easy_setopt(job->curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(job->curl, CURLOPT_PIPEWAIT, 1L);
+#endif
+        job->next = shoes_curl_engine.active;
+        shoes_curl_engine.active = job;
+        shoes_curl_engine.nactive++;
+        curl_multi_add_handle(shoes_curl_engine.multi, job->curl);
+      }
+      job = next;
+    }
+  }
+}
+
+static void
+shoes_curl_done(CURL *curl, CURLcode res)
+{
+  shoes_curl_job *job = NULL, **j;
+  curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&job);
+  curl_multi_remove_handle(shoes_curl_engine.multi, curl);
+
+  pthread_mutex_lock(&shoes_curl_engine.lock);
+  for (j = &shoes_curl_engine.active; *j != NULL; j = &(*j)->next)
+    if (*j == job)
+    {
+      *j = job->next;
+      shoes_curl_engine.nactive--;
+      break;
+    }
+  pthread_mutex_unlock(&shoes_curl_engine.lock);
+
+  shoes_curl_finish(job->req, job->cdata, res);
   curl_easy_cleanup(curl);
+  shoes_http_request_free(job->req);
+  free(job->req);
+  SHOE_FREE(job);
 }
 
 void *
 shoes_download2(void *data)
 {
-  shoes_http_request *req = (shoes_http_request *)data;
-  shoes_download(req);
+  for (;;)
+  {
+    int running, left;
+    CURLMsg *msg;
+
+    pthread_mutex_lock(&shoes_curl_engine.lock);
+    while (shoes_curl_engine.nactive == 0 && !shoes_curl_pending())
+      pthread_cond_wait(&shoes_curl_engine.ready, &shoes_curl_engine.lock);
+    shoes_curl_admit();
+    pthread_mutex_unlock(&shoes_curl_engine.lock);
+
+    curl_multi_perform(shoes_curl_engine.multi, &running);
+    while ((msg = curl_multi_info_read(shoes_curl_engine.multi, &left)) != NULL)
+      if (msg->msg == CURLMSG_DONE)
+        shoes_curl_done(msg->easy_handle, msg->data.result);
+
+    // new requests wake us through shoes_curl_wakeup
+#if LIBCURL_VERSION_NUM >= 0x074400
+    curl_multi_poll(shoes_curl_engine.multi, NULL, 0, 1000, NULL);
+#else
+    {
+      long timeout = -1;
+      struct curl_waitfd wake;
+      char buf[64];
+      curl_multi_timeout(shoes_curl_engine.multi, &timeout);
+      if (timeout < 0 || timeout > 1000) timeout = 1000;
+      wake.fd = shoes_curl_engine.wake[0];
+      wake.events = CURL_WAIT_POLLIN;
+      wake.revents = 0;
+      if (timeout > 0)
+        curl_multi_wait(shoes_curl_engine.multi, &wake, 1, (int)timeout, NULL);
+      if (wake.revents)
+        while (read(shoes_curl_engine.wake[0], buf, sizeof(buf)) > 0);
+    }
+#endif
+  }
+  return NULL;
+}
+
+// a partly built engine is taken down again, so the next request retries
+static int
+shoes_curl_start()
+{
+  pthread_t tid;
+  shoes_curl_engine.multi = curl_multi_init();
+  if (shoes_curl_engine.multi == NULL) return 0;
+#if LIBCURL_VERSION_NUM < 0x074400
+  if (pipe(shoes_curl_engine.wake) != 0)
+  {
+    curl_multi_cleanup(shoes_curl_engine.multi);
+    shoes_curl_engine.multi = NULL;
+    return 0;
+  }
+  fcntl(shoes_curl_engine.wake[0], F_SETFL, O_NONBLOCK);
+  fcntl(shoes_curl_engine.wake[1], F_SETFL, O_NONBLOCK);
+  fcntl(shoes_curl_engine.wake[0], F_SETFD, FD_CLOEXEC);
+  fcntl(shoes_curl_engine.wake[1], F_SETFD, FD_CLOEXEC);
+#endif
+#ifdef CURLPIPE_MULTIPLEX
+  curl_multi_setopt(shoes_curl_engine.multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+  curl_multi_setopt(shoes_curl_engine.multi, CURLMOPT_MAXCONNECTS, (long)SHOES_HTTP_MAX_ACTIVE);
+
+  // only the engine thread touches these, so the share needs no locking
+  shoes_curl_engine.share = curl_share_init();
+  if (shoes_curl_engine.share == NULL) goto fail;
+  curl_share_setopt(shoes_curl_engine.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(shoes_curl_engine.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+  if (pthread_create(&tid, NULL, shoes_download2, NULL) != 0) goto fail;
+  pthread_detach(tid);
+  return 1;
+
+fail:
+  if (shoes_curl_engine.share != NULL)
+    curl_share_cleanup(shoes_curl_engine.share);
+  curl_multi_cleanup(shoes_curl_engine.multi);
+  shoes_curl_engine.share = NULL;
+  shoes_curl_engine.multi = NULL;
+#if LIBCURL_VERSION_NUM < 0x074400
+  close(shoes_curl_engine.wake[0]);
+  close(shoes_curl_engine.wake[1]);
+#endif
+  return 0;
+}
+
+// with no engine to run it, a request fails through its handler like any
+// other download error
+static void
+shoes_curl_fail(shoes_http_request *req, CURLcode res)
+{
+  if (req->handler != NULL)
+  {
+    shoes_http_event *event = SHOE_ALLOC(shoes_http_event);
+    SHOE_MEMZERO(event, shoes_http_event, 1);
+    event->stage = SHOES_HTTP_ERROR;
+    event->error = res;
+    req->handler(event, req->data);
+    SHOE_FREE(event);
+  }
   shoes_http_request_free(req);
   free(req);
-  return NULL;
 }
 
 void
 shoes_queue_download(shoes_http_request *req)
 {
-  pthread_t tid;
-  pthread_create(&tid, NULL, shoes_download2, req);
+  int pri = min(req->priority, SHOES_HTTP_PRIORITIES - 1);
+  shoes_curl_job *job;
+
+  pthread_mutex_lock(&shoes_curl_engine.lock);
+  if (!shoes_curl_engine.started)
+    shoes_curl_engine.started = shoes_curl_start();
+  if (!shoes_curl_engine.started)
+  {
+    pthread_mutex_unlock(&shoes_curl_engine.lock);
+    shoes_curl_fail(req, CURLE_FAILED_INIT);
+    return;
+  }
+
+  job = SHOE_ALLOC(shoes_curl_job);
+  SHOE_MEMZERO(job, shoes_curl_job, 1);
+  job->req = req;
+  job->hash = shoes_curl_hash(req->url);
+  shoes_curl_enqueue(job, pri);
+  job->hnext = shoes_curl_engine.waiting[job->hash & (SHOES_HTTP_BUCKETS - 1)];
+  shoes_curl_engine.waiting[job->hash & (SHOES_HTTP_BUCKETS - 1)] = job;
+  pthread_cond_signal(&shoes_curl_engine.ready);
+  pthread_mutex_unlock(&shoes_curl_engine.lock);
+  shoes_curl_wakeup();
+}
+
+// move a request that is still waiting into a more urgent class
+void
+shoes_http_prioritize(const char *url, unsigned char priority)
+{
+  unsigned int hash = shoes_curl_hash(url);
+  shoes_curl_job *job;
+  pthread_mutex_lock(&shoes_curl_engine.lock);
+  for (job = shoes_curl_engine.waiting[hash & (SHOES_HTTP_BUCKETS - 1)]; job != NULL; job = job->hnext)
+  {
+    int pri = min(job->req->priority, SHOES_HTTP_PRIORITIES - 1);
+    if (job->hash != hash || pri <= priority || job->req->url == NULL || strcmp(job->req->url, url) != 0)
+      continue;
+    shoes_curl_dequeue(job, pri);
+    job->req->priority = priority;
+    shoes_curl_enqueue(job, priority);
+    break;
+  }
+  pthread_mutex_unlock(&shoes_curl_engine.lock);
+}
+
+void
+shoes_native_download(shoes_http_request *req)
+{
+  shoes_queue_download(req);
 }
 
 VALUE
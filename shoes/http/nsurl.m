@@ -251,6 +251,11 @@ shoes_native_download(shoes_http_request *req)
   shoes_download(req);
 }
 
+void
+shoes_http_prioritize(const char *url, unsigned char priority)
+{
+}
+
 VALUE
 shoes_http_err(SHOES_DOWNLOAD_ERROR code)
 {
@@ -62,6 +62,10 @@ void shoes_native_download(shoes_http_request *req) {
     // after this stack frame pops there's nothing holding them.
 }
 
+void shoes_http_prioritize(const char *url, unsigned char priority) {
+    /* downloads run one at a time, in order - nothing to reorder */
+}
+
 VALUE shoes_http_err(SHOES_DOWNLOAD_ERROR code) {
     /* a little unclear what this does or what it returns
     I think it converts the platform 'code' to a Shoes string
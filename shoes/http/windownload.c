@@ -65,6 +65,11 @@ shoes_queue_download(shoes_http_request *req)
   CreateThread(0, 0, (LPTHREAD_START_ROUTINE)shoes_download2, (void *)req, 0, &tid);
 }
 
+void
+shoes_http_prioritize(const char *url, unsigned char priority)
+{
+}
+
 VALUE
 shoes_http_err(SHOES_DOWNLOAD_ERROR code)
 {
@@ -2,11 +2,18 @@
 // shoes/image.c
 // Loading image formats in Cairo.  I've already tried gdk-pixbuf and imlib2, but
 // the idea here is to cut down dependencies, since I only really need reading of
-// the basics: GIF and JPEG.
+// the basics: GIF and JPEG. Other formats can be added with
+// shoes_image_codec_register.
 //
 #include <stdio.h>
+#include <stdlib.h>
 #include <setjmp.h>
 #include <sys/stat.h>
+#ifndef SHOES_WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 #include "shoes/app.h"
 #include "shoes/canvas.h"
 #include "shoes/ruby.h"
@@ -39,18 +46,8 @@ shoes_image_format shoes_image_detect(VALUE, int *, int *);
 int shoes_cache_setting = 1;
 
 #define JPEG_LINES 16
-#define SIZE_SURFACE ((cairo_surface_t *)1)
-
-typedef struct {
-    unsigned int state[5];
-    unsigned int count[2];
-    unsigned char buffer[64];
-} SHA1_CTX;
 
 void SHA1Transform(unsigned int state[5], unsigned char buffer[64]);
-void SHA1Init(SHA1_CTX* context);
-void SHA1Update(SHA1_CTX* context, unsigned char* data, unsigned int len);
-void SHA1Final(unsigned char digest[20], SHA1_CTX* context);
 
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
@@ -290,47 +287,141 @@ cairo_surface_t *shoes_surface_create_from_pixels(PIXEL *pixels, int width, int
     return surface;
 }
 
-#define PNG_SIG "\x89\x50\x4E\x47\x0D\x0A\x1A\x0A"
-
-cairo_surface_t *shoes_png_size(char *filename, int *width, int *height) {
-    unsigned char *sig = SHOE_ALLOC_N(unsigned char, 32);
-    cairo_surface_t *surface = NULL;
-
+//
+// Image files are opened once and handed to the codecs as a single buffer
+// (mmap'd where the platform allows) so sniffing, sizing and decoding never
+// go back to the disk.
+//
+int shoes_image_file_open(char *filename, shoes_image_file *f) {
+    SHOE_MEMZERO(f, shoes_image_file, 1);
 #ifdef SHOES_WIN32
-    HANDLE hFile;
-    hFile = CreateFile( filename, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
-    if ( hFile == INVALID_HANDLE_VALUE ) return NULL;
-    DWORD readsize;
-    ReadFile( hFile, sig, 32, &readsize, NULL );
-    if (readsize < 8)
-        goto done;
+    DWORD size;
+    f->file = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (f->file == INVALID_HANDLE_VALUE) return 0;
+    size = GetFileSize(f->file, NULL);
+    if (size == INVALID_FILE_SIZE || size == 0) {
+        CloseHandle(f->file);
+        return 0;
+    }
+    f->map = CreateFileMapping(f->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (f->map != NULL)
+        f->data = (unsigned char *)MapViewOfFile(f->map, FILE_MAP_READ, 0, 0, 0);
+    if (f->data == NULL) {
+        if (f->map != NULL) CloseHandle(f->map);
+        CloseHandle(f->file);
+        return 0;
+    }
+    f->len = size;
+    f->mapped = 1;
 #else
-    FILE *image = fopen(filename, "rb");
-    if (image == NULL) return NULL;
-
-    if (fread(sig, 1, 32, image) < 8)
-        goto done;
+    struct stat st;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return 0;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    f->len = (size_t)st.st_size;
+    f->data = (unsigned char *)mmap(NULL, f->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (f->data != (unsigned char *)MAP_FAILED) {
+        f->mapped = 1;
+    } else {
+        // some filesystems can't be mapped, fall back to reading it in
+        size_t got = 0;
+        ssize_t n;
+        f->data = SHOE_ALLOC_N(unsigned char, f->len);
+        while (got < f->len && (n = read(fd, f->data + got, f->len - got)) > 0)
+            got += n;
+        f->len = got;
+    }
+    close(fd);
 #endif
+    return 1;
+}
 
-    if (memcmp(sig, PNG_SIG, 8) != 0)
-        goto done;
-
-    *width = *((int *)(sig + 0x10));
-    BE_CPU(*width);
-    *height = *((int *)(sig + 0x14));
-    BE_CPU(*height);
-
-    surface = SIZE_SURFACE;
-done:
+void shoes_image_file_close(shoes_image_file *f) {
+    if (f->data == NULL) return;
 #ifdef SHOES_WIN32
-    CloseHandle( hFile );
+    UnmapViewOfFile(f->data);
+    CloseHandle(f->map);
+    CloseHandle(f->file);
 #else
-    fclose(image);
+    if (f->mapped)
+        munmap(f->data, f->len);
+    else
+        SHOE_FREE(f->data);
 #endif
-    return surface;
+    f->data = NULL;
 }
 
-cairo_surface_t *shoes_surface_create_from_gif(char *filename, int *width, int *height, unsigned char load) {
+#define SHOES_LE16(p) ((unsigned int)(p)[0] | ((unsigned int)(p)[1] << 8))
+#define SHOES_LE32(p) (SHOES_LE16(p) | ((unsigned int)(p)[2] << 16) | ((unsigned int)(p)[3] << 24))
+#define SHOES_BE32(p) (((unsigned int)(p)[0] << 24) | ((unsigned int)(p)[1] << 16) | \
+                       ((unsigned int)(p)[2] << 8) | (unsigned int)(p)[3])
+
+//
+// PNG handling code
+//
+#define PNG_SIG "\x89\x50\x4E\x47\x0D\x0A\x1A\x0A"
+
+typedef struct {
+    const unsigned char *data;
+    size_t len, pos;
+} shoes_png_reader;
+
+static cairo_status_t shoes_png_read(void *closure, unsigned char *buf, unsigned int length) {
+    shoes_png_reader *rd = (shoes_png_reader *)closure;
+    if (rd->pos + length > rd->len)
+        return CAIRO_STATUS_READ_ERROR;
+    memcpy(buf, rd->data + rd->pos, length);
+    rd->pos += length;
+    return CAIRO_STATUS_SUCCESS;
+}
+
+static int shoes_png_size(const unsigned char *data, size_t len, int *width, int *height) {
+    if (len < 0x18 || memcmp(data + 12, "IHDR", 4) != 0) return 0;
+    *width = (int)SHOES_BE32(data + 0x10);
+    *height = (int)SHOES_BE32(data + 0x14);
+    return 1;
+}
+
+static cairo_surface_t *shoes_png_load(const unsigned char *data, size_t len, int *width, int *height) {
+    shoes_png_reader rd = { data, len, 0 };
+    cairo_surface_t *img = cairo_image_surface_create_from_png_stream(shoes_png_read, &rd);
+    if (cairo_surface_status(img) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(img);
+        return NULL;
+    }
+    *width = cairo_image_surface_get_width(img);
+    *height = cairo_image_surface_get_height(img);
+    return img;
+}
+
+//
+// GIF handling code
+//
+typedef struct {
+    const unsigned char *data;
+    size_t len, pos;
+} shoes_gif_reader;
+
+static int shoes_gif_read(GifFileType *gif, GifByteType *buf, int length) {
+    shoes_gif_reader *rd = (shoes_gif_reader *)gif->UserData;
+    if (rd->pos + length > rd->len)
+        length = (int)(rd->len - rd->pos);
+    memcpy(buf, rd->data + rd->pos, length);
+    rd->pos += length;
+    return length;
+}
+
+static int shoes_gif_size(const unsigned char *data, size_t len, int *width, int *height) {
+    if (len < 10) return 0;
+    *width = (int)SHOES_LE16(data + 6);
+    *height = (int)SHOES_LE16(data + 8);
+    return (*width > 0 && *height > 0 && *width <= 8192 && *height <= 8192);
+}
+
+static cairo_surface_t *shoes_gif_load(const unsigned char *data, size_t len, int *width, int *height) {
     cairo_surface_t *surface = NULL;
     GifFileType *gif;
     PIXEL *ptr = NULL, *pixels = NULL;
@@ -338,16 +429,16 @@ cairo_surface_t *shoes_surface_create_from_gif(char *filename, int *width, int *
     GifRecordType rec;
     ColorMapObject *cmap;
     int i, j, bg, r, g, b, w = 0, h = 0, done = 0, transp = -1;
-    float per = 0.0f, per_inc;
     int intoffset[] = { 0, 4, 2, 1 };
     int intjump[] = { 8, 8, 4, 2 };
+    shoes_gif_reader rd = { data, len, 0 };
 
     transp = -1;
 #if !defined(GIFLIB_MAJOR) || (GIFLIB_MAJOR <= 4)
-    gif = DGifOpenFileName(filename);
+    gif = DGifOpen(&rd, shoes_gif_read);
 #else
     int gif_err;
-    gif = DGifOpenFileName(filename, &gif_err);
+    gif = DGifOpen(&rd, shoes_gif_read, &gif_err);
 #endif
     if (gif == NULL)
         goto done;
@@ -367,11 +458,6 @@ cairo_surface_t *shoes_surface_create_from_gif(char *filename, int *width, int *
             if ((w < 1) || (h < 1) || (w > 8192) || (h > 8192))
                 goto done;
 
-            if (!load) {
-                surface = SIZE_SURFACE;
-                goto done;
-            }
-
             rows = SHOE_ALLOC_N(GifPixelType *, h);
             if (rows == NULL)
                 goto done;
@@ -407,6 +493,9 @@ cairo_surface_t *shoes_surface_create_from_gif(char *filename, int *width, int *
         }
     } while (rec != TERMINATE_RECORD_TYPE);
 
+    if (!done)
+        goto done;
+
     bg = gif->SBackGroundColor;
     cmap = (gif->Image.ColorMap ? gif->Image.ColorMap : gif->SColorMap);
     pixels = SHOE_ALLOC_N(PIXEL, w * h);
@@ -414,7 +503,6 @@ cairo_surface_t *shoes_surface_create_from_gif(char *filename, int *width, int *
         goto done;
 
     ptr = pixels;
-    per_inc = 100.0f / (((float)w) * h);
     for (i = 0; i < h; i++) {
         for (j = 0; j < w; j++) {
             if (rows[i][j] == transp) {
@@ -432,13 +520,9 @@ cairo_surface_t *shoes_surface_create_from_gif(char *filename, int *width, int *
                 LE_CPU(*ptr);
                 ptr++;
             }
-            per += per_inc;
         }
     }
 
-    if ((w < 1) || (h < 1) || (w > 8192) || (h > 8192))
-        goto done;
-
     surface = shoes_surface_create_from_pixels(pixels, w, h);
 
 done:
@@ -460,107 +544,52 @@ done:
 //
 // JPEG handling code
 //
-struct shoes_jpeg_file_src {
-    struct jpeg_source_mgr pub;   /* public fields */
-
-#ifdef SHOES_WIN32
-    HANDLE infile;        /* source stream */
-#else
-    FILE *infile;         /* source stream */
-#endif
-
-    JOCTET *buffer;         /* start of buffer */
-    boolean start_of_file;    /* have we gotten any data yet? */
-};
-
 struct shoes_jpeg_error_mgr {
     struct jpeg_error_mgr pub;             /* public fields */
     jmp_buf setjmp_buffer;  /* for return to caller */
 };
 
-typedef struct shoes_jpeg_file_src *shoes_jpeg_file;
 typedef struct shoes_jpeg_error_mgr *shoes_jpeg_err;
 
-#define JPEG_INPUT_BUF_SIZE 4096
+static const JOCTET shoes_jpeg_eoi[2] = { (JOCTET)0xFF, (JOCTET)JPEG_EOI };
 
-void shoes_jpeg_term_source(j_decompress_ptr cinfo) {
+void shoes_jpeg_init_source(j_decompress_ptr cinfo) {
 }
 
-void shoes_jpeg_init_source(j_decompress_ptr cinfo) {
-    shoes_jpeg_file src = (shoes_jpeg_file) cinfo->src;
-    src->start_of_file = 1;
+void shoes_jpeg_term_source(j_decompress_ptr cinfo) {
 }
 
+// the whole file is already in memory, running out means a truncated file
 boolean shoes_jpeg_fill_input_buffer(j_decompress_ptr cinfo) {
-    shoes_jpeg_file src = (shoes_jpeg_file)cinfo->src;
-    size_t nbytes;
-
-#ifdef SHOES_WIN32
-    DWORD readsize;
-    ReadFile( src->infile, src->buffer, JPEG_INPUT_BUF_SIZE, &readsize, NULL );
-    nbytes = readsize;
-#else
-    nbytes = fread(src->buffer, 1, JPEG_INPUT_BUF_SIZE, src->infile);
-#endif
-
-    if (nbytes <= 0) {
-        if (src->start_of_file) /* Treat empty input file as fatal error */
-            ERREXIT(cinfo, JERR_INPUT_EMPTY);
-        WARNMS(cinfo, JWRN_JPEG_EOF);
-        src->buffer[0] = (JOCTET) 0xFF;
-        src->buffer[1] = (JOCTET) JPEG_EOI;
-        nbytes = 2;
-    }
-
-    src->pub.next_input_byte = src->buffer;
-    src->pub.bytes_in_buffer = nbytes;
-    src->start_of_file = 0;
-
+    WARNMS(cinfo, JWRN_JPEG_EOF);
+    cinfo->src->next_input_byte = shoes_jpeg_eoi;
+    cinfo->src->bytes_in_buffer = 2;
     return 1;
 }
 
 void shoes_jpeg_skip_input_data(j_decompress_ptr cinfo, long num_bytes) {
-    shoes_jpeg_file src = (shoes_jpeg_file)cinfo->src;
-
-    if (num_bytes > 0) {
-        while (num_bytes > (long)src->pub.bytes_in_buffer) {
-            num_bytes -= (long)src->pub.bytes_in_buffer;
-            (void)shoes_jpeg_fill_input_buffer(cinfo);
-        }
-        src->pub.next_input_byte += (size_t)num_bytes;
-        src->pub.bytes_in_buffer -= (size_t)num_bytes;
+    if (num_bytes <= 0) return;
+    if ((size_t)num_bytes > cinfo->src->bytes_in_buffer) {
+        (void)shoes_jpeg_fill_input_buffer(cinfo);
+    } else {
+        cinfo->src->next_input_byte += (size_t)num_bytes;
+        cinfo->src->bytes_in_buffer -= (size_t)num_bytes;
     }
 }
 
-void jpeg_file_src(j_decompress_ptr cinfo,
-#ifdef SHOES_WIN32
-              HANDLE infile
-#else
-              FILE *infile
-#endif
-             ) {
-    shoes_jpeg_file src;
-
+void shoes_jpeg_mem_src(j_decompress_ptr cinfo, const unsigned char *data, size_t len) {
     if (cinfo->src == NULL) {
-        /* first time for this JPEG object? */
         cinfo->src = (struct jpeg_source_mgr *)
                      (*cinfo->mem->alloc_small)((j_common_ptr) cinfo, JPOOL_PERMANENT,
-                                                sizeof(struct shoes_jpeg_file_src));
-        src = (shoes_jpeg_file) cinfo->src;
-        src->buffer = (JOCTET *)
-                      (*cinfo->mem->alloc_small)((j_common_ptr) cinfo, JPOOL_PERMANENT,
-                              JPEG_INPUT_BUF_SIZE * sizeof(JOCTET));
+                                                sizeof(struct jpeg_source_mgr));
     }
-
-    src = (shoes_jpeg_file)cinfo->src;
-    src->pub.init_source = shoes_jpeg_init_source;
-    src->pub.fill_input_buffer = shoes_jpeg_fill_input_buffer;
-    src->pub.skip_input_data = shoes_jpeg_skip_input_data;
-    src->pub.resync_to_restart = jpeg_resync_to_restart; /* use default method */
-    src->pub.term_source = shoes_jpeg_term_source;
-    src->infile = infile;
-    src->pub.bytes_in_buffer = 0; /* forces fill_input_buffer on first read */
-    src->pub.next_input_byte = NULL; /* until buffer loaded */
+    cinfo->src->init_source = shoes_jpeg_init_source;
+    cinfo->src->fill_input_buffer = shoes_jpeg_fill_input_buffer;
+    cinfo->src->skip_input_data = shoes_jpeg_skip_input_data;
+    cinfo->src->resync_to_restart = jpeg_resync_to_restart; /* use default method */
+    cinfo->src->term_source = shoes_jpeg_term_source;
+    cinfo->src->next_input_byte = (const JOCTET *)data;
+    cinfo->src->bytes_in_buffer = len;
 }
 
 void shoes_jpeg_fatal(j_common_ptr cinfo) {
@@ -568,40 +597,24 @@ void shoes_jpeg_fatal(j_common_ptr cinfo) {
     longjmp(jpgerr->setjmp_buffer, 1);
 }
 
-cairo_surface_t *shoes_surface_create_from_jpeg(char *filename, int *width, int *height, unsigned char load) {
-    int x, y, w, h, l, i, scans, count, prevy;
+static cairo_surface_t *shoes_jpeg_load(const unsigned char *data, size_t len, int *width, int *height) {
+    int x, y, w, h, l, i, scans;
     unsigned char *ptr, *rgb = NULL, **line = NULL;
     PIXEL *pixels = NULL, *ptr2;
     cairo_surface_t *surface = NULL;
     struct jpeg_decompress_struct cinfo;
     struct shoes_jpeg_error_mgr jerr;
 
-#ifdef SHOES_WIN32
-    HANDLE hFile;
-    hFile = CreateFile( filename, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
-    if ( hFile == INVALID_HANDLE_VALUE ) return NULL;
-#else
-    FILE *f = fopen(filename, "rb");
-    if (!f) return NULL;
-#endif
-
     // TODO: error handling
     cinfo.err = jpeg_std_error(&jerr.pub);
     jerr.pub.error_exit = shoes_jpeg_fatal;
-    // jerr.pub.emit_message = shoes_jpeg_error;
-    // jerr.pub.output_message = shoes_jpeg_error2;
     if (setjmp(jerr.setjmp_buffer)) {
-        // append_jpeg_message(interp, (j_common_ptr) &cinfo);
         jpeg_destroy_decompress(&cinfo);
         return NULL;
     }
 
     jpeg_create_decompress(&cinfo);
-#ifdef SHOES_WIN32
-    jpeg_file_src(&cinfo, hFile);
-#else
-    jpeg_file_src(&cinfo, f);
-#endif
+    shoes_jpeg_mem_src(&cinfo, data, len);
     jpeg_read_header(&cinfo, TRUE);
     cinfo.do_fancy_upsampling = FALSE;
     cinfo.do_block_smoothing = FALSE;
@@ -616,11 +629,6 @@ cairo_surface_t *shoes_surface_create_from_jpeg(char *filename, int *width, int
     if ((w < 1) || (h < 1) || (w > 8192) || (h > 8192))
         goto done;
 
-    if (!load) {
-        surface = SIZE_SURFACE;
-        goto done;
-    }
-
     if (cinfo.rec_outbuf_height > JPEG_LINES)
         goto done;
 
@@ -629,8 +637,6 @@ cairo_surface_t *shoes_surface_create_from_jpeg(char *filename, int *width, int
     if (rgb == NULL || pixels == NULL)
         goto done;
 
-    count = 0;
-    prevy = 0;
     if (cinfo.output_components == 3 || cinfo.output_components == 1) {
         int c = cinfo.output_components;
         for (i = 0; i < cinfo.rec_outbuf_height; i++)
@@ -661,14 +667,313 @@ done:
     if (pixels != NULL) free(pixels);
     if (rgb != NULL) free(rgb);
     jpeg_destroy_decompress(&cinfo);
-#ifdef SHOES_WIN32
-    CloseHandle( hFile );
+    return surface;
+}
+
+// averages one output row of shoes_jpeg_load_thumbnail and starts the next
+static void shoes_jpeg_thumbnail_row(unsigned int *acc, PIXEL *out, int ow) {
+    int i;
+    for (i = 0; i < ow; i++, acc += 4) {
+        unsigned int n = max(1, acc[3]);
+        out[i] = (0xff000000) | ((acc[0] / n) << 16) | ((acc[1] / n) << 8) | (acc[2] / n);
+        LE_CPU(out[i]);
+        acc[0] = acc[1] = acc[2] = acc[3] = 0;
+    }
+}
+
+// Decode only the rectangle x, y, w, h of a JPEG scaled down by 1/scale
+// (1, 2, 4 or 8, done by libjpeg for free). Rows above the rectangle are
+// skipped and, with libjpeg-turbo, only the iMCU columns covering it are
+// decoded. Used by tiled_image for images too big to load whole.
+cairo_surface_t *shoes_jpeg_load_region(const unsigned char *data, size_t len, int scale,
+                                        int x, int y, int w, int h) {
+    int l, i, c, scans;
+    // set after setjmp, so volatile for the error path to see them
+    unsigned char *volatile rgb = NULL, **volatile line = NULL;
+    PIXEL *volatile pixels = NULL;
+    PIXEL *ptr2;
+    cairo_surface_t *surface = NULL;
+    struct jpeg_decompress_struct cinfo;
+    struct shoes_jpeg_error_mgr jerr;
+    JDIMENSION xoff = 0, xw;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = shoes_jpeg_fatal;
+    if (setjmp(jerr.setjmp_buffer)) {
+        surface = NULL;
+        goto done;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    shoes_jpeg_mem_src(&cinfo, data, len);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = scale;
+    cinfo.do_fancy_upsampling = FALSE;
+    cinfo.do_block_smoothing = FALSE;
+    jpeg_start_decompress(&cinfo);
+
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x + w > (int)cinfo.output_width) w = (int)cinfo.output_width - x;
+    if (y + h > (int)cinfo.output_height) h = (int)cinfo.output_height - y;
+    c = cinfo.output_components;
+    if (w < 1 || h < 1 || (c != 3 && c != 1) || cinfo.rec_outbuf_height > JPEG_LINES)
+        goto done;
+
+#if defined(LIBJPEG_TURBO_VERSION_NUMBER) && LIBJPEG_TURBO_VERSION_NUMBER >= 1005000
+    xoff = x;
+    xw = w;
+    jpeg_crop_scanline(&cinfo, &xoff, &xw);   // widens to iMCU boundaries
+    if (y > 0) jpeg_skip_scanlines(&cinfo, y);
 #else
-    fclose(f);
+    xw = cinfo.output_width;
+#endif
+
+    line = SHOE_ALLOC_N(unsigned char *, JPEG_LINES);
+    rgb = SHOE_ALLOC_N(unsigned char, xw * JPEG_LINES * c);
+    ptr2 = pixels = SHOE_ALLOC_N(PIXEL, w * h);
+    for (i = 0; i < cinfo.rec_outbuf_height; i++)
+        line[i] = rgb + (i * xw * c);
+
+#if !defined(LIBJPEG_TURBO_VERSION_NUMBER) || LIBJPEG_TURBO_VERSION_NUMBER < 1005000
+    // no skipping in plain libjpeg, read and throw away
+    while ((int)cinfo.output_scanline < y)
+        jpeg_read_scanlines(&cinfo, line, min(cinfo.rec_outbuf_height, y - (int)cinfo.output_scanline));
 #endif
+
+    for (l = 0; l < h; l += scans) {
+        int yy;
+        scans = jpeg_read_scanlines(&cinfo, line, min(cinfo.rec_outbuf_height, h - l));
+        if (scans < 1) break;
+        for (yy = 0; yy < scans; yy++) {
+            unsigned char *ptr = line[yy] + (x - xoff) * c;
+            for (i = 0; i < w; i++) {
+                if (c == 3)
+                    *ptr2 = (0xff000000) | ((ptr[0]) << 16) | ((ptr[1]) << 8) | (ptr[2]);
+                else
+                    *ptr2 = (0xff000000) | ((ptr[0]) << 16) | ((ptr[0]) << 8) | (ptr[0]);
+                LE_CPU(*ptr2);
+                ptr += c;
+                ptr2++;
+            }
+        }
+    }
+
+    surface = shoes_surface_create_from_pixels(pixels, w, h);
+    jpeg_abort_decompress(&cinfo);
+done:
+    if (line != NULL) free(line);
+    if (pixels != NULL) free(pixels);
+    if (rgb != NULL) free(rgb);
+    jpeg_destroy_decompress(&cinfo);
+    return surface;
+}
+
+// The whole JPEG shrunk to fit in size x size pixels, in one pass: libjpeg
+// decodes it at 1/8 scale and each of those rows is averaged into the output
+// row it falls in. For tiled_image's overview.
+cairo_surface_t *shoes_jpeg_load_thumbnail(const unsigned char *data, size_t len, int size) {
+    int i, c, sw, sh, ow, oh, oy = 0, y = 0;
+    // set after setjmp, so volatile for the error path to see them
+    unsigned char *volatile rgb = NULL, **volatile line = NULL;
+    unsigned int *volatile acc = NULL;
+    int *volatile col = NULL;
+    PIXEL *volatile pixels = NULL;
+    cairo_surface_t *surface = NULL;
+    struct jpeg_decompress_struct cinfo;
+    struct shoes_jpeg_error_mgr jerr;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = shoes_jpeg_fatal;
+    if (setjmp(jerr.setjmp_buffer)) {
+        surface = NULL;
+        goto done;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    shoes_jpeg_mem_src(&cinfo, data, len);
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = 8;
+    cinfo.do_fancy_upsampling = FALSE;
+    cinfo.do_block_smoothing = FALSE;
+    jpeg_start_decompress(&cinfo);
+
+    sw = cinfo.output_width;
+    sh = cinfo.output_height;
+    c = cinfo.output_components;
+    if (sw < 1 || sh < 1 || (c != 3 && c != 1) || cinfo.rec_outbuf_height > JPEG_LINES)
+        goto done;
+    if (sw >= sh) {
+        ow = min(sw, size);
+        oh = max(1, (int)((long long)sh * ow / sw));
+    } else {
+        oh = min(sh, size);
+        ow = max(1, (int)((long long)sw * oh / sh));
+    }
+
+    line = SHOE_ALLOC_N(unsigned char *, JPEG_LINES);
+    rgb = SHOE_ALLOC_N(unsigned char, sw * JPEG_LINES * c);
+    acc = SHOE_ALLOC_N(unsigned int, ow * 4);     // r, g, b, count
+    col = SHOE_ALLOC_N(int, sw);
+    pixels = SHOE_ALLOC_N(PIXEL, ow * oh);
+    SHOE_MEMZERO(acc, unsigned int, ow * 4);
+    for (i = 0; i < sw; i++)
+        col[i] = (int)((long long)i * ow / sw) * 4;
+    for (i = 0; i < cinfo.rec_outbuf_height; i++)
+        line[i] = rgb + (i * sw * c);
+
+    while (y < sh) {
+        int yy, scans = jpeg_read_scanlines(&cinfo, line, cinfo.rec_outbuf_height);
+        if (scans < 1) break;
+        for (yy = 0; yy < scans && y < sh; yy++, y++) {
+            const unsigned char *ptr = line[yy];
+            int ny = (int)((long long)y * oh / sh);
+            if (ny != oy) {
+                shoes_jpeg_thumbnail_row(acc, pixels + oy * ow, ow);
+                oy = ny;
+            }
+            for (i = 0; i < sw; i++, ptr += c) {
+                unsigned int *a = acc + col[i];
+                a[0] += ptr[0];
+                a[1] += ptr[c == 3 ? 1 : 0];
+                a[2] += ptr[c == 3 ? 2 : 0];
+                a[3]++;
+            }
+        }
+    }
+    shoes_jpeg_thumbnail_row(acc, pixels + oy * ow, ow);
+    for (i = (oy + 1) * ow; i < ow * oh; i++)   // a short file leaves the rest black
+        pixels[i] = 0xff000000;
+
+    surface = shoes_surface_create_from_pixels(pixels, ow, oh);
+    jpeg_abort_decompress(&cinfo);
+done:
+    if (line != NULL) free(line);
+    if (rgb != NULL) free(rgb);
+    if (acc != NULL) free(acc);
+    if (col != NULL) free(col);
+    if (pixels != NULL) free(pixels);
+    jpeg_destroy_decompress(&cinfo);
+    return surface;
+}
+
+// Full size of a JPEG with no limit, for tiled_image
+int shoes_jpeg_dimensions(const unsigned char *data, size_t len, int *width, int *height) {
+    struct jpeg_decompress_struct cinfo;
+    struct shoes_jpeg_error_mgr jerr;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = shoes_jpeg_fatal;
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return 0;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    shoes_jpeg_mem_src(&cinfo, data, len);
+    jpeg_read_header(&cinfo, TRUE);
+    *width = cinfo.image_width;
+    *height = cinfo.image_height;
+    jpeg_destroy_decompress(&cinfo);
+    return (*width > 0 && *height > 0);
+}
+
+static int shoes_jpeg_size(const unsigned char *data, size_t len, int *width, int *height) {
+    return shoes_jpeg_dimensions(data, len, width, height) &&
+           *width <= 8192 && *height <= 8192;
+}
+
+//
+// BMP handling code (uncompressed 24 and 32 bit only)
+//
+static int shoes_bmp_size(const unsigned char *data, size_t len, int *width, int *height) {
+    unsigned int hdr;
+    int bpp;
+    if (len < 30) return 0;
+    // "BM" alone is too weak, the DIB header has to be one of the known sizes
+    hdr = SHOES_LE32(data + 14);
+    if (hdr == 12) {
+        *width = (int)SHOES_LE16(data + 18);
+        *height = (int)SHOES_LE16(data + 20);
+        bpp = (int)SHOES_LE16(data + 24);
+    } else if (hdr == 40 || hdr == 52 || hdr == 56 || hdr == 64 || hdr == 108 || hdr == 124) {
+        *width = (int)SHOES_LE32(data + 18);
+        *height = abs((int)SHOES_LE32(data + 22));
+        bpp = (int)SHOES_LE16(data + 28);
+    } else
+        return 0;
+    if (bpp != 1 && bpp != 4 && bpp != 8 && bpp != 16 && bpp != 24 && bpp != 32)
+        return 0;
+    return (*width > 0 && *height > 0 && *width <= 8192 && *height <= 8192);
+}
+
+static cairo_surface_t *shoes_bmp_load(const unsigned char *data, size_t len, int *width, int *height) {
+    int x, y, w, h, bpp, rowlen, topdown;
+    unsigned int offset, compression;
+    cairo_surface_t *surface;
+    PIXEL *pixels, *ptr;
+
+    // the OS/2 12 byte header lays out its fields differently, not loaded here
+    if (len < 34 || !shoes_bmp_size(data, len, &w, &h) || SHOES_LE32(data + 14) < 40)
+        return NULL;
+    offset = SHOES_LE32(data + 10);
+    topdown = ((int)SHOES_LE32(data + 22)) < 0;
+    bpp = (int)SHOES_LE16(data + 28);
+    compression = SHOES_LE32(data + 30);
+    if ((bpp != 24 && bpp != 32) || compression != 0)
+        return NULL;
+    rowlen = ((w * bpp / 8) + 3) & ~3;
+    if (offset > len || (size_t)rowlen * h > len - offset)
+        return NULL;
+
+    ptr = pixels = SHOE_ALLOC_N(PIXEL, w * h);
+    for (y = 0; y < h; y++) {
+        const unsigned char *row = data + offset + (size_t)rowlen * (topdown ? y : h - 1 - y);
+        for (x = 0; x < w; x++, row += bpp / 8) {
+            *ptr = 0xff000000 | (row[2] << 16) | (row[1] << 8) | row[0];
+            LE_CPU(*ptr);
+            ptr++;
+        }
+    }
+    surface = shoes_surface_create_from_pixels(pixels, w, h);
+    SHOE_FREE(pixels);
+    *width = w;
+    *height = h;
     return surface;
 }
 
+//
+// Codec registry. Codecs are tried in order against the magic bytes of the
+// file, later registrations (WebP, TIFF...) go after the built-ins.
+//
+static shoes_image_codec shoes_codec_png = { "png", SHOES_IMAGE_PNG, PNG_SIG, 8, 0, shoes_png_size, shoes_png_load };
+static shoes_image_codec shoes_codec_jpeg = { "jpeg", SHOES_IMAGE_JPEG, "\xFF\xD8\xFF", 3, 0, shoes_jpeg_size, shoes_jpeg_load };
+static shoes_image_codec shoes_codec_gif = { "gif", SHOES_IMAGE_GIF, "GIF8", 4, 0, shoes_gif_size, shoes_gif_load };
+static shoes_image_codec shoes_codec_bmp = { "bmp", SHOES_IMAGE_BMP, "BM", 2, 0, shoes_bmp_size, shoes_bmp_load };
+
+static shoes_image_codec *shoes_image_codecs[SHOES_IMAGE_CODECS_MAX] = {
+    &shoes_codec_png, &shoes_codec_jpeg, &shoes_codec_gif, &shoes_codec_bmp
+};
+static int shoes_image_codec_count = 4;
+
+void shoes_image_codec_register(shoes_image_codec *codec) {
+    if (shoes_image_codec_count < SHOES_IMAGE_CODECS_MAX)
+        shoes_image_codecs[shoes_image_codec_count++] = codec;
+}
+
+shoes_image_codec *shoes_image_codec_find(const unsigned char *data, size_t len) {
+    int i;
+    for (i = 0; i < shoes_image_codec_count; i++) {
+        shoes_image_codec *codec = shoes_image_codecs[i];
+        if (len >= (size_t)(codec->magic_offset + codec->magic_len) &&
+                memcmp(data + codec->magic_offset, codec->magic, codec->magic_len) == 0)
+            return codec;
+    }
+    return NULL;
+}
+
 char shoes_has_ext(char *fname, int len, const char *ext) {
     return strncmp(fname + (len - strlen(ext)), ext, strlen(ext)) == 0;
 }
@@ -698,24 +1003,34 @@ void shoes_failed_image(VALUE path) {
                 RSTRING_PTR(path), RSTRING_PTR(ext));
 }
 
-cairo_surface_t *shoes_surface_create_from_file(VALUE imgpath, int *width, int *height) {
+cairo_surface_t *shoes_surface_create_from_file(VALUE imgpath, int *width, int *height, shoes_image_format *format) {
     cairo_surface_t *img = NULL;
-    shoes_image_format format = shoes_image_detect(imgpath, width, height);
-    if (format == SHOES_IMAGE_PNG) {
-        img = cairo_image_surface_create_from_png(RSTRING_PTR(imgpath));
-        if (cairo_surface_status(img) != CAIRO_STATUS_SUCCESS)
-            img = NULL;
-    } else if (format == SHOES_IMAGE_JPEG)
-        img = shoes_surface_create_from_jpeg(RSTRING_PTR(imgpath), width, height, TRUE);
-    else if (format == SHOES_IMAGE_GIF)
-        img = shoes_surface_create_from_gif(RSTRING_PTR(imgpath), width, height, TRUE);
-    else
+    shoes_image_codec *codec;
+    shoes_image_file file;
+
+    if (format != NULL) *format = SHOES_IMAGE_NONE;
+    if (!shoes_check_file_exists(imgpath))
+        return shoes_world->blank_image;
+    if (!shoes_image_file_open(RSTRING_PTR(imgpath), &file)) {
+        shoes_failed_image(imgpath);
         return shoes_world->blank_image;
+    }
+
+    codec = shoes_image_codec_find(file.data, file.len);
+    if (codec == NULL) {
+        shoes_image_file_close(&file);
+        shoes_unsupported_image(imgpath);
+        return shoes_world->blank_image;
+    }
+
+    img = codec->load(file.data, file.len, width, height);
+    shoes_image_file_close(&file);
 
     if (img == NULL) {
         shoes_failed_image(imgpath);
         img = shoes_world->blank_image;
-    }
+    } else if (format != NULL)
+        *format = codec->format;
 
     return img;
 }
@@ -738,6 +1053,7 @@ shoes_cached_image *shoes_cached_image_new(int width, int height, cairo_surface_
     cached->width = width;
     cached->height = height;
     cached->mtime = 0;
+    cached->format = SHOES_IMAGE_NONE;
     return cached;
 }
 
@@ -770,53 +1086,35 @@ void shoes_cache_delete(char *imgpath) {
 }
 
 shoes_image_format shoes_image_detect(VALUE imgpath, int *width, int *height) {
-    shoes_image_format format = SHOES_IMAGE_NONE;
     shoes_cached_image *cached = NULL;
-    cairo_surface_t *img = NULL;
-    VALUE filename = rb_funcall(imgpath, s_downcase, 0);
-    char *fname = RSTRING_PTR(filename);
-    int len = (int)RSTRING_LEN(filename);
+    shoes_image_codec *codec;
+    shoes_image_file file;
 
     if (shoes_cache_setting && shoes_cache_lookup(RSTRING_PTR(imgpath), &cached)) {
         *width = cached->width;
         *height = cached->height;
         return cached->format;
     }
-    
+
     if (!shoes_check_file_exists(imgpath))
         return SHOES_IMAGE_NONE;
-    else if (shoes_has_ext(fname, len, ".png")) {
-        img = shoes_png_size(RSTRING_PTR(imgpath), width, height);
-        format = SHOES_IMAGE_PNG;
-    } else if (shoes_has_ext(fname, len, ".jpg") || shoes_has_ext(fname, len, ".jpeg")) {
-        img = shoes_surface_create_from_jpeg(RSTRING_PTR(imgpath), width, height, FALSE);
-        format = SHOES_IMAGE_JPEG;
-    } else if (shoes_has_ext(fname, len, ".gif")) {
-        img = shoes_surface_create_from_gif(RSTRING_PTR(imgpath), width, height, FALSE);
-        format = SHOES_IMAGE_GIF;
-    }
-
-    if (img != SIZE_SURFACE) {
-        if (format != SHOES_IMAGE_PNG &&
-                (img = shoes_png_size(RSTRING_PTR(imgpath), width, height)) == SIZE_SURFACE)
-            format = SHOES_IMAGE_PNG;
-        else if (format != SHOES_IMAGE_JPEG &&
-                 (img = shoes_surface_create_from_jpeg(RSTRING_PTR(imgpath), width, height, FALSE)) == SIZE_SURFACE)
-            format = SHOES_IMAGE_JPEG;
-        else if (format != SHOES_IMAGE_GIF &&
-                 (img = shoes_surface_create_from_gif(RSTRING_PTR(imgpath), width, height, FALSE)) == SIZE_SURFACE)
-            format = SHOES_IMAGE_GIF;
+    if (!shoes_image_file_open(RSTRING_PTR(imgpath), &file)) {
+        shoes_failed_image(imgpath);
+        return SHOES_IMAGE_NONE;
     }
 
-    if (format == SHOES_IMAGE_NONE) {
+    codec = shoes_image_codec_find(file.data, file.len);
+    if (codec == NULL) {
+        shoes_image_file_close(&file);
         shoes_unsupported_image(imgpath);
-        return format;
+        return SHOES_IMAGE_NONE;
     }
 
-    if (img != SIZE_SURFACE)
+    if (!codec->size(file.data, file.len, width, height))
         shoes_failed_image(imgpath);
+    shoes_image_file_close(&file);
 
-    return format;
+    return codec->format;
 }
 
 shoes_code shoes_load_imagesize(VALUE imgpath, int *width, int *height) {
@@ -839,26 +1137,25 @@ unsigned char shoes_image_downloaded(shoes_image_download_event *idat) {
         return 0;
     }
     fprintf(stderr, "download finished %s\n", idat->filepath);
-    cairo_surface_t *img = shoes_surface_create_from_file(rb_str_new2(idat->filepath), &width, &height);
+    shoes_image_format format;
+    cairo_surface_t *img = shoes_surface_create_from_file(rb_str_new2(idat->filepath), &width, &height, &format);
     if (img != NULL) {
         shoes_cached_image *cached;
         if (shoes_cache_lookup(idat->uripath, &cached) && cached->surface == shoes_world->blank_image) {
             cached->surface = img;
             cached->width = width;
             cached->height = height;
+            cached->format = format;
             cached->mtime = shoes_file_mtime(idat->filepath);
 
-            if (idat->status != 304) {
+            if (idat->status != 304 && !idat->digested) {
 #ifdef SHOES_WIN32
                 HANDLE hFile;
                 hFile = CreateFile( idat->filepath, GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
                 SHA1Init(&context);
                 DWORD readsize;
-                while (1) {
-                    ReadFile( hFile, buffer, 16384, &readsize, NULL );
-                    if (readsize != 16384) break;
+                while (ReadFile( hFile, buffer, 16384, &readsize, NULL ) && readsize > 0)
                     SHA1Update(&context, buffer, readsize);
-                }
                 SHA1Final(digest, &context);
                 CloseHandle( hFile );
 #else
@@ -899,10 +1196,15 @@ int shoes_http_image_handler(shoes_http_event *de, void *data) {
             SHOE_MEMCPY(idat->etag, de->hval, char, de->hvallen);
             idat->etag[de->hvallen] = '\0';
         }
+    } else if (de->stage == SHOES_HTTP_DIGEST && idat->status == 200) {
+        int i;
+        for (i = 0; i < 20; i++)
+            sprintf(&idat->hexdigest[i*2], "%02x", (unsigned char)de->body[i]);
+        idat->digested = 1;
     } else if (de->stage == SHOES_HTTP_COMPLETED) {
         shoes_image_download_event *side = SHOE_ALLOC(shoes_image_download_event);
         SHOE_MEMCPY(side, idat, shoes_image_download_event, 1);
-        return shoes_throw_message(SHOES_IMAGE_DOWNLOAD, idat->slot, side);
+        shoes_post_message(SHOES_IMAGE_DOWNLOAD, idat->slot, side, SHOES_MSG_POST);
     }
     return SHOES_DOWNLOAD_CONTINUE;
 }
@@ -918,6 +1220,7 @@ shoes_cached_image *shoes_load_image_sanity(shoes_cached_image *cached) {
 shoes_cached_image *shoes_load_image_nocache (VALUE slot, VALUE imgpath) {
   shoes_cached_image *cached = NULL;
   cairo_surface_t *img = NULL;
+  shoes_image_format format;
   VALUE filename = rb_funcall(imgpath, s_downcase, 0);
   StringValue(filename);
   char *fname = RSTRING_PTR(filename);
@@ -954,6 +1257,8 @@ shoes_cached_image *shoes_load_image_nocache (VALUE slot, VALUE imgpath) {
     req->port = NUM2INT(port);
     req->path = strdup(RSTRING_PTR(requ));
     req->handler = shoes_http_image_handler;
+    req->flags = SHOES_DL_DEFAULTS;
+    req->priority = SHOES_HTTP_PRIORITY_NORMAL;
     req->filepath = strdup(RSTRING_PTR(tmppath));
     idat->filepath = strdup(RSTRING_PTR(tmppath));
     idat->uripath = strdup(RSTRING_PTR(imgpath));
@@ -972,9 +1277,10 @@ shoes_cached_image *shoes_load_image_nocache (VALUE slot, VALUE imgpath) {
   } else {
     // read user file
     //fprintf(stderr, "no cache read from %s\n", RSTRING_PTR(imgpath));
-    img = shoes_surface_create_from_file(imgpath, &width, &height);
+    img = shoes_surface_create_from_file(imgpath, &width, &height, &format);
     if (img != shoes_world->blank_image) {
         cached = shoes_cached_image_new(width, height, img);
+        cached->format = format;
     }
   }
   return shoes_load_image_sanity(cached);
@@ -984,6 +1290,7 @@ shoes_cached_image *shoes_load_image_nocache (VALUE slot, VALUE imgpath) {
 shoes_cached_image *shoes_load_image(VALUE slot, VALUE imgpath, VALUE cache_opt) {
     shoes_cached_image *cached = NULL;
     cairo_surface_t *img = NULL;
+    shoes_image_format format;
     VALUE filename = rb_funcall(imgpath, s_downcase, 0);
     StringValue(filename);
     char *fname = RSTRING_PTR(filename);
@@ -1045,6 +1352,8 @@ shoes_cached_image *shoes_load_image(VALUE slot, VALUE imgpath, VALUE cache_opt)
         req->port = NUM2INT(port);
         req->path = strdup(RSTRING_PTR(requ));
         req->handler = shoes_http_image_handler;
+        req->flags = SHOES_DL_DEFAULTS | SHOES_DL_DIGEST;
+        req->priority = SHOES_HTTP_PRIORITY_NORMAL;
         req->filepath = strdup(RSTRING_PTR(tmppath));
         idat->filepath = strdup(RSTRING_PTR(tmppath));
         idat->uripath = strdup(RSTRING_PTR(imgpath));
@@ -1060,9 +1369,10 @@ shoes_cached_image *shoes_load_image(VALUE slot, VALUE imgpath, VALUE cache_opt)
     } else {
       /* here when reading from file */
       //fprintf(stderr, "Read and mem cache file %s\n",RSTRING_PTR(imgpath));
-      img = shoes_surface_create_from_file(imgpath, &width, &height);
+      img = shoes_surface_create_from_file(imgpath, &width, &height, &format);
       if (img != shoes_world->blank_image) {
         cached = shoes_cached_image_new(width, height, img);
+        cached->format = format;
         shoes_cache_insert(SHOES_CACHE_FILE, imgpath, cached);
       }
     }
@@ -7,7 +7,7 @@
 #define SHOES_INTERNAL_H
 
 #define SHOE_REALLOC_N(V, T, N)     (V)=(T *)realloc((char*)(V), sizeof(T)*(N))
-#define SHOE_ALLOC_N(T, N)          (T *)malloc(sizeof(T) * N)
+#define SHOE_ALLOC_N(T, N)          (T *)malloc(sizeof(T) * (N))
 #define SHOE_ALLOC(T)               (T *)malloc(sizeof(T))
 #define SHOE_FREE(T)                free((void*)T)
 
@@ -741,6 +741,11 @@ int shoes_throw_message(unsigned int name, VALUE obj, void *data)
   return shoes_catch_message(name, obj, data);
 }
 
+int shoes_post_message(unsigned int name, VALUE obj, void *data, int mode)
+{
+  return shoes_catch_message(name, obj, data);
+}
+
 void shoes_native_slot_mark(SHOES_SLOT_OS *slot)
 {
   rb_gc_mark_maybe(slot->controls);
@@ -766,6 +771,12 @@ void shoes_native_slot_paint(SHOES_SLOT_OS *slot)
   [slot->view setNeedsDisplay: YES];
 }
 
+void shoes_native_slot_paint_rect(SHOES_SLOT_OS *slot, int x, int y, int w, int h)
+{
+  // ShoesView is flipped, so only the scroll lies between canvas and view
+  [slot->view setNeedsDisplayInRect: NSMakeRect(x, y - slot->scrolly, w, h)];
+}
+
 void shoes_native_slot_lengthen(SHOES_SLOT_OS *slot, int height, int endy)
 {
   if (slot->vscroll)
@@ -975,6 +986,11 @@ shoes_native_loop()
   [NSApp run];
 }
 
+void
+shoes_native_wakeup()
+{
+}
+
 void
 shoes_native_app_close(shoes_app *app)
 {
@@ -27,6 +27,12 @@
 #endif
 #include <pthread.h>
 #include <glib/gprintf.h>
+#include <ruby/thread.h>
+#ifndef SHOES_GTK_WIN32
+#include <glib-unix.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include "gtk.h"
 #include "shoes/native/gtk/gtkfixedalt.h"
@@ -112,6 +118,8 @@ shoes_gtk_app_cmdline (GApplication *application, gchar ***arguments,
   return TRUE;
 }
 
+static void shoes_gtk_msg_init(void);   // the message ring, below
+
 void shoes_native_init() {
 #if !defined(RUBY_HTTP) && !defined(SHOES_GTK_WIN32)
     curl_global_init(CURL_GLOBAL_ALL);
@@ -132,6 +140,7 @@ void shoes_native_init() {
     // Shoes 3.3.3 way to init
     gtk_init(NULL, NULL);
 #endif
+    shoes_gtk_msg_init();
 }
 
 /* end of GApplication init  */
@@ -182,44 +191,167 @@ unsigned long shoes_diff_time(SHOES_TIME *start, SHOES_TIME *end) {
 }
 #endif
 
+//
+// Messages from worker threads (downloads) to the GUI thread go through a
+// bounded lock-free ring, many producers and one consumer. A single GSource
+// drains it from the main loop, a batch per dispatch, so a burst of events
+// costs one wakeup instead of one idle callback and one mutex/cond pair
+// each. Coalesced messages (progress) that are superseded by a later one
+// for the same object in the same batch are dropped. A producer that wants
+// the handler's result waits on one shared condition. The GUI thread itself
+// never queues, it would be waiting on itself, so it handles its own
+// messages on the spot the way cocoa.m does.
+//
+#define SHOES_MSG_QUEUE 1024   // a power of two
+#define SHOES_MSG_BATCH 64
+
 typedef struct {
+    int done, ret;
+} shoes_gtk_reply;
+
+typedef struct {
+    volatile gint seq;
     unsigned int name;
     VALUE obj;
     void *data;
-    pthread_mutex_t mutex;
-    pthread_cond_t cond;
-    int ret;
+    int mode;
+    shoes_gtk_reply *reply;
 } shoes_gtk_msg;
 
+static shoes_gtk_msg shoes_gtk_msgs[SHOES_MSG_QUEUE];
+static volatile gint shoes_gtk_msg_tail = 0;   // next slot to claim, producers
+static gint shoes_gtk_msg_head = 0;            // next slot to read, GUI thread only
+static GMutex shoes_gtk_reply_lock;
+static GCond shoes_gtk_reply_cond;
+static GThread *shoes_gtk_gui_thread = NULL;
 
-static gboolean shoes_gtk_catch_message(gpointer user) {
-    shoes_gtk_msg *msg = (shoes_gtk_msg *)user;
-    pthread_mutex_lock(&msg->mutex);
-    msg->ret = shoes_catch_message(msg->name, msg->obj, msg->data);
-    pthread_cond_signal(&msg->cond);
-    pthread_mutex_unlock(&msg->mutex);
-    return FALSE;
+static gboolean shoes_gtk_msg_ready() {
+    shoes_gtk_msg *msg = &shoes_gtk_msgs[shoes_gtk_msg_head & (SHOES_MSG_QUEUE - 1)];
+    return g_atomic_int_get(&msg->seq) == shoes_gtk_msg_head + 1;
 }
 
-// Only called by image.c
-int shoes_throw_message(unsigned int name, VALUE obj, void *data) {
-    int ret;
-    shoes_gtk_msg *msg = SHOE_ALLOC(shoes_gtk_msg);
+static gboolean shoes_gtk_msg_prepare(GSource *source, gint *timeout) {
+    *timeout = -1;
+    return shoes_gtk_msg_ready();
+}
+
+static gboolean shoes_gtk_msg_check(GSource *source) {
+    return shoes_gtk_msg_ready();
+}
+
+static gboolean shoes_gtk_msg_dispatch(GSource *source, GSourceFunc callback, gpointer user) {
+    shoes_gtk_msg batch[SHOES_MSG_BATCH];
+    int i, j, n = 0;
+
+    while (n < SHOES_MSG_BATCH && shoes_gtk_msg_ready()) {
+        shoes_gtk_msg *msg = &shoes_gtk_msgs[shoes_gtk_msg_head & (SHOES_MSG_QUEUE - 1)];
+        batch[n++] = *msg;
+        g_atomic_int_set(&msg->seq, shoes_gtk_msg_head + SHOES_MSG_QUEUE);
+        shoes_gtk_msg_head++;
+    }
+
+    for (i = 0; i < n; i++) {
+        shoes_gtk_msg *msg = &batch[i];
+        int ret;
+        if (msg->mode == SHOES_MSG_COALESCE) {
+            for (j = i + 1; j < n; j++)
+                if (batch[j].mode == SHOES_MSG_COALESCE && batch[j].name == msg->name && batch[j].obj == msg->obj)
+                    break;
+            if (j < n) {
+                free(msg->data);
+                continue;
+            }
+        }
+        ret = shoes_catch_message(msg->name, msg->obj, msg->data);
+        if (msg->reply != NULL) {
+            g_mutex_lock(&shoes_gtk_reply_lock);
+            msg->reply->ret = ret;
+            msg->reply->done = 1;
+            g_cond_broadcast(&shoes_gtk_reply_cond);
+            g_mutex_unlock(&shoes_gtk_reply_lock);
+        }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+static GSourceFuncs shoes_gtk_msg_funcs = {
+    shoes_gtk_msg_prepare, shoes_gtk_msg_check, shoes_gtk_msg_dispatch, NULL
+};
+
+static void shoes_gtk_msg_init(void) {
+    int i;
+    GSource *source;
+    shoes_gtk_gui_thread = g_thread_self();
+    for (i = 0; i < SHOES_MSG_QUEUE; i++)
+        shoes_gtk_msgs[i].seq = i;
+    source = g_source_new(&shoes_gtk_msg_funcs, sizeof(GSource));
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_attach(source, NULL);
+    g_source_unref(source);
+}
+
+static void *shoes_gtk_msg_nap(void *data) {
+    g_usleep(1000);
+    return NULL;
+}
+
+static void *shoes_gtk_reply_wait(void *data) {
+    shoes_gtk_reply *reply = (shoes_gtk_reply *)data;
+    g_mutex_lock(&shoes_gtk_reply_lock);
+    while (!reply->done)
+        g_cond_wait(&shoes_gtk_reply_cond, &shoes_gtk_reply_lock);
+    g_mutex_unlock(&shoes_gtk_reply_lock);
+    return NULL;
+}
+
+// Ruby threads (Shoes.notify_worker) come here holding the GVL, which the GUI
+// thread needs to handle anything, so they let go of it while they wait.
+int shoes_post_message(unsigned int name, VALUE obj, void *data, int mode) {
+    shoes_gtk_reply reply = {0, 0};
+    shoes_gtk_msg *msg;
+    gint pos;
+    int rubyist;
+
+    if (g_thread_self() == shoes_gtk_gui_thread)
+        return shoes_catch_message(name, obj, data);
+
+    rubyist = ruby_native_thread_p();
+    for (;;) {
+        pos = g_atomic_int_get(&shoes_gtk_msg_tail);
+        msg = &shoes_gtk_msgs[pos & (SHOES_MSG_QUEUE - 1)];
+        gint dif = g_atomic_int_get(&msg->seq) - pos;
+        if (dif == 0) {
+            if (g_atomic_int_compare_and_exchange(&shoes_gtk_msg_tail, pos, pos + 1))
+                break;
+        } else if (dif < 0) {
+            // full, let the GUI thread catch up
+            g_main_context_wakeup(NULL);
+            if (rubyist)
+                rb_thread_call_without_gvl(shoes_gtk_msg_nap, NULL, RUBY_UBF_IO, NULL);
+            else
+                g_usleep(1000);
+        }
+    }
+
     msg->name = name;
     msg->obj = obj;
     msg->data = data;
-    pthread_mutex_init(&msg->mutex, NULL);
-    pthread_cond_init(&msg->cond, NULL);
-    msg->ret = 0;
-
-    pthread_mutex_lock(&msg->mutex);
-    g_idle_add_full(G_PRIORITY_DEFAULT, shoes_gtk_catch_message, msg, NULL);
-    pthread_cond_wait(&msg->cond, &msg->mutex);
-    ret = msg->ret;
-    pthread_mutex_unlock(&msg->mutex);
+    msg->mode = mode;
+    msg->reply = mode == SHOES_MSG_WAIT ? &reply : NULL;
+    g_atomic_int_set(&msg->seq, pos + 1);
+    g_main_context_wakeup(NULL);
+
+    if (mode != SHOES_MSG_WAIT)
+        return SHOES_DOWNLOAD_CONTINUE;
+    if (rubyist)
+        rb_thread_call_without_gvl(shoes_gtk_reply_wait, &reply, RUBY_UBF_IO, NULL);
+    else
+        shoes_gtk_reply_wait(&reply);
+    return reply.ret;
+}
 
-    free(msg);
-    return ret;
+int shoes_throw_message(unsigned int name, VALUE obj, void *data) {
+    return shoes_post_message(name, obj, data, SHOES_MSG_WAIT);
 }
 
 void shoes_native_slot_mark(SHOES_SLOT_OS *slot) {}
@@ -233,6 +365,13 @@ void shoes_native_slot_clear(shoes_canvas *canvas) {
 
 void shoes_native_slot_paint(SHOES_SLOT_OS *slot) {
     gtk_widget_queue_draw(slot->oscanvas);
+    shoes_native_wakeup();
+}
+
+// x, y are canvas coordinates, like a shoes_place
+void shoes_native_slot_paint_rect(SHOES_SLOT_OS *slot, int x, int y, int w, int h) {
+    gtk_widget_queue_draw_area(slot->oscanvas, x, y - slot->scrolly, w, h);
+    shoes_native_wakeup();
 }
 
 void shoes_native_slot_lengthen(SHOES_SLOT_OS *slot, int height, int endy) {
@@ -269,14 +408,54 @@ void shoes_native_remove_item(SHOES_SLOT_OS *slot, VALUE item, char c) {
 //
 // Window-level events
 //
+
+// Pointer motion is coalesced to one walk of the app per frame: events only
+// note where the pointer is and the frame clock sends the latest position
+// on. Moves that don't cross a pixel (high rate mice) are dropped.
+static gboolean shoes_app_gtk_motion_retry(gpointer data);
+
+static void shoes_app_gtk_motion_held(shoes_app *app) {
+    int wait = shoes_canvas_send_held_motion(app->canvas);
+    if (wait >= 0 && !app->os.motion_retry)
+        app->os.motion_retry = g_timeout_add(wait, shoes_app_gtk_motion_retry, app);
+}
+
+static gboolean shoes_app_gtk_motion_retry(gpointer data) {
+    shoes_app *app = (shoes_app *)data;
+    app->os.motion_retry = 0;
+    shoes_app_gtk_motion_held(app);
+    return G_SOURCE_REMOVE;
+}
+
+static void shoes_app_gtk_motion_flush(shoes_app *app) {
+    if (!app->os.motion_pending) return;
+    app->os.motion_pending = 0;
+    shoes_app_motion(app, app->os.motionx, app->os.motiony);
+    shoes_app_gtk_motion_held(app);
+}
+
+static gboolean shoes_app_gtk_motion_tick(GtkWidget *widget, GdkFrameClock *clock, gpointer data) {
+    shoes_app *app = (shoes_app *)data;
+    app->os.motion_tick = 0;
+    shoes_app_gtk_motion_flush(app);
+    return G_SOURCE_REMOVE;
+}
+
 static gboolean shoes_app_gtk_motion(GtkWidget *widget, GdkEventMotion *event, gpointer data) {
-    GdkModifierType state;
     shoes_app *app = (shoes_app *)data;
     if (!event->is_hint) {
+        int x, y;
         shoes_canvas *canvas;
         Data_Get_Struct(app->canvas, shoes_canvas, canvas);
-        state = (GdkModifierType)event->state;
-        shoes_app_motion(app, (int)event->x, (int)event->y + canvas->slot->scrolly);
+        x = (int)event->x;
+        y = (int)event->y + canvas->slot->scrolly;
+        if (!app->os.motion_pending && x == app->mousex && y == app->mousey)
+            return TRUE;
+        app->os.motionx = x;
+        app->os.motiony = y;
+        app->os.motion_pending = 1;
+        if (!app->os.motion_tick)
+            app->os.motion_tick = gtk_widget_add_tick_callback(widget, shoes_app_gtk_motion_tick, app, NULL);
     }
     return TRUE;
 }
@@ -291,7 +470,8 @@ static gboolean shoes_app_gtk_button(GtkWidget *widget, GdkEventButton *event, g
     GdkModifierType state;
    
     gdk_window_get_device_position(gtk_widget_get_window(widget), event->device, &x, &y, &state);
-    
+    shoes_app_gtk_motion_flush(app);
+
     if (event->type == GDK_BUTTON_PRESS) {
         shoes_app_click(app, event->button, x, y);
     } else if (event->type == GDK_BUTTON_RELEASE) {
@@ -304,6 +484,7 @@ static gboolean shoes_app_gtk_button(GtkWidget *widget, GdkEventButton *event, g
     shoes_app *app = (shoes_app *)data;
     shoes_canvas *canvas;
     Data_Get_Struct(app->canvas, shoes_canvas, canvas);
+    shoes_app_gtk_motion_flush(app);
     if (event->type == GDK_BUTTON_PRESS) {
         shoes_app_click(app, event->button, event->x, event->y + canvas->slot->scrolly);
     } else if (event->type == GDK_BUTTON_RELEASE) {
@@ -434,6 +615,17 @@ static gboolean shoes_app_gtk_quit(GtkWidget *widget, GdkEvent *event, gpointer
     return FALSE;
 }
 
+// However the window goes away (closed by the user, by `close` or by its
+// owner), the motion timers must not outlive it.
+static void shoes_app_gtk_destroy(GtkWidget *widget, gpointer data) {
+    shoes_app *app = (shoes_app *)data;
+    if (app->os.motion_retry) g_source_remove(app->os.motion_retry);
+    if (app->os.motion_tick) gtk_widget_remove_tick_callback(widget, app->os.motion_tick);
+    app->os.motion_retry = 0;
+    app->os.motion_tick = 0;
+    app->os.motion_pending = 0;
+}
+
 static void shoes_canvas_gtk_paint_children(GtkWidget *widget, gpointer data) {
     shoes_canvas *canvas = (shoes_canvas *)data;
     gtk_container_propagate_draw(GTK_CONTAINER(canvas->slot->oscanvas), widget,
@@ -493,75 +685,97 @@ static void shoes_canvas_gtk_scroll(GtkRange *r, gpointer data) {
     shoes_slot_repaint(canvas->app->slot);
 }
 
-// TODO:  remove dead code? warning: 'shoes_app_g_poll' defined but not used
 #ifndef SHOES_GTK_WIN32
-static gint shoes_app_g_poll(GPollFD *fds, guint nfds, gint timeout) {
-    struct timeval tv;
+//
+// GLib polls through Ruby so other Ruby threads run while the GUI is idle.
+// The fd sets are kept between calls, there is no timeout cap (the loop
+// sleeps until GLib has something to do), and the GVL is only given up
+// when the poll can actually block. Ruby threads that change what's on
+// screen wake the loop through shoes_native_wakeup.
+//
+static rb_fdset_t shoes_poll_rset, shoes_poll_wset, shoes_poll_xset;
+static int shoes_wake_fds[2] = {-1, -1};
+static gint shoes_wake_pending = 0;
 
-    rb_fdset_t rset, wset, xset;
+static gint shoes_app_g_poll(GPollFD *fds, guint nfds, gint timeout) {
+    struct timeval tv, *tvp = NULL;
     GPollFD *f;
     int ready;
     int maxfd = 0;
 
-    rb_fd_init(&rset); // was FD_ZERO()
-    rb_fd_init(&wset);
-    rb_fd_init(&xset);
+    // a non-blocking check doesn't need to let go of Ruby
+    if (timeout == 0)
+        return g_poll(fds, nfds, 0);
 
+    rb_fd_zero(&shoes_poll_rset);
+    rb_fd_zero(&shoes_poll_wset);
+    rb_fd_zero(&shoes_poll_xset);
     for (f = fds; f < &fds[nfds]; ++f)
         if (f->fd >= 0) {
             if (f->events & G_IO_IN)
-                //FD_SET (f->fd, &rset);
-                rb_fd_set(f->fd, &rset);
+                rb_fd_set(f->fd, &shoes_poll_rset);
             if (f->events & G_IO_OUT)
-                //FD_SET (f->fd, &wset);
-                rb_fd_set(f->fd, &wset);
+                rb_fd_set(f->fd, &shoes_poll_wset);
             if (f->events & G_IO_PRI)
-                //FD_SET (f->fd, &xset);
-                rb_fd_set(f->fd, &xset);
+                rb_fd_set(f->fd, &shoes_poll_xset);
             if (f->fd > maxfd && (f->events & (G_IO_IN|G_IO_OUT|G_IO_PRI)))
                 maxfd = f->fd;
         }
 
-    //
-    // If we poll indefinitely, then the window updates will
-    // pile up for as long as Ruby is churning away.
-    //
-    // Give Ruby half-seconds in which to work, in order to
-    // keep it from completely blocking the GUI.
-    //
-    // cjc: timeout appears to be in millisecs.
-    if (timeout == -1 || timeout > 500)
-        timeout = 500;
-
-    tv.tv_sec = timeout / 1000;
-    tv.tv_usec = (timeout % 1000) * 1000;
+    if (timeout > 0) {
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
+        tvp = &tv;
+    }
 
-    ready = rb_thread_fd_select (maxfd + 1, &rset, &wset, &xset, &tv);
-    if (ready > 0)
-        // I think the idea here is that the Ruby threads might cause Gtk events
-        // and that's supposed to pass back in the f->revents
-        // Does Ruby/Windows execute this code more often or incorrectly?
-        for (f = fds; f < &fds[nfds]; ++f) {
-            f->revents = 0;
-            if (f->fd >= 0) {
-                //if (FD_ISSET (f->fd, &rset))
-                if (rb_fd_isset (f->fd, &rset))
-                    f->revents |= G_IO_IN;
-                //if (FD_ISSET (f->fd, &wset))
-                if (rb_fd_isset (f->fd, &wset))
-                    f->revents |= G_IO_OUT;
-                //if (FD_ISSET (f->fd, &xset))
-                if (rb_fd_isset (f->fd, &xset))
-                    f->revents |= G_IO_PRI;
-            }
+    ready = rb_thread_fd_select(maxfd + 1, &shoes_poll_rset, &shoes_poll_wset, &shoes_poll_xset, tvp);
+    for (f = fds; f < &fds[nfds]; ++f) {
+        f->revents = 0;
+        if (ready > 0 && f->fd >= 0) {
+            if (rb_fd_isset(f->fd, &shoes_poll_rset))
+                f->revents |= G_IO_IN;
+            if (rb_fd_isset(f->fd, &shoes_poll_wset))
+                f->revents |= G_IO_OUT;
+            if (rb_fd_isset(f->fd, &shoes_poll_xset))
+                f->revents |= G_IO_PRI;
         }
-    // Free the allocated storage from rb_fd_init
-    rb_fd_term(&rset);
-    rb_fd_term(&wset);
-    rb_fd_term(&xset);
+    }
     return ready;
 }
+
+static gboolean shoes_gtk_woken(gint fd, GIOCondition condition, gpointer data) {
+    char buf[64];
+    g_atomic_int_set(&shoes_wake_pending, 0);
+    while (read(fd, buf, sizeof(buf)) > 0);
+    return G_SOURCE_CONTINUE;
+}
+
+static void shoes_gtk_wakeup_init() {
+    if (shoes_wake_fds[0] >= 0) return;
+    rb_fd_init(&shoes_poll_rset);
+    rb_fd_init(&shoes_poll_wset);
+    rb_fd_init(&shoes_poll_xset);
+    if (g_unix_open_pipe(shoes_wake_fds, FD_CLOEXEC, NULL)) {
+        g_unix_set_fd_nonblocking(shoes_wake_fds[0], TRUE, NULL);
+        g_unix_set_fd_nonblocking(shoes_wake_fds[1], TRUE, NULL);
+        g_unix_fd_add(shoes_wake_fds[0], G_IO_IN, shoes_gtk_woken, NULL);
+    }
+}
+
+// Safe from any Ruby thread. Only the first call before the loop
+// runs again writes to the pipe.
+void shoes_native_wakeup() {
+    if (shoes_wake_fds[1] < 0 || rb_thread_current() == rb_thread_main()) return;
+    if (g_atomic_int_compare_and_exchange(&shoes_wake_pending, 0, 1)) {
+        if (write(shoes_wake_fds[1], "w", 1) < 0)
+            g_atomic_int_set(&shoes_wake_pending, 0);
+    }
+}
 #else
+// gtkrb_idle below already hands Ruby a slice every 10ms
+void shoes_native_wakeup() {
+}
+
 /*
  * Fake a rb_fd to always have something to read
  * Ruby run select
@@ -792,6 +1006,8 @@ shoes_code shoes_native_app_open(shoes_app *app, char *path, int dialog) {
                      G_CALLBACK(shoes_app_gtk_keypress), app);
     g_signal_connect(G_OBJECT(gk->window), "delete-event",
                      G_CALLBACK(shoes_app_gtk_quit), app);
+    g_signal_connect(G_OBJECT(gk->window), "destroy",
+                     G_CALLBACK(shoes_app_gtk_destroy), app);
 
     app->slot->oscanvas = gk->window;
     return SHOES_OK;
@@ -821,6 +1037,7 @@ static gboolean gtkrb_idle() {
 
 void shoes_native_loop() {
 #ifndef SHOES_GTK_WIN32
+    shoes_gtk_wakeup_init();
     g_main_context_set_poll_func(g_main_context_default(), shoes_app_g_poll);
 #else
     /* Win32 (should work for Linux too when finished)
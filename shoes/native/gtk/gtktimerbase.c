@@ -7,19 +7,208 @@
 #include "shoes/native/gtk/gtktimerbase.h"
 #include "shoes/types/timerbase.h"
 
-static gboolean shoes_gtk_animate(gpointer data) {
-    VALUE timer = (VALUE)data;
-    shoes_timer *self_t;
-    Data_Get_Struct(timer, shoes_timer, self_t);
-    if (self_t->started == ANIM_STARTED)
-        shoes_timer_call(timer);
-    return self_t->started == ANIM_STARTED;
+//
+// Every animate, every and timer in a window runs off that window's
+// GdkFrameClock. While something is due within SHOES_CLOCK_NEAR the window
+// keeps a tick callback; each tick fires the due timers in order and then
+// lays out and repaints once, so the paint lands in the same frame. Slower
+// timers, and windows that aren't mapped (no frames then), sleep on one
+// timeout until the next is nearly due.
+//
+#define SHOES_CLOCK_NEAR 50000     // microseconds
+
+typedef struct {
+    guint id;
+    VALUE timer;
+    GtkWidget *window;
+    gint64 interval, due;          // microseconds, monotonic clock
+} shoes_gtk_tick;
+
+typedef struct {
+    GtkWidget *window;
+    guint tick, wake;
+    char running, dead;    // a timer block may close the window mid-run
+} shoes_gtk_clock;
+
+static GPtrArray *shoes_gtk_ticks = NULL, *shoes_gtk_clocks = NULL;
+static guint shoes_gtk_tick_last = 0;
+
+static void shoes_gtk_clock_arm(shoes_gtk_clock *clock, gint64 now);
+
+static shoes_gtk_tick *shoes_gtk_tick_find(guint id) {
+    guint i;
+    for (i = 0; i < shoes_gtk_ticks->len; i++) {
+        shoes_gtk_tick *t = g_ptr_array_index(shoes_gtk_ticks, i);
+        if (t->id == id) return t;
+    }
+    return NULL;
+}
+
+static void shoes_gtk_tick_drop(shoes_gtk_tick *t) {
+    g_ptr_array_remove_fast(shoes_gtk_ticks, t);
+    g_free(t);
+}
+
+static gint shoes_gtk_tick_order(gconstpointer a, gconstpointer b) {
+    const shoes_gtk_tick *x = *(shoes_gtk_tick **)a, *y = *(shoes_gtk_tick **)b;
+    return x->due < y->due ? -1 : (x->due > y->due ? 1 : (int)x->id - (int)y->id);
+}
+
+static gboolean shoes_gtk_clock_mapped(shoes_gtk_clock *clock) {
+    return clock->window != NULL && gtk_widget_get_mapped(clock->window);
+}
+
+// fires whatever is due at `now`, oldest deadline first. Returns 0 if one of
+// them closed the window, the clock is freed then.
+static int shoes_gtk_clock_run(shoes_gtk_clock *clock, gint64 now) {
+    guint i, n = 0;
+    guint *due;
+    g_ptr_array_sort(shoes_gtk_ticks, shoes_gtk_tick_order);
+    due = g_new(guint, shoes_gtk_ticks->len + 1);
+    for (i = 0; i < shoes_gtk_ticks->len; i++) {
+        shoes_gtk_tick *t = g_ptr_array_index(shoes_gtk_ticks, i);
+        if (t->window == clock->window && t->due <= now)
+            due[n++] = t->id;
+    }
+
+    clock->running = 1;
+    shoes_canvas_repaint_hold();
+    for (i = 0; i < n && !clock->dead; i++) {
+        shoes_timer *self_t;
+        unsigned int dropped;
+        VALUE timer;
+        shoes_gtk_tick *t = shoes_gtk_tick_find(due[i]);
+        if (t == NULL) continue;   // removed by an earlier block
+        dropped = (unsigned int)((now - t->due) / t->interval);
+        t->due += (gint64)(dropped + 1) * t->interval;
+        timer = t->timer;
+        Data_Get_Struct(timer, shoes_timer, self_t);
+        if (self_t->started == ANIM_STARTED)
+            shoes_timer_call_at(timer, now / 1000000., dropped);
+        if ((t = shoes_gtk_tick_find(due[i])) != NULL && self_t->started != ANIM_STARTED)
+            shoes_gtk_tick_drop(t);
+    }
+    shoes_canvas_repaint_release();
+    g_free(due);
+    clock->running = 0;
+    if (clock->dead) {
+        g_free(clock);
+        return 0;
+    }
+    return 1;
+}
+
+static gboolean shoes_gtk_clock_tick(GtkWidget *widget, GdkFrameClock *frame_clock, gpointer data) {
+    shoes_gtk_clock *clock = (shoes_gtk_clock *)data;
+    gint64 now = gdk_frame_clock_get_frame_time(frame_clock);
+    if (!shoes_gtk_clock_run(clock, now))
+        return G_SOURCE_REMOVE;
+    shoes_gtk_clock_arm(clock, now);
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean shoes_gtk_clock_wake(gpointer data) {
+    shoes_gtk_clock *clock = (shoes_gtk_clock *)data;
+    gint64 now = g_get_monotonic_time();
+    clock->wake = 0;
+    if (!shoes_gtk_clock_mapped(clock) && !shoes_gtk_clock_run(clock, now))
+        return G_SOURCE_REMOVE;
+    shoes_gtk_clock_arm(clock, now);
+    return G_SOURCE_REMOVE;
+}
+
+static void shoes_gtk_clock_arm(shoes_gtk_clock *clock, gint64 now) {
+    guint i;
+    gint64 next = G_MAXINT64;
+    for (i = 0; i < shoes_gtk_ticks->len; i++) {
+        shoes_gtk_tick *t = g_ptr_array_index(shoes_gtk_ticks, i);
+        if (t->window == clock->window && t->due < next)
+            next = t->due;
+    }
+
+    if (next != G_MAXINT64 && shoes_gtk_clock_mapped(clock) && next - now < SHOES_CLOCK_NEAR) {
+        if (clock->wake) g_source_remove(clock->wake);
+        clock->wake = 0;
+        if (!clock->tick)
+            clock->tick = gtk_widget_add_tick_callback(clock->window, shoes_gtk_clock_tick, clock, NULL);
+        return;
+    }
+    if (clock->tick) gtk_widget_remove_tick_callback(clock->window, clock->tick);
+    clock->tick = 0;
+    if (clock->wake) g_source_remove(clock->wake);
+    clock->wake = 0;
+    if (next != G_MAXINT64) {
+        // wake a little early so the first frame tick is on time
+        gint64 wait = next - now - (shoes_gtk_clock_mapped(clock) ? SHOES_CLOCK_NEAR / 2 : 0);
+        clock->wake = g_timeout_add(wait > 0 ? (guint)(wait / 1000) : 0, shoes_gtk_clock_wake, clock);
+    }
+}
+
+static void shoes_gtk_clock_remap(GtkWidget *widget, gpointer data) {
+    shoes_gtk_clock_arm((shoes_gtk_clock *)data, g_get_monotonic_time());
+}
+
+static void shoes_gtk_clock_destroy(GtkWidget *widget, gpointer data) {
+    shoes_gtk_clock *clock = (shoes_gtk_clock *)data;
+    guint i = 0;
+    while (i < shoes_gtk_ticks->len) {
+        shoes_gtk_tick *t = g_ptr_array_index(shoes_gtk_ticks, i);
+        if (t->window == clock->window) shoes_gtk_tick_drop(t);
+        else i++;
+    }
+    if (clock->wake) g_source_remove(clock->wake);
+    clock->wake = clock->tick = 0;
+    clock->window = NULL;
+    g_ptr_array_remove_fast(shoes_gtk_clocks, clock);
+    // closed from one of its own timers, shoes_gtk_clock_run frees it
+    if (clock->running)
+        clock->dead = 1;
+    else
+        g_free(clock);
+}
+
+static shoes_gtk_clock *shoes_gtk_clock_for(GtkWidget *window) {
+    guint i;
+    shoes_gtk_clock *clock;
+    for (i = 0; i < shoes_gtk_clocks->len; i++) {
+        clock = g_ptr_array_index(shoes_gtk_clocks, i);
+        if (clock->window == window) return clock;
+    }
+    clock = g_new0(shoes_gtk_clock, 1);
+    clock->window = window;
+    g_ptr_array_add(shoes_gtk_clocks, clock);
+    if (window != NULL) {
+        g_signal_connect(window, "map", G_CALLBACK(shoes_gtk_clock_remap), clock);
+        g_signal_connect(window, "unmap", G_CALLBACK(shoes_gtk_clock_remap), clock);
+        g_signal_connect(window, "destroy", G_CALLBACK(shoes_gtk_clock_destroy), clock);
+    }
+    return clock;
 }
 
 void shoes_native_timer_remove(shoes_canvas *canvas, SHOES_TIMER_REF ref) {
-    g_source_remove(ref);
+    GtkWidget *window;
+    shoes_gtk_tick *t;
+    if (shoes_gtk_ticks == NULL || (t = shoes_gtk_tick_find(ref)) == NULL) return;
+    window = t->window;
+    shoes_gtk_tick_drop(t);
+    shoes_gtk_clock_arm(shoes_gtk_clock_for(window), g_get_monotonic_time());
 }
 
 SHOES_TIMER_REF shoes_native_timer_start(VALUE self, shoes_canvas *canvas, unsigned int interval) {
-    return g_timeout_add(interval, shoes_gtk_animate, (gpointer)self);
-}
\ No newline at end of file
+    shoes_gtk_tick *t;
+    gint64 now = g_get_monotonic_time();
+    if (shoes_gtk_ticks == NULL) {
+        shoes_gtk_ticks = g_ptr_array_new();
+        shoes_gtk_clocks = g_ptr_array_new();
+    }
+    t = g_new0(shoes_gtk_tick, 1);
+    if (++shoes_gtk_tick_last == 0) shoes_gtk_tick_last = 1;
+    t->id = shoes_gtk_tick_last;
+    t->timer = self;
+    t->window = canvas->app->os.window;
+    t->interval = (gint64)interval * 1000;
+    t->due = now + t->interval;
+    g_ptr_array_add(shoes_gtk_ticks, t);
+    shoes_gtk_clock_arm(shoes_gtk_clock_for(t->window), now);
+    return t->id;
+}
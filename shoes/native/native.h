@@ -22,18 +22,28 @@
 
 #define SHOES_THREAD_DOWNLOAD 41
 #define SHOES_IMAGE_DOWNLOAD  42
+#define SHOES_WORKER_EVENT    43
+#define SHOES_SVG_PARSED      44
+#define SHOES_TILE_DECODED    45
 #define SHOES_MAX_MESSAGE     100
 
+// how shoes_post_message hands a message to the GUI thread
+#define SHOES_MSG_WAIT     0   // block until handled, returns the handler's result
+#define SHOES_MSG_POST     1   // fire and forget, the handler frees data
+#define SHOES_MSG_COALESCE 2   // like POST, but a later message for the same obj replaces it
+
 VALUE shoes_font_list(void);
 VALUE shoes_load_font(const char *);
 void shoes_native_init(void);
 void shoes_native_cleanup(shoes_world_t *world);
 void shoes_native_quit(void);
 int shoes_throw_message(unsigned int, VALUE, void *);
+int shoes_post_message(unsigned int, VALUE, void *, int);
 void shoes_native_slot_mark(SHOES_SLOT_OS *);
 void shoes_native_slot_reset(SHOES_SLOT_OS *);
 void shoes_native_slot_clear(shoes_canvas *);
 void shoes_native_slot_paint(SHOES_SLOT_OS *);
+void shoes_native_slot_paint_rect(SHOES_SLOT_OS *, int, int, int, int);
 void shoes_native_slot_lengthen(SHOES_SLOT_OS *, int, int);
 void shoes_native_slot_scroll_top(SHOES_SLOT_OS *);
 int shoes_native_slot_gutter(SHOES_SLOT_OS *);
@@ -52,6 +62,7 @@ void shoes_native_set_resizable(shoes_app *app, int resizable);
 shoes_code shoes_native_app_open(shoes_app *, char *, int);
 void shoes_native_app_show(shoes_app *);
 void shoes_native_loop(void);
+void shoes_native_wakeup(void);
 void shoes_native_app_close(shoes_app *);
 void shoes_native_app_set_icon(shoes_app *, char *);
 void shoes_native_app_set_wtitle(shoes_app *, char*);
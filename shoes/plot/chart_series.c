@@ -2,11 +2,31 @@
  * shoes_chart_series class
  * encapsulates the data and unique presentation values of them
  * not really Shoes api user visible (yet)
+ *
+ * The numbers live in a plain C array of doubles (NAN for nil) so drawing
+ * never touches Ruby objects. Ruby arrays are only made when a script asks
+ * for series.values or series.labels, and labels that weren't given are
+ * made up from the index when they are needed. plot.load_csv hands over its
+ * x column as doubles (keys) and the labels are formatted from those.
+ *
+ * A streaming series (streaming: true, capacity: n) keeps only the last n
+ * values in a ring. Every slot is written twice, at i and i + n, so the
+ * window starting at the oldest value is always one contiguous run of
+ * doubles and the painters never see the wrap.
+ *
+ * For zooming, the lowest and highest value of any index range comes from
+ * a pyramid: the lo/hi of each block of SERIES_BLOCK values, then of each
+ * pair of blocks, then of each pair of those... Each also counts the
+ * missing values under it. It's rebuilt when a range is asked for after
+ * the values changed.
 */
 #include "shoes/types/color.h"
 #include "shoes/plot/plot.h"
+#include <time.h>
 
 
+#define SERIES_BLOCK 64
+
 // forward declare
 static VALUE shoes_chart_series_parse_points(VALUE);
 
@@ -20,9 +40,14 @@ void shoes_chart_series_mark(shoes_chart_series *self_t) {
     rb_gc_mark_maybe(self_t->strokes);
     rb_gc_mark_maybe(self_t->point_type);
     rb_gc_mark_maybe(self_t->color);
+    rb_gc_mark_maybe(self_t->plot);
 }
 
 void shoes_chart_series_free(shoes_chart_series *self_t) {
+    if (self_t->buf) free(self_t->buf);
+    if (self_t->pyramid) free(self_t->pyramid);
+    if (self_t->keys) free(self_t->keys);
+    if (self_t->keyfmt) free(self_t->keyfmt);
     RUBY_CRITICAL(SHOE_FREE(self_t));
 }
 
@@ -31,8 +56,8 @@ VALUE shoes_chart_series_alloc(VALUE klass) {
     shoes_chart_series *ser = SHOE_ALLOC(shoes_chart_series);
     SHOE_MEMZERO(ser, shoes_chart_series, 1);
     obj = Data_Wrap_Struct(klass, shoes_chart_series_mark, shoes_chart_series_free, ser);
-    ser->values = rb_ary_new();
-    ser->labels = rb_ary_new();
+    ser->values = Qnil;
+    ser->labels = Qnil;
     ser->minv = Qnil;
     ser->maxv = Qnil;
     ser->name = Qnil;
@@ -40,15 +65,372 @@ VALUE shoes_chart_series_alloc(VALUE klass) {
     ser->strokes = Qnil;
     ser->point_type = Qnil;
     ser->color = Qnil;
+    ser->plot = Qnil;
+    ser->data = NULL;
+    ser->buf = NULL;
+    ser->count = 0;
+    ser->capa = 0;
+    ser->ring = 0;
+    ser->head = 0;
+    ser->total = 0;
+    ser->lo = ser->hi = NAN;
+    ser->stale = 0;
+    ser->pyramid = NULL;
+    ser->blocks = 0;
+    ser->unindexed = 1;
+    ser->keys = NULL;
+    ser->nkeys = 0;
+    ser->keyfmt = NULL;
     return obj;
 }
 
+// turn an empty series into a streaming one holding the last n values
+void shoes_chart_series_ring(shoes_chart_series *self_t, long n) {
+    if (n < 2)
+        rb_raise(rb_eArgError, "chart_series: capacity: must be at least 2");
+    SHOE_REALLOC_N(self_t->buf, double, n * 2);
+    if (self_t->buf == NULL)
+        rb_raise(rb_eNoMemError, "chart_series: can't hold %ld values", n);
+    self_t->data = self_t->buf;
+    self_t->ring = self_t->capa = n;
+    self_t->count = self_t->head = self_t->total = 0;
+    self_t->lo = self_t->hi = NAN;
+}
+
+// make room for n values; anything new is missing until it is stored
+void shoes_chart_series_reserve(shoes_chart_series *self_t, long n) {
+    long i;
+    if (self_t->ring) {
+        if (n > self_t->ring)
+            rb_raise(rb_eArgError, "chart_series: a streaming series holds %ld values", self_t->ring);
+        return;
+    }
+    if (n > self_t->capa) {
+        long capa = max(n, self_t->capa * 2);
+        SHOE_REALLOC_N(self_t->buf, double, capa);
+        if (self_t->buf == NULL)
+            rb_raise(rb_eNoMemError, "chart_series: can't hold %ld values", n);
+        self_t->data = self_t->buf;
+        self_t->capa = capa;
+    }
+    for (i = self_t->count; i < n; i++)
+        self_t->data[i] = NAN;
+}
+
+static void shoes_chart_series_widen(shoes_chart_series *self_t, double v) {
+    if (isnan(v)) return;
+    if (isnan(self_t->lo) || v < self_t->lo) self_t->lo = v;
+    if (isnan(self_t->hi) || v > self_t->hi) self_t->hi = v;
+}
+
+// smallest and largest value present, rescanned only after an extreme
+// was overwritten or scrolled out
+static void shoes_chart_series_extent(shoes_chart_series *self_t) {
+    long i;
+    if (!self_t->stale) return;
+    self_t->lo = self_t->hi = NAN;
+    for (i = 0; i < self_t->count; i++)
+        shoes_chart_series_widen(self_t, self_t->data[i]);
+    self_t->stale = 0;
+}
+
+static void shoes_chart_series_forget(shoes_chart_series *self_t, double old) {
+    if (!isnan(old) && (old <= self_t->lo || old >= self_t->hi))
+        self_t->stale = 1;
+}
+
+// what's in view of a plot zoomed with autoscale: true
+static int shoes_chart_series_window(shoes_chart_series *self_t, double *lo, double *hi) {
+    shoes_plot *plot;
+    if (NIL_P(self_t->plot))
+        return 0;
+    Data_Get_Struct(self_t->plot, shoes_plot, plot);
+    if (!plot->autoscale)
+        return 0;
+    shoes_chart_series_range(self_t, plot->beg_idx, plot->end_idx, lo, hi, NULL);
+    return !isnan(*lo);
+}
+
+// axis range for the painters: the zoom window's when autoscaling,
+// min: and max: if given, else the data's
+double shoes_chart_series_scale_min(shoes_chart_series *self_t) {
+    double lo, hi;
+    if (shoes_chart_series_window(self_t, &lo, &hi))
+        return lo < hi ? lo : lo - 0.5;
+    if (!NIL_P(self_t->minv))
+        return NUM2DBL(self_t->minv);
+    shoes_chart_series_extent(self_t);
+    if (isnan(self_t->lo))
+        return 0.0;
+    return self_t->lo < self_t->hi ? self_t->lo : self_t->lo - 0.5;
+}
+
+double shoes_chart_series_scale_max(shoes_chart_series *self_t) {
+    double lo, hi;
+    if (shoes_chart_series_window(self_t, &lo, &hi))
+        return lo < hi ? hi : hi + 0.5;
+    if (!NIL_P(self_t->maxv))
+        return NUM2DBL(self_t->maxv);
+    shoes_chart_series_extent(self_t);
+    if (isnan(self_t->hi))
+        return 1.0;
+    return self_t->lo < self_t->hi ? self_t->hi : self_t->hi + 0.5;
+}
+
+static void shoes_chart_series_span(double *lo, double *hi, double l, double h) {
+    if (isnan(l)) return;
+    if (isnan(*lo) || l < *lo) *lo = l;
+    if (isnan(*hi) || h > *hi) *hi = h;
+}
+
+// a single value into lo, hi and the missing count
+static void shoes_chart_series_tally(double *lo, double *hi, double *nan, double v) {
+    if (isnan(v)) *nan += 1;
+    else shoes_chart_series_span(lo, hi, v, v);
+}
+
+// level 0 holds a lo, hi, missing triple per block; each level above pairs
+// up the one below, an odd block out is carried up alone
+static void shoes_chart_series_index(shoes_chart_series *self_t) {
+    long i, j, n, len, off, blocks = (self_t->count + SERIES_BLOCK - 1) / SERIES_BLOCK;
+    if (!self_t->unindexed)
+        return;
+    for (n = 0, len = blocks; len > 1; len = (len + 1) / 2)
+        n += len;
+    n += 1;
+    if (self_t->pyramid == NULL || blocks > self_t->blocks) {
+        SHOE_REALLOC_N(self_t->pyramid, double, n * 3);
+        if (self_t->pyramid == NULL)
+            rb_raise(rb_eNoMemError, "chart_series: can't index %ld values", self_t->count);
+    }
+    double *p = self_t->pyramid;
+    for (i = 0; i < blocks; i++) {
+        long end = min(self_t->count, (i + 1) * SERIES_BLOCK);
+        double *b = p + i * 3;
+        b[0] = b[1] = NAN;
+        b[2] = 0;
+        for (j = i * SERIES_BLOCK; j < end; j++)
+            shoes_chart_series_tally(&b[0], &b[1], &b[2], self_t->data[j]);
+    }
+    for (off = 0, len = blocks; len > 1; off += len, len = (len + 1) / 2) {
+        double *lvl = p + off * 3, *up = p + (off + len) * 3;
+        for (i = 0; i < len; i += 2) {
+            double *u = up + (i / 2) * 3, *l = lvl + i * 3;
+            u[0] = l[0];
+            u[1] = l[1];
+            u[2] = l[2];
+            if (i + 1 < len) {
+                shoes_chart_series_span(&u[0], &u[1], l[3], l[4]);
+                u[2] += l[5];
+            }
+        }
+    }
+    self_t->blocks = blocks;
+    self_t->unindexed = 0;
+}
+
+// lowest and highest value of data[beg] up to data[end - 1], NAN if all
+// of them are missing. If missing isn't NULL it gets how many are.
+void shoes_chart_series_range(shoes_chart_series *self_t, long beg, long end, double *lo, double *hi, long *missing) {
+    long i, bb, eb, off, len;
+    double nan = 0;
+    *lo = *hi = NAN;
+    beg = max(0, beg);
+    end = min(self_t->count, end);
+    bb = (beg + SERIES_BLOCK - 1) / SERIES_BLOCK;
+    eb = end / SERIES_BLOCK;
+    if (bb >= eb) {
+        for (i = beg; i < end; i++)
+            shoes_chart_series_tally(lo, hi, &nan, self_t->data[i]);
+        if (missing) *missing = (long)nan;
+        return;
+    }
+    // the ragged ends, then whole blocks from the top of the pyramid down
+    for (i = beg; i < bb * SERIES_BLOCK; i++)
+        shoes_chart_series_tally(lo, hi, &nan, self_t->data[i]);
+    for (i = eb * SERIES_BLOCK; i < end; i++)
+        shoes_chart_series_tally(lo, hi, &nan, self_t->data[i]);
+    shoes_chart_series_index(self_t);
+    double *p = self_t->pyramid;
+    for (off = 0, len = self_t->blocks; bb < eb; off += len, len = (len + 1) / 2) {
+        if (bb & 1) {
+            double *b = p + (off + bb) * 3;
+            shoes_chart_series_span(lo, hi, b[0], b[1]);
+            nan += b[2];
+            bb++;
+        }
+        if (eb & 1) {
+            double *b;
+            eb--;
+            b = p + (off + eb) * 3;
+            shoes_chart_series_span(lo, hi, b[0], b[1]);
+            nan += b[2];
+        }
+        bb /= 2;
+        eb /= 2;
+    }
+    if (missing) *missing = (long)nan;
+}
+
+// overwrite value i (0 is the oldest)
+void shoes_chart_series_store(shoes_chart_series *self_t, long i, double v) {
+    if (self_t->ring) {
+        long slot = (self_t->head + i) % self_t->ring;
+        shoes_chart_series_forget(self_t, self_t->buf[slot]);
+        self_t->buf[slot] = self_t->buf[slot + self_t->ring] = v;
+    } else {
+        shoes_chart_series_forget(self_t, self_t->data[i]);
+        self_t->data[i] = v;
+    }
+    self_t->unindexed = 1;
+    self_t->version++;
+    shoes_chart_series_widen(self_t, v);
+}
+
+// append; a full ring drops its oldest value
+void shoes_chart_series_add(shoes_chart_series *self_t, double v) {
+    if (self_t->ring == 0) {
+        shoes_chart_series_reserve(self_t, self_t->count + 1);
+        self_t->data[self_t->count++] = v;
+    } else {
+        long slot;
+        if (self_t->count < self_t->ring) {
+            slot = self_t->count++;
+        } else {
+            slot = self_t->head;
+            shoes_chart_series_forget(self_t, self_t->buf[slot]);
+            self_t->head = (self_t->head + 1) % self_t->ring;
+        }
+        self_t->buf[slot] = self_t->buf[slot + self_t->ring] = v;
+        self_t->data = self_t->buf + self_t->head;
+    }
+    self_t->total++;
+    self_t->unindexed = 1;
+    self_t->version++;
+    shoes_chart_series_widen(self_t, v);
+}
+
+// Array of numbers (nil for missing) or a String packed with native
+// doubles, e.g. [1.5, 2.0].pack("d*")
+void shoes_chart_series_load(shoes_chart_series *self_t, VALUE src) {
+    long i, n;
+    if (self_t->ring) {
+        // start over, keeping what fits
+        self_t->count = self_t->head = self_t->total = 0;
+        self_t->data = self_t->buf;
+        self_t->lo = self_t->hi = NAN;
+        self_t->stale = 0;
+        shoes_chart_series_add_many(self_t, src);
+        return;
+    }
+    if (TYPE(src) == T_ARRAY) {
+        n = RARRAY_LEN(src);
+        shoes_chart_series_reserve(self_t, n);
+        for (i = 0; i < n; i++) {
+            VALUE v = rb_ary_entry(src, i);
+            self_t->data[i] = NIL_P(v) ? NAN : NUM2DBL(v);
+        }
+    } else if (TYPE(src) == T_STRING) {
+        if (RSTRING_LEN(src) % sizeof(double))
+            rb_raise(rb_eArgError, "chart_series: packed values must be a whole number of doubles");
+        n = RSTRING_LEN(src) / sizeof(double);
+        shoes_chart_series_reserve(self_t, n);
+        SHOE_MEMCPY(self_t->data, RSTRING_PTR(src), double, n);
+    } else {
+        rb_raise(rb_eArgError, "chart_series: values must be an Array or a packed String");
+    }
+    self_t->count = self_t->total = n;
+    self_t->stale = 1;
+    self_t->unindexed = 1;
+    self_t->version++;
+}
+
+// Array or packed String, appended one at a time
+void shoes_chart_series_add_many(shoes_chart_series *self_t, VALUE src) {
+    long i, n;
+    if (TYPE(src) == T_ARRAY) {
+        n = RARRAY_LEN(src);
+        for (i = 0; i < n; i++) {
+            VALUE v = rb_ary_entry(src, i);
+            shoes_chart_series_add(self_t, NIL_P(v) ? NAN : NUM2DBL(v));
+        }
+    } else if (TYPE(src) == T_STRING) {
+        double d;
+        if (RSTRING_LEN(src) % sizeof(double))
+            rb_raise(rb_eArgError, "chart_series: packed values must be a whole number of doubles");
+        n = RSTRING_LEN(src) / sizeof(double);
+        // a ring only keeps the tail anyway
+        i = (self_t->ring && n > self_t->ring) ? n - self_t->ring : 0;
+        self_t->total += i;
+        for (; i < n; i++) {
+            SHOE_MEMCPY(&d, RSTRING_PTR(src) + i * sizeof(double), double, 1);
+            shoes_chart_series_add(self_t, d);
+        }
+    } else {
+        rb_raise(rb_eArgError, "chart_series: values must be an Array or a packed String");
+    }
+}
+
+// pick up changes made to the Ruby array since it was loaded (redraw_to)
+void shoes_chart_series_sync(shoes_chart_series *self_t) {
+    if (!NIL_P(self_t->values))
+        shoes_chart_series_load(self_t, self_t->values);
+}
+
+// labels from now on come from keys (taken over, n of them): seconds since
+// 1970 (UTC) put through the strftime format fmt, or plain numbers if fmt
+// is NULL. A date that isn't there makes a nil label.
+void shoes_chart_series_keys(shoes_chart_series *self_t, double *keys, long n, const char *fmt) {
+    if (self_t->keys) free(self_t->keys);
+    if (self_t->keyfmt) free(self_t->keyfmt);
+    self_t->keys = keys;
+    self_t->nkeys = n;
+    self_t->keyfmt = fmt != NULL ? strdup(fmt) : NULL;
+}
+
+// label for observation i: NULL if it's nil, buf when made up
+char *shoes_chart_series_label(shoes_chart_series *self_t, long i, char *buf, int bufsz) {
+    if (NIL_P(self_t->labels)) {
+        if (self_t->keys != NULL && i >= 0 && i < self_t->nkeys) {
+            double k = self_t->keys[i];
+            if (self_t->keyfmt != NULL) {
+                time_t t = (time_t)k;
+                struct tm *tm = isnan(k) ? NULL : gmtime(&t);
+                if (tm == NULL || strftime(buf, bufsz, self_t->keyfmt, tm) == 0)
+                    return NULL;
+                return buf;
+            }
+            if (!isnan(k)) {
+                snprintf(buf, bufsz, "%.15g", k);
+                return buf;
+            }
+        }
+        snprintf(buf, bufsz, "%ld", self_t->total - self_t->count + i + 1);
+        return buf;
+    }
+    VALUE rbstr = rb_ary_entry(self_t->labels, i);
+    if (TYPE(rbstr) != T_STRING)
+        return NULL;
+    return RSTRING_PTR(rbstr);
+}
+
+static VALUE shoes_chart_series_label_value(shoes_chart_series *self_t, long i) {
+    char t[64], *s;
+    if (!NIL_P(self_t->labels))
+        return rb_ary_entry(self_t->labels, i);
+    s = shoes_chart_series_label(self_t, i, t, sizeof(t));
+    return s != NULL ? rb_str_new2(s) : Qnil;
+}
+
 // This is called from plot.c shoes_plot_add()
 void shoes_chart_series_Cinit(shoes_chart_series *self_t, VALUE rbvals, VALUE rblabels,
                               VALUE rbmax, VALUE rbmin, VALUE rbname, VALUE rbdesc, VALUE  rbstroke,
                               VALUE rbpoint_type, VALUE color_wrapped) {
-    self_t->values = rbvals;
-    self_t->labels = rblabels;
+    if (!NIL_P(rbvals))
+        shoes_chart_series_load(self_t, rbvals);
+    // a ring isn't reloaded from an array, and its labels number the samples
+    self_t->values = (TYPE(rbvals) == T_ARRAY && !self_t->ring) ? rbvals : Qnil;
+    self_t->labels = self_t->ring ? Qnil : rblabels;
     self_t->maxv = rbmax;
     self_t->minv = rbmin;
     self_t->name = rbname;
@@ -66,8 +448,9 @@ void shoes_chart_series_Cinit(shoes_chart_series *self_t, VALUE rbvals, VALUE rb
 VALUE shoes_chart_series_new(int argc, VALUE *argv, VALUE self) {
     shoes_chart_series *self_t;
     VALUE newseries = Qnil;
-    VALUE rbsz, rbvals, rblabels, rbmin, rbmax, rbname, rbdesc, rbcolor;
+    VALUE rbvals, rblabels, rbmin, rbmax, rbname, rbdesc, rbcolor;
     VALUE rbstroke, rbpoint, rbpoint_type  = Qnil;
+    VALUE rbstreaming, rbcapacity;
     VALUE color_wrapped = Qnil;
     rb_arg_list args;
     switch (rb_parse_args(argc, argv, "h", &args)) {
@@ -85,27 +468,26 @@ VALUE shoes_chart_series_new(int argc, VALUE *argv, VALUE self) {
         rbcolor  = shoes_hash_get(newseries, rb_intern("color"));
         rbstroke = shoes_hash_get(newseries, rb_intern("strokewidth"));
         rbpoint = shoes_hash_get(newseries, rb_intern("points"));
-
-        if ( NIL_P(rbvals) || TYPE(rbvals) != T_ARRAY ) {
-            rb_raise(rb_eArgError, "plot.add: Missing an Array of values");
-        }
-        int valsz = RARRAY_LEN(rbvals);
-        rbsz = INT2NUM(valsz);
-        if (NIL_P(rbmin) || NIL_P(rbmax)) {
-            rb_raise(rb_eArgError, "plot.add: Missing min: or max: option");
-        }
-        if ( NIL_P(rblabels)) {
-            // we can fake it - poorly - TODO: call a user given proc ?
-            int l = NUM2INT(rbsz);
-            int i;
-            rblabels = rb_ary_new2(l);
-            for (i = 0; i < l; i++) {
-                char t[8];
-                sprintf(t, "%i", i+1);
-                VALUE foostr = rb_str_new2(t);
-                rb_ary_store(rblabels, i, foostr);
+        rbstreaming = shoes_hash_get(newseries, rb_intern("streaming"));
+        rbcapacity = shoes_hash_get(newseries, rb_intern("capacity"));
+
+        if (RTEST(rbstreaming)) {
+            // values: are optional, min: and max: default to the data's range
+            if (NIL_P(rbcapacity))
+                rbcapacity = INT2NUM(1000);
+            if (!NIL_P(rbvals) && TYPE(rbvals) != T_ARRAY && TYPE(rbvals) != T_STRING)
+                rb_raise(rb_eArgError, "plot.add: values: must be an Array or a packed String");
+        } else {
+            if ( NIL_P(rbvals) || (TYPE(rbvals) != T_ARRAY && TYPE(rbvals) != T_STRING)) {
+                rb_raise(rb_eArgError, "plot.add: Missing an Array of values");
+            }
+            if (NIL_P(rbmin) || NIL_P(rbmax)) {
+                rb_raise(rb_eArgError, "plot.add: Missing min: or max: option");
             }
         }
+        // no labels: are faked ("1", "2", ...) when drawn - TODO: call a user given proc ?
+        if (!NIL_P(rblabels) && TYPE(rblabels) != T_ARRAY)
+            rb_raise(rb_eArgError, "plot.add: labels: must be an Array");
 
         if (NIL_P(rbname))
             rb_raise(rb_eArgError, "plot.add missing name:");
@@ -166,6 +548,8 @@ VALUE shoes_chart_series_new(int argc, VALUE *argv, VALUE self) {
     }
     VALUE obj = shoes_chart_series_alloc(cChartSeries);
     Data_Get_Struct(obj, shoes_chart_series, self_t);
+    if (RTEST(rbstreaming))
+        shoes_chart_series_ring(self_t, NUM2LONG(rbcapacity));
     shoes_chart_series_Cinit(self_t, rbvals, rblabels, rbmax, rbmin, rbname, rbdesc,
                              rbstroke, rbpoint_type, color_wrapped);
     return obj;
@@ -236,15 +620,83 @@ VALUE shoes_plot_parse_column_settings(VALUE opts) {
 }
 
 // Simple getter/setter  methods
+
+// The array is built on first request and kept, so appending to it and
+// calling plot.redraw_to still works.
 VALUE shoes_chart_series_values(VALUE self) {
     shoes_chart_series *cs;
     Data_Get_Struct(self, shoes_chart_series, cs);
+    if (NIL_P(cs->values)) {
+        long i;
+        VALUE ary = rb_ary_new_capa(cs->count);
+        for (i = 0; i < cs->count; i++)
+            rb_ary_store(ary, i, isnan(cs->data[i]) ? Qnil : DBL2NUM(cs->data[i]));
+        if (cs->ring)     // a snapshot, it scrolls on without it
+            return ary;
+        cs->values = ary;
+    }
     return cs->values;
 }
 
+// replace all the values at once - an Array or a String of packed doubles
+VALUE shoes_chart_series_values_set(VALUE self, VALUE vals) {
+    shoes_chart_series *cs;
+    Data_Get_Struct(self, shoes_chart_series, cs);
+    shoes_chart_series_load(cs, vals);
+    cs->values = (TYPE(vals) == T_ARRAY && !cs->ring) ? vals : Qnil;
+    if (!NIL_P(cs->plot))
+        shoes_plot_series_reloaded(cs->plot);
+    return vals;
+}
+
+// append one value (nil for missing). On a streaming series the oldest
+// value scrolls out once it is full.
+VALUE shoes_chart_series_push(VALUE self, VALUE val) {
+    shoes_chart_series *cs;
+    Data_Get_Struct(self, shoes_chart_series, cs);
+    long before = cs->count;
+    shoes_chart_series_add(cs, NIL_P(val) ? NAN : NUM2DBL(val));
+    if (!NIL_P(cs->values))
+        rb_ary_push(cs->values, val);
+    if (!NIL_P(cs->plot))
+        shoes_plot_series_grew(cs->plot, before, cs->count);
+    return self;
+}
+
+// append an Array or a String of packed doubles
+VALUE shoes_chart_series_push_many(VALUE self, VALUE vals) {
+    shoes_chart_series *cs;
+    Data_Get_Struct(self, shoes_chart_series, cs);
+    long before = cs->count;
+    shoes_chart_series_add_many(cs, vals);
+    if (!NIL_P(cs->values)) {
+        // keep the source array in step for redraw_to
+        long i;
+        for (i = RARRAY_LEN(cs->values); i < cs->count; i++)
+            rb_ary_push(cs->values, isnan(cs->data[i]) ? Qnil : DBL2NUM(cs->data[i]));
+    }
+    if (!NIL_P(cs->plot))
+        shoes_plot_series_grew(cs->plot, before, cs->count);
+    return self;
+}
+
+VALUE shoes_chart_series_size(VALUE self) {
+    shoes_chart_series *cs;
+    Data_Get_Struct(self, shoes_chart_series, cs);
+    return LONG2NUM(cs->count);
+}
+
+// made up labels aren't kept, there is nothing to save by keeping them
 VALUE shoes_chart_series_labels(VALUE self) {
     shoes_chart_series *cs;
     Data_Get_Struct(self, shoes_chart_series, cs);
+    if (NIL_P(cs->labels)) {
+        long i;
+        VALUE ary = rb_ary_new_capa(cs->count);
+        for (i = 0; i < cs->count; i++)
+            rb_ary_store(ary, i, shoes_chart_series_label_value(cs, i));
+        return ary;
+    }
     return cs->labels;
 }
 
@@ -290,6 +742,8 @@ VALUE shoes_chart_series_desc_set(VALUE self, VALUE str) {
     shoes_chart_series *cs;
     Data_Get_Struct(self, shoes_chart_series, cs);
     cs->desc = str;
+    if (!NIL_P(cs->plot))
+        shoes_plot_static_changed(cs->plot);
     return cs->desc;
 }
 VALUE shoes_chart_series_color(VALUE self) {
@@ -302,6 +756,8 @@ VALUE shoes_chart_series_color_set(VALUE self, VALUE clr) {
     shoes_chart_series *cs;
     Data_Get_Struct(self, shoes_chart_series, cs);
     cs->color = clr;
+    if (!NIL_P(cs->plot))
+        shoes_plot_static_changed(cs->plot);   // legend
     return cs->color;
 }
 
@@ -343,9 +799,15 @@ VALUE shoes_chart_series_get(VALUE self, VALUE idx) {
     VALUE nary = Qnil;
     if (TYPE(idx) == T_FIXNUM) {
         nary = rb_ary_new_capa(2);
-        long i  = NUM2INT(idx);
-        rb_ary_store(nary, 0, rb_ary_entry(cs->labels, i));
-        rb_ary_store(nary, 1, rb_ary_entry(cs->values, i));
+        long i  = NUM2LONG(idx);
+        if (i < 0) i += cs->count;
+        if (i < 0 || i >= cs->count) {
+            rb_ary_store(nary, 0, Qnil);
+            rb_ary_store(nary, 1, Qnil);
+        } else {
+            rb_ary_store(nary, 0, shoes_chart_series_label_value(cs, i));
+            rb_ary_store(nary, 1, isnan(cs->data[i]) ? Qnil : DBL2NUM(cs->data[i]));
+        }
     }
     return nary;
 }
@@ -355,9 +817,29 @@ VALUE shoes_chart_series_set(VALUE self, VALUE idx, VALUE ary) {
     shoes_chart_series *cs;
     Data_Get_Struct(self, shoes_chart_series, cs);
     if ((TYPE(idx) == T_FIXNUM) && (TYPE(ary) == T_ARRAY) && (RARRAY_LEN(ary) == 2)) {
-        long i  = NUM2INT(idx);
+        long i  = NUM2LONG(idx);
+        VALUE v = rb_ary_entry(ary, 1);
+        if (i < 0)
+            rb_raise(rb_eArgError, "chart_series.set index is negative");
+        if (cs->ring) {
+            // no labels to keep, the samples are numbered
+            if (i >= cs->count)
+                rb_raise(rb_eArgError, "chart_series.set index is past the end, use push");
+            shoes_chart_series_store(cs, i, NIL_P(v) ? NAN : NUM2DBL(v));
+            return Qtrue;
+        }
+        if (NIL_P(cs->labels))   // from now on they are real
+            cs->labels = shoes_chart_series_labels(self);
+        if (i >= cs->count) {
+            shoes_chart_series_reserve(cs, i + 1);
+            cs->count = cs->total = i + 1;
+        }
+        shoes_chart_series_store(cs, i, NIL_P(v) ? NAN : NUM2DBL(v));
         rb_ary_store(cs->labels, i, rb_ary_entry(ary, 0));
-        rb_ary_store(cs->values, i, rb_ary_entry(ary, 1));
+        if (!NIL_P(cs->plot))
+            shoes_plot_static_changed(cs->plot);
+        if (!NIL_P(cs->values))
+            rb_ary_store(cs->values, i, v);
     } else
         rb_raise(rb_eArgError, "bad arguments to chart_series.set");
     return Qtrue;
@@ -11,7 +11,7 @@
  */
 
 // some forward declares for functions in this file
-void shoes_plot_draw_everything(cairo_t *, shoes_place *, shoes_plot *);
+void shoes_plot_draw_everything(cairo_t *, shoes_place *, shoes_plot *, int);
 
 // alloc some memory for a shoes_plot; We'll protect it's Ruby VALUES from gc
 // out of caution. fingers crossed.
@@ -33,6 +33,9 @@ void shoes_plot_free(shoes_plot *self_t) {
     pango_font_description_free (self_t->legend_pfd);
     pango_font_description_free (self_t->label_pfd);
     shoes_transform_release(self_t->st);
+    if (self_t->static_layer)
+        cairo_surface_destroy(self_t->static_layer);
+    shoes_plot_near_free(self_t);
     if (self_t->c_things) {
         switch (self_t-> chart_type) {
             case PIE_CHART:
@@ -59,11 +62,17 @@ VALUE shoes_plot_alloc(VALUE klass) {
     plot->x_ticks = 8;
     plot->y_ticks = 6;
     plot->missing = MISSING_SKIP;
+    plot->density = PLOT_DENSITY_DEFAULT;
+    plot->autoscale = 0;
     plot->chart_type = LINE_CHART;
     plot->background = Qnil;
     plot->default_colors = rb_ary_new();
     shoes_plot_util_default_colors(plot);
     plot->c_things = NULL;
+    plot->layer = PLOT_LAYER_ALL;
+    plot->static_layer = NULL;
+    plot->static_dirty = 1;
+    plot->near_grid = NULL;
     return obj;
 }
 
@@ -74,6 +83,7 @@ VALUE shoes_plot_new(int argc, VALUE *argv, VALUE parent) {
     VALUE missing = Qnil, chart_type = Qnil, background = Qnil;
     VALUE pie_pct = Qnil, colors = Qnil, radar_opts = Qnil;
     VALUE rbcol_settings = Qnil, grid_lines = Qnil, radar_lbl_mult = Qnil;
+    VALUE density = Qnil;
     shoes_canvas *canvas;
     Data_Get_Struct(parent, shoes_canvas, canvas);
 
@@ -102,6 +112,7 @@ VALUE shoes_plot_new(int argc, VALUE *argv, VALUE parent) {
         radar_opts = shoes_hash_get(attr, rb_intern("column_settings"));
         grid_lines = shoes_hash_get(attr, rb_intern("grid_lines"));
         radar_lbl_mult = shoes_hash_get(attr, rb_intern("label_radius"));
+        density = shoes_hash_get(attr, rb_intern("density"));
         // there may be many other things in that hash :-)
     } else {
         rb_raise(rb_eArgError, "Plot: missing mandatory {options}");
@@ -236,6 +247,17 @@ VALUE shoes_plot_new(int argc, VALUE *argv, VALUE parent) {
         if (! NIL_P(pie_pct))
             self_t->missing = RTEST(pie_pct);
     }
+    // scatter only: true always bins, false never, a number is the threshold
+    if (density == Qtrue)
+        self_t->density = 1;
+    else if (density == Qfalse)
+        self_t->density = 0;
+    else if (!NIL_P(density)) {
+        if (TYPE(density) != T_FIXNUM || NUM2LONG(density) < 0)
+            rb_raise(rb_eArgError, "Plot: density: is not t/f or a positive integer");
+        self_t->density = NUM2LONG(density);
+    }
+
     if (!NIL_P(caption)) {
         self_t->caption = caption;
     } else {
@@ -318,7 +340,7 @@ VALUE shoes_plot_draw(VALUE self, VALUE c, VALUE actual) {
     shoes_place_decide(&place, c, self_t->attr, self_t->place.w, self_t->place.h, rel, REL_COORDS(rel) == REL_CANVAS);
 
     if (RTEST(actual)) {
-        shoes_plot_draw_everything(CCR(canvas), &place, self_t);
+        shoes_plot_draw_everything(CCR(canvas), &place, self_t, 1);
         //self_t->place = place;
     }
 
@@ -335,13 +357,7 @@ VALUE shoes_plot_draw(VALUE self, VALUE c, VALUE actual) {
     return self;
 }
 
-// this is called by both shoes_plot_draw (general Shoes refresh events)
-// and by shoes_plot_save_as. The real code is in plot_util.c and the
-// other plot_xxxx.c files
-void shoes_plot_draw_everything(cairo_t *cr, shoes_place *place, shoes_plot *self_t) {
-
-    shoes_apply_transformation(cr, self_t->st, place, 0);  // cairo_save(cr) is inside
-    cairo_translate(cr, place->ix + place->dx, place->iy + place->dy);
+static void shoes_plot_draw_chart(cairo_t *cr, shoes_place *place, shoes_plot *self_t) {
     switch (self_t->chart_type) {
         case TIMESERIES_CHART:
         case LINE_CHART:
@@ -359,11 +375,86 @@ void shoes_plot_draw_everything(cairo_t *cr, shoes_place *place, shoes_plot *sel
         case RADAR_CHART:
             shoes_plot_radar_draw(cr, place, self_t);
     }
+}
+
+// Everything the static layer depends on that changes without anyone
+// telling us: size, the visible range, the axis scales (streaming series
+// rescale themselves) and where made up labels start counting.
+static void shoes_plot_static_key(shoes_plot *self_t, shoes_place *place, double *key) {
+    int i, n = 0;
+    SHOE_MEMZERO(key, double, 20);
+    key[n++] = place->w;
+    key[n++] = place->h;
+    key[n++] = place->dx;
+    key[n++] = place->dy;
+    key[n++] = self_t->beg_idx;
+    key[n++] = self_t->end_idx;
+    key[n++] = self_t->seriescnt;
+    for (i = 0; i < self_t->seriescnt && i < 6; i++) {
+        shoes_chart_series *cs;
+        Data_Get_Struct(rb_ary_entry(self_t->series, i), shoes_chart_series, cs);
+        if (i == 0)
+            key[n++] = cs->total - cs->count;
+        key[n++] = shoes_chart_series_scale_min(cs);
+        key[n++] = shoes_chart_series_scale_max(cs);
+    }
+}
+
+// draws the title, caption, axes, ticks, labels and legend into their
+// own surface unless the one we have still fits
+static void shoes_plot_draw_static(cairo_t *cr, shoes_place *place, shoes_plot *self_t) {
+    double key[20];
+    cairo_t *lcr;
+    shoes_plot_static_key(self_t, place, key);
+    if (self_t->static_layer != NULL && !self_t->static_dirty &&
+            memcmp(key, self_t->static_key, sizeof(key)) == 0)
+        return;
+    if (self_t->static_layer != NULL)
+        cairo_surface_destroy(self_t->static_layer);
+    self_t->static_layer = cairo_surface_create_similar(cairo_get_target(cr),
+                           CAIRO_CONTENT_COLOR_ALPHA, place->w, place->h);
+    lcr = cairo_create(self_t->static_layer);
+    self_t->layer = PLOT_LAYER_STATIC;
+    shoes_plot_draw_chart(lcr, place, self_t);
+    self_t->layer = PLOT_LAYER_ALL;
+    cairo_destroy(lcr);
+    SHOE_MEMCPY(self_t->static_key, key, double, 20);
+    self_t->static_dirty = 0;
+}
+
+// this is called by both shoes_plot_draw (general Shoes refresh events)
+// and by shoes_plot_save_as. The real code is in plot_util.c and the
+// other plot_xxxx.c files. Screen paints reuse the static layer as long
+// as nothing but a translation is in effect; exports draw it all.
+void shoes_plot_draw_everything(cairo_t *cr, shoes_place *place, shoes_plot *self_t, int cached) {
+    cairo_matrix_t m;
+
+    shoes_apply_transformation(cr, self_t->st, place, 0);  // cairo_save(cr) is inside
+    cairo_translate(cr, place->ix + place->dx, place->iy + place->dy);
+    cairo_get_matrix(cr, &m);
+    if (cached && place->w > 0 && place->h > 0 &&
+            m.xx == 1.0 && m.yy == 1.0 && m.xy == 0.0 && m.yx == 0.0) {
+        shoes_plot_draw_static(cr, place, self_t);
+        cairo_set_source_surface(cr, self_t->static_layer, 0, 0);
+        cairo_paint(cr);
+        self_t->layer = PLOT_LAYER_DATA;
+        shoes_plot_draw_chart(cr, place, self_t);
+        self_t->layer = PLOT_LAYER_ALL;
+    } else {
+        shoes_plot_draw_chart(cr, place, self_t);
+    }
     // drawing finished
     shoes_undo_transformation(cr, self_t->st, place, 0); // does cairo_restore(cr)
     self_t->place = *place;
 }
 
+// a series changed something only the static layer shows (desc, color, labels)
+void shoes_plot_static_changed(VALUE self) {
+    shoes_plot *self_t;
+    Data_Get_Struct(self, shoes_plot, self_t);
+    self_t->static_dirty = 1;
+}
+
 VALUE shoes_plot_add(VALUE self, VALUE theseries) {
     shoes_plot *self_t;
     //VALUE rbsz, rbvals, rbobs, rbmin, rbmax, rbshname, rblgname, rbcolor;
@@ -383,10 +474,13 @@ VALUE shoes_plot_add(VALUE self, VALUE theseries) {
     if (rb_obj_is_kind_of(newseries, cChartSeries)) {
         shoes_chart_series *cs;
         Data_Get_Struct(newseries, shoes_chart_series, cs);
-        int nobs = RARRAY_LEN(cs->values);
+        int nobs = cs->count;
         self_t->beg_idx = 0;
         self_t->end_idx = nobs;
+        cs->plot = self;
         self_t->seriescnt++;
+        self_t->static_dirty = 1;
+        shoes_plot_near_free(self_t);
         rb_ary_store(self_t->series, i, newseries);
         // radar & pie chart types need to pre-compute some geometery and store it
         // in their own structs.
@@ -407,6 +501,48 @@ VALUE shoes_plot_add(VALUE self, VALUE theseries) {
     return self;
 }
 
+// series.values= replaced the data of one of our series, show all of it
+void shoes_plot_series_reloaded(VALUE self) {
+    shoes_plot *self_t;
+    Data_Get_Struct(self, shoes_plot, self_t);
+    if (self_t->seriescnt < 1)
+        return;
+    shoes_chart_series *cs;
+    Data_Get_Struct(rb_ary_entry(self_t->series, 0), shoes_chart_series, cs);
+    self_t->beg_idx = 0;
+    self_t->end_idx = cs->count;
+    self_t->static_dirty = 1;
+    if (self_t->chart_type == PIE_CHART) {
+        shoes_plot_pie_dealloc(self_t);
+        shoes_plot_pie_init(self_t);
+    }
+    shoes_canvas_repaint_all(self_t->parent);
+}
+
+// push/push_many added values to one of our series. Follow them if the
+// view was showing the newest value. Nothing moves but this plot, so
+// only its own rectangle is repainted - no layout of the whole app.
+void shoes_plot_series_grew(VALUE self, long before, long after) {
+    shoes_plot *self_t;
+    Data_Get_Struct(self, shoes_plot, self_t);
+    if (self_t->end_idx >= before)
+        self_t->end_idx = after;
+    if (self_t->chart_type == PIE_CHART) {
+        // the value labels around the pie changed
+        shoes_plot_pie_dealloc(self_t);
+        shoes_plot_pie_init(self_t);
+        self_t->static_dirty = 1;
+    }
+    if (self_t->place.iw <= 0 || self_t->place.ih <= 0) {
+        shoes_canvas_repaint_all(self_t->parent);   // never drawn yet
+        return;
+    }
+    shoes_canvas *canvas;
+    Data_Get_Struct(self_t->parent, shoes_canvas, canvas);
+    shoes_native_slot_paint_rect(canvas->slot, self_t->place.ix + self_t->place.dx,
+                                 self_t->place.iy + self_t->place.dy, self_t->place.iw, self_t->place.ih);
+}
+
 VALUE shoes_plot_delete(VALUE self, VALUE series) {
     shoes_plot *self_t;
     Data_Get_Struct(self, shoes_plot, self_t);
@@ -415,10 +551,17 @@ VALUE shoes_plot_delete(VALUE self, VALUE series) {
     int idx = NUM2INT(series);
     if (! (idx >= 0 && idx <= self_t->seriescnt))
         rb_raise(rb_eArgError, "plot.delete arg is out of range");
-    rb_ary_delete_at(self_t->series, idx);
+    VALUE rbser = rb_ary_delete_at(self_t->series, idx);
+    if (rb_obj_is_kind_of(rbser, cChartSeries)) {
+        shoes_chart_series *cs;
+        Data_Get_Struct(rbser, shoes_chart_series, cs);
+        if (cs->plot == self) cs->plot = Qnil;
+    }
     if (self_t->chart_type == PIE_CHART)
         shoes_plot_pie_dealloc(self_t);
     self_t->seriescnt--;
+    self_t->static_dirty = 1;
+    shoes_plot_near_free(self_t);
     shoes_canvas_repaint_all(self_t->parent);
     return Qtrue;
 }
@@ -435,6 +578,14 @@ VALUE shoes_plot_redraw_to(VALUE self, VALUE to_here) {
         rb_raise(rb_eArgError, "plot.redraw_to arg is not an integer");
     int idx = NUM2INT(to_here);
     self_t->end_idx = idx;
+    // the script may have appended to the arrays it gave us, labels too
+    self_t->static_dirty = 1;
+    int i;
+    for (i = 0; i < self_t->seriescnt; i++) {
+        shoes_chart_series *cs;
+        Data_Get_Struct(rb_ary_entry(self_t->series, i), shoes_chart_series, cs);
+        shoes_chart_series_sync(cs);
+    }
 
     shoes_canvas_repaint_all(self_t->parent);
     //printf("shoes_plot_redraw_to(%i) called\n", idx);
@@ -462,9 +613,13 @@ VALUE shoes_plot_find_name(VALUE self, VALUE name) {
     return Qnil; // when nothing matches
 }
 
-VALUE shoes_plot_zoom(VALUE self, VALUE beg, VALUE end) {
+// zoom(first, last, autoscale: true) also fits the vertical scale to the
+// values in view, see shoes_chart_series_range()
+VALUE shoes_plot_zoom(int argc, VALUE *argv, VALUE self) {
     shoes_plot *self_t;
+    VALUE beg, end, opts = Qnil;
     Data_Get_Struct(self, shoes_plot, self_t);
+    rb_scan_args(argc, argv, "21", &beg, &end, &opts);
     // restrict to timeseries chart
     if (self_t->chart_type != TIMESERIES_CHART)
         return Qnil;
@@ -474,7 +629,7 @@ VALUE shoes_plot_zoom(VALUE self, VALUE beg, VALUE end) {
     VALUE rbser = rb_ary_entry(self_t->series, 0);
     shoes_chart_series *cs;
     Data_Get_Struct(rbser, shoes_chart_series, cs);
-    int maxe = RARRAY_LEN(cs->values);
+    int maxe = cs->count;
     int b = NUM2INT(beg);
     int e = NUM2INT(end);
     int nb = max(0, b);
@@ -486,6 +641,31 @@ VALUE shoes_plot_zoom(VALUE self, VALUE beg, VALUE end) {
     //printf("zoom to %i -- %i\n", nb, ne);
     self_t->beg_idx = nb;
     self_t->end_idx = ne;
+    self_t->autoscale = (TYPE(opts) == T_HASH) && RTEST(shoes_hash_get(opts, rb_intern("autoscale")));
+    shoes_canvas_repaint_all(self_t->parent);
+    return Qtrue;
+}
+
+// slide the zoomed window n values later (earlier if negative), stopping
+// at either end of the data. Autoscaling carries on if zoom asked for it.
+VALUE shoes_plot_pan(VALUE self, VALUE by) {
+    shoes_plot *self_t;
+    Data_Get_Struct(self, shoes_plot, self_t);
+    if (self_t->chart_type != TIMESERIES_CHART)
+        return Qnil;
+    if (self_t->seriescnt < 1)
+        return Qnil;
+    if (TYPE(by) != T_FIXNUM)
+        rb_raise(rb_eArgError, "plot.pan arg is not an integer");
+    shoes_chart_series *cs;
+    Data_Get_Struct(rb_ary_entry(self_t->series, 0), shoes_chart_series, cs);
+    int width = self_t->end_idx - self_t->beg_idx;
+    int nb = self_t->beg_idx + NUM2INT(by);
+    nb = max(0, min(nb, (int)cs->count - width));
+    if (nb == self_t->beg_idx)
+        return Qfalse;
+    self_t->beg_idx = nb;
+    self_t->end_idx = nb + width;
     shoes_canvas_repaint_all(self_t->parent);
     return Qtrue;
 }
@@ -584,7 +764,7 @@ cairo_surface_t *build_surface(VALUE self, double scale, int *result, char *file
     if (scale != 1.0) cairo_scale(cr, scale, scale);
     cairo_translate(cr, -(place.ix + place.dx), -(place.iy + place.dy));
 
-    shoes_plot_draw_everything(cr, &self_t->place, self_t);
+    shoes_plot_draw_everything(cr, &self_t->place, self_t, 0);
     if (format != NULL) cairo_show_page(cr);
     cairo_destroy(cr);
 
@@ -675,7 +855,7 @@ VALUE shoes_plot_remove(VALUE self) {
  * this attempts to compute the values/xobs index nearest the x pixel
  * from a mouse click.  First get a % of x between width
  * use that to pick between beg_idx, end_idx and return that.
- *
+ * plot.near(x, y) in plot_near.c does better, for every chart type.
  */
 VALUE shoes_plot_near(VALUE self, VALUE xpos) {
     shoes_plot *self_t;
@@ -686,11 +866,10 @@ VALUE shoes_plot_near(VALUE self, VALUE xpos) {
     right = self_t->graph_w;
     int newx = x - (self_t->place.ix + self_t->place.dx + left);
     int wid = right - left;
-    double rpos = newx  / wid;
+    double rpos = newx / (double) wid;
     int rng = (self_t->end_idx - self_t->beg_idx);
     int idx = floorl(rpos * rng);
-    printf("shoes_plot_near: %i newx: %i rpos: %f here: %i\n", x,newx,rpos,idx);
-    return INT2NUM(idx);
+    return INT2NUM(self_t->beg_idx + max(0, min(rng - 1, idx)));
 }
 
 // define our own inside function so we can offset our own margins
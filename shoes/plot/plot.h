@@ -66,6 +66,17 @@ enum {
     RADAR_EXTRA,
 };
 
+// Which parts of a chart a paint draws (plot->layer). Titles, axes, ticks,
+// labels and legends are the static layer and are cached in a surface,
+// the data is drawn over it every time.
+enum {
+    PLOT_LAYER_STATIC = 1,
+    PLOT_LAYER_DATA = 2,
+    PLOT_LAYER_ALL = 3
+};
+#define PLOT_STATIC(p) ((p)->layer & PLOT_LAYER_STATIC)
+#define PLOT_DATA(p)   ((p)->layer & PLOT_LAYER_DATA)
+
 // quadrant (pie, radar)
 enum {
     QUAD_ONE,
@@ -124,6 +135,9 @@ typedef struct {
     PangoLayout **layouts;  // array
 } radar_chart_t;
 
+// scatter charts switch to a density heatmap above this many points
+#define PLOT_DENSITY_DEFAULT 100000
+
 typedef cairo_public cairo_surface_t * (cairo_surface_function_t) (const char *filename, double width, double height);
 
 extern void shoes_plot_line_draw(cairo_t *, shoes_place *, shoes_plot *);
@@ -138,6 +152,22 @@ extern void shoes_plot_radar_draw(cairo_t *, shoes_place *, shoes_plot *);
 extern void shoes_chart_series_Cinit(shoes_chart_series *, VALUE, VALUE,
                                      VALUE, VALUE, VALUE, VALUE, VALUE, VALUE, VALUE);
 extern VALUE shoes_plot_parse_column_settings(VALUE);
+extern void shoes_chart_series_reserve(shoes_chart_series *, long);
+extern void shoes_chart_series_load(shoes_chart_series *, VALUE);
+extern void shoes_chart_series_ring(shoes_chart_series *, long);
+extern void shoes_chart_series_add(shoes_chart_series *, double);
+extern void shoes_chart_series_add_many(shoes_chart_series *, VALUE);
+extern void shoes_chart_series_store(shoes_chart_series *, long, double);
+extern double shoes_chart_series_scale_min(shoes_chart_series *);
+extern double shoes_chart_series_scale_max(shoes_chart_series *);
+extern void shoes_chart_series_range(shoes_chart_series *, long, long, double *, double *, long *);
+extern void shoes_chart_series_sync(shoes_chart_series *);
+extern char *shoes_chart_series_label(shoes_chart_series *, long, char *, int);
+extern void shoes_chart_series_keys(shoes_chart_series *, double *, long, const char *);
+extern void shoes_plot_series_reloaded(VALUE);
+extern void shoes_plot_series_grew(VALUE, long, long);
+extern void shoes_plot_static_changed(VALUE);
+extern void shoes_plot_near_free(shoes_plot *);
 // plot utility functions (in plot_util.c)
 extern void shoes_plot_set_cairo_default(cairo_t *, shoes_plot *);
 extern void shoes_plot_util_default_colors(shoes_plot *);
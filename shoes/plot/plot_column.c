@@ -10,8 +10,7 @@
 void shoes_plot_draw_column_top(cairo_t *cr, int x, int y) {
 }
 
-void shoes_plot_column_xaxis(cairo_t *cr, shoes_plot *plot, int x, VALUE obs) {
-    char *rawstr = RSTRING_PTR(obs);
+void shoes_plot_column_xaxis(cairo_t *cr, shoes_plot *plot, int x, char *rawstr) {
     int y;
     y = plot->graph_h;
     shoes_plot_draw_label(cr, plot, x, y, rawstr, BELOW);
@@ -37,18 +36,17 @@ void shoes_plot_draw_columns(cairo_t *cr, shoes_plot *plot) {
     double vScales[num_series];
     shoes_color *colors[num_series];
     int nubs[num_series];
-    VALUE values[num_series];
-    VALUE labels[num_series];
+    shoes_chart_series *series[num_series];
+    char lblbuf[24];
     int range = plot->end_idx - plot->beg_idx; // zooming adj
     // load local var arrays
     for (i = 0; i < plot->seriescnt; i++) {
         VALUE rbser = rb_ary_entry(plot->series, i);
         shoes_chart_series *cs;
         Data_Get_Struct(rbser, shoes_chart_series, cs);
-        values[i] = cs->values;
-        labels[i] = cs->labels;
-        maximums[i] = NUM2DBL(cs->maxv);
-        minimums[i] = NUM2DBL(cs->minv);
+        series[i] = cs;
+        maximums[i] = shoes_chart_series_scale_max(cs);
+        minimums[i] = shoes_chart_series_scale_min(cs);
         nubs[i] = (width / range > 10) ? RTEST(cs->point_type) : 0;
         Data_Get_Struct(cs->color, shoes_color, colors[i]);
         int sw = NUM2INT(cs->strokes);
@@ -79,12 +77,12 @@ void shoes_plot_draw_columns(cairo_t *cr, shoes_plot *plot) {
     for (i = plot->beg_idx; i < plot->end_idx; i++) {
         int j;
         for (j = 0; j < plot->seriescnt; j++) {
-            VALUE rbdp  = rb_ary_entry(values[j], i + plot->beg_idx);
-            if (NIL_P(rbdp)) {
+            long k = i + plot->beg_idx;
+            double v = (k < series[j]->count) ? series[j]->data[k] : NAN;
+            if (isnan(v)) {
                 printf("skipping nil at %i\n", i + plot->beg_idx);
                 continue;
             }
-            double v = NUM2DBL(rbdp);
             cairo_set_line_width(cr, strokesw[j]);
             cairo_set_source_rgba(cr, colors[j]->r / 255.0, colors[j]->g / 255.0,
                                   colors[j]->b / 255.0, colors[j]->a / 255.0);
@@ -99,9 +97,9 @@ void shoes_plot_draw_columns(cairo_t *cr, shoes_plot *plot) {
         }
         // draw xaxis labels.
         shoes_plot_set_cairo_default(cr, plot); // reset to default
-        VALUE obs = rb_ary_entry(labels[0], i + plot->beg_idx);
+        char *obs = shoes_chart_series_label(series[0], i + plot->beg_idx, lblbuf, sizeof(lblbuf));
         //VALUE obs = rb_ary_entry(rbobs, i + plot->beg_idx);
-        shoes_plot_column_xaxis(cr, plot, xpos-(colsw / 2), obs);
+        shoes_plot_column_xaxis(cr, plot, xpos-(colsw / 2), obs ? obs : " ");
         xpos = (ncolsw * (i + 1)) + xinset;
     }
     // tell cairo to draw all lines (and points) not already drawn.
@@ -114,8 +112,11 @@ void shoes_plot_column_draw(cairo_t *cr, shoes_place *place, shoes_plot *self_t)
     shoes_plot_util_adornments(cr, place, self_t, 50);
     if (self_t->seriescnt) {
         // draw  box, ticks and x,y labels.
-        shoes_plot_draw_ticks_and_labels(cr, self_t); // FIX for v2?
-        shoes_plot_draw_legend(cr, self_t); //Fix for v2?
-        shoes_plot_draw_columns(cr, self_t);
+        if (PLOT_STATIC(self_t)) {
+            shoes_plot_draw_ticks_and_labels(cr, self_t); // FIX for v2?
+            shoes_plot_draw_legend(cr, self_t); //Fix for v2?
+        }
+        if (PLOT_DATA(self_t))
+            shoes_plot_draw_columns(cr, self_t);
     }
 }
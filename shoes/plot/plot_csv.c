@@ -0,0 +1,400 @@
+/*
+ * plot.load_csv(path, opts) - comma or tab separated columns straight into
+ * chart series.
+ *
+ * The file is mapped (shoes_image_file_open) and read in one pass. Numbers
+ * go into a growing double buffer per series, tracking its min and max as
+ * they come, and are handed to plot.add as packed doubles, so no Ruby
+ * object is made per value. The x column is kept the same way (seconds for
+ * dates, else numbers) and the series make their labels from it as they
+ * are drawn (shoes_chart_series_label).
+ *
+ * Quoted fields ("a, b" and "say ""hi""") are understood, a quoted field
+ * can't span lines though. Empty or unreadable numbers are missing values.
+*/
+#include "shoes/plot/plot.h"
+#include <ruby/util.h>
+
+typedef struct {
+    const char *p, *end;
+    char sep;
+} shoes_csv;
+
+typedef struct {
+    double *data;
+    long count, capa;
+    double lo, hi;
+} shoes_csv_column;
+
+// everything a load needs, so the parse can run under rb_ensure
+typedef struct {
+    VALUE self, path, rbx, rby, rbsep;
+    int scatter, header;
+    char *datefmt, *labelfmt;
+    shoes_image_file f;
+    shoes_csv_column *cols;
+    int nseries;
+    shoes_csv_column keys;      // the x column, for labels
+    int *slot, *colof;          // sized by the header, so not on the stack
+} shoes_csv_load;
+
+// one field of the current row; *eol is set when it ended the row
+static void shoes_csv_field(shoes_csv *csv, const char **start, long *len, int *quoted, int *eol) {
+    const char *p = csv->p;
+    *quoted = 0;
+    if (p < csv->end && *p == '"') {
+        *quoted = 1;
+        *start = ++p;
+        while (p < csv->end && *p != '\n') {
+            if (*p == '"') {
+                if (p + 1 < csv->end && p[1] == '"') {
+                    p += 2;
+                    continue;
+                }
+                break;
+            }
+            p++;
+        }
+        *len = p - *start;
+        // anything between the closing quote and the separator is dropped
+        while (p < csv->end && *p != csv->sep && *p != '\n' && *p != '\r')
+            p++;
+    } else {
+        *start = p;
+        while (p < csv->end && *p != csv->sep && *p != '\n' && *p != '\r')
+            p++;
+        *len = p - *start;
+    }
+    *eol = 1;
+    if (p < csv->end && *p == csv->sep) {
+        *eol = 0;
+        p++;
+    } else {
+        if (p < csv->end && *p == '\r') p++;
+        if (p < csv->end && *p == '\n') p++;
+    }
+    csv->p = p;
+}
+
+static void shoes_csv_skip_blank(shoes_csv *csv) {
+    while (csv->p < csv->end && (*csv->p == '\n' || *csv->p == '\r'))
+        csv->p++;
+}
+
+static VALUE shoes_csv_string(const char *s, long len, int quoted) {
+    if (!quoted || memchr(s, '"', len) == NULL)
+        return rb_str_new(s, len);
+    VALUE str = rb_str_buf_new(len);
+    long i;
+    for (i = 0; i < len; i++) {
+        rb_str_buf_cat(str, s + i, 1);
+        if (s[i] == '"' && i + 1 < len && s[i + 1] == '"')
+            i++;
+    }
+    return str;
+}
+
+// locale independent, NAN when it isn't all number
+static double shoes_csv_number(const char *s, long len) {
+    char buf[64], *end;
+    while (len > 0 && (*s == ' ' || *s == '\t')) {
+        s++;
+        len--;
+    }
+    while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t'))
+        len--;
+    if (len == 0 || len >= (long) sizeof(buf))
+        return NAN;
+    SHOE_MEMCPY(buf, s, char, len);
+    buf[len] = '\0';
+    double v = ruby_strtod(buf, &end);
+    return (*end == '\0') ? v : NAN;
+}
+
+// a strptime() subset that also builds on Windows: %Y %y %m %d %H %M %S
+// and literal characters. Returns 0 when the field doesn't match.
+static int shoes_csv_date(const char *s, long len, const char *fmt, struct tm *tm) {
+    const char *end = s + len;
+    SHOE_MEMZERO(tm, struct tm, 1);
+    tm->tm_mday = 1;
+    for (; *fmt; fmt++) {
+        if (*fmt != '%') {
+            if (s >= end || *s != *fmt) return 0;
+            s++;
+            continue;
+        }
+        int width = (*++fmt == 'Y') ? 4 : 2, n = 0, got = 0;
+        while (got < width && s < end && *s >= '0' && *s <= '9') {
+            n = n * 10 + (*s++ - '0');
+            got++;
+        }
+        if (got == 0) return 0;
+        switch (*fmt) {
+            case 'Y': tm->tm_year = n - 1900; break;
+            case 'y': tm->tm_year = (n < 70) ? n + 100 : n; break;
+            case 'm': tm->tm_mon = n - 1; break;
+            case 'd': tm->tm_mday = n; break;
+            case 'H': tm->tm_hour = n; break;
+            case 'M': tm->tm_min = n; break;
+            case 'S': tm->tm_sec = n; break;
+            default: return 0;
+        }
+    }
+    return s == end;
+}
+
+// seconds since 1970 (UTC), for dates on a scatter's x axis
+static double shoes_csv_seconds(struct tm *tm) {
+    long y = tm->tm_year + 1900 - (tm->tm_mon < 2);
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (tm->tm_mon + (tm->tm_mon < 2 ? 10 : -2)) + 2) / 5 + tm->tm_mday - 1;
+    long days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+    return days * 86400.0 + tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec;
+}
+
+// a failed grow leaves the old buffer in place for shoes_csv_done to free
+static void shoes_csv_push(shoes_csv_column *col, double v) {
+    if (col->count == col->capa) {
+        long capa = max(1024, col->capa * 2);
+        double *data = col->data;
+        SHOE_REALLOC_N(data, double, capa);
+        if (data == NULL)
+            rb_raise(rb_eNoMemError, "plot.load_csv: can't hold %ld values", capa);
+        col->data = data;
+        col->capa = capa;
+    }
+    col->data[col->count++] = v;
+    if (!isnan(v)) {
+        if (isnan(col->lo) || v < col->lo) col->lo = v;
+        if (isnan(col->hi) || v > col->hi) col->hi = v;
+    }
+}
+
+// column number for an x: or y: option, -1 if there's no such column
+static int shoes_csv_column_index(VALUE spec, VALUE names) {
+    long i;
+    if (FIXNUM_P(spec))
+        return (NUM2INT(spec) >= 0 && NUM2INT(spec) < RARRAY_LEN(names)) ? NUM2INT(spec) : -1;
+    for (i = 0; i < RARRAY_LEN(names); i++) {
+        if (rb_str_equal(rb_ary_entry(names, i), spec) == Qtrue)
+            return i;
+    }
+    return -1;
+}
+
+// the parse proper; shoes_csv_done runs after it however it ends
+static VALUE shoes_csv_parse(VALUE data) {
+    shoes_csv_load *load = (shoes_csv_load *) data;
+    shoes_plot *self_t;
+    Data_Get_Struct(load->self, shoes_plot, self_t);
+    int scatter = load->scatter;
+    char *datefmt = load->datefmt;
+    VALUE path = load->path, rbx = load->rbx, rby = load->rby;
+
+    shoes_csv csv;
+    csv.p = (const char *) load->f.data;
+    csv.end = csv.p + load->f.len;
+    if (!NIL_P(load->rbsep)) {
+        csv.sep = RSTRING_PTR(load->rbsep)[0];
+    } else {
+        // tabs in the first line and no commas: it's tab separated
+        const char *nl = memchr(csv.p, '\n', load->f.len);
+        long first = nl ? nl - csv.p : (long) load->f.len;
+        csv.sep = (memchr(csv.p, '\t', first) && !memchr(csv.p, ',', first)) ? '\t' : ',';
+    }
+
+    // the first row names the columns, or at least says how many there are
+    VALUE names = rb_ary_new();
+    const char *s;
+    long len;
+    int quoted, eol, col;
+    shoes_csv_skip_blank(&csv);
+    const char *rows = csv.p;
+    do {
+        shoes_csv_field(&csv, &s, &len, &quoted, &eol);
+        if (load->header) {
+            rb_ary_push(names, shoes_csv_string(s, len, quoted));
+        } else {
+            char t[32];
+            snprintf(t, sizeof(t), "column %ld", RARRAY_LEN(names) + 1);
+            rb_ary_push(names, rb_str_new2(t));
+        }
+    } while (!eol);
+    if (!load->header)
+        csv.p = rows;
+
+    int ncols = RARRAY_LEN(names), i;
+    int xcol = NIL_P(rbx) ? -1 : shoes_csv_column_index(rbx, names);
+    int *slot = load->slot = SHOE_ALLOC_N(int, ncols);   // series a column goes to, -1 for none
+    int nseries = 0;
+    if (slot == NULL)
+        rb_raise(rb_eNoMemError, "plot.load_csv: can't hold %d columns", ncols);
+    for (i = 0; i < ncols; i++)
+        slot[i] = -1;
+    if (scatter && xcol >= 0)
+        slot[xcol] = nseries++;
+    if (NIL_P(rby)) {
+        for (i = 0; i < ncols; i++)
+            if (i != xcol) slot[i] = nseries++;
+    } else {
+        for (i = 0; i < RARRAY_LEN(rby); i++) {
+            col = shoes_csv_column_index(rb_ary_entry(rby, i), names);
+            if (col < 0 || slot[col] >= 0)
+                rb_raise(rb_eArgError, "plot.load_csv: no column %s in %s",
+                         RSTRING_PTR(rb_inspect(rb_ary_entry(rby, i))), RSTRING_PTR(path));
+            slot[col] = nseries++;
+        }
+    }
+    if (!NIL_P(rbx) && xcol < 0)
+        rb_raise(rb_eArgError, "plot.load_csv: no column %s in %s",
+                 RSTRING_PTR(rb_inspect(rbx)), RSTRING_PTR(path));
+    if (nseries == 0 || self_t->seriescnt + nseries > 6 || (scatter && nseries != 2))
+        rb_raise(rb_eArgError, "plot.load_csv: %d series don't fit this plot", nseries);
+
+    shoes_csv_column *cols = load->cols = SHOE_ALLOC_N(shoes_csv_column, nseries);
+    if (cols == NULL)
+        rb_raise(rb_eNoMemError, "plot.load_csv: out of memory");
+    SHOE_MEMZERO(cols, shoes_csv_column, nseries);
+    load->nseries = nseries;
+    for (i = 0; i < nseries; i++)
+        cols[i].lo = cols[i].hi = NAN;
+    int keyed = (xcol >= 0 && !scatter);
+    long nrows = 0;
+    for (;;) {
+        shoes_csv_skip_blank(&csv);
+        if (csv.p >= csv.end)
+            break;
+        col = 0;
+        do {
+            struct tm tm;
+            shoes_csv_field(&csv, &s, &len, &quoted, &eol);
+            if (col >= ncols) {
+                col++;
+                continue;   // more fields than the header, ignore them
+            }
+            if (slot[col] >= 0 || (col == xcol && keyed)) {
+                double v;
+                if (col == xcol && datefmt)
+                    v = shoes_csv_date(s, len, datefmt, &tm) ? shoes_csv_seconds(&tm) : NAN;
+                else
+                    v = shoes_csv_number(s, len);
+                if (slot[col] >= 0)
+                    shoes_csv_push(&cols[slot[col]], v);
+                if (col == xcol && keyed)
+                    shoes_csv_push(&load->keys, v);
+            }
+            col++;
+        } while (!eol);
+        nrows++;
+        // short rows are missing the rest
+        for (i = 0; i < nseries; i++)
+            while (cols[i].count < nrows)
+                shoes_csv_push(&cols[i], NAN);
+        if (keyed)
+            while (load->keys.count < nrows)
+                shoes_csv_push(&load->keys, NAN);
+    }
+
+    // in the order the series were asked for, scatter's x first
+    int *colof = load->colof = SHOE_ALLOC_N(int, nseries);
+    if (colof == NULL)
+        rb_raise(rb_eNoMemError, "plot.load_csv: out of memory");
+    for (col = 0; col < ncols; col++)
+        if (slot[col] >= 0) colof[slot[col]] = col;
+    VALUE added = rb_ary_new();
+    for (i = 0; i < nseries; i++) {
+        shoes_csv_column *c = &cols[i];
+        double lo = isnan(c->lo) ? 0.0 : c->lo, hi = isnan(c->hi) ? 1.0 : c->hi;
+        if (lo == hi) {
+            lo -= 0.5;
+            hi += 0.5;
+        }
+        VALUE h = rb_hash_new();
+        rb_hash_aset(h, ID2SYM(rb_intern("values")), rb_str_new((char *) c->data, c->count * sizeof(double)));
+        rb_hash_aset(h, ID2SYM(rb_intern("min")), rb_float_new(lo));
+        rb_hash_aset(h, ID2SYM(rb_intern("max")), rb_float_new(hi));
+        rb_hash_aset(h, ID2SYM(rb_intern("name")), rb_ary_entry(names, colof[i]));
+        SHOE_FREE(c->data);
+        c->data = NULL;
+        rb_ary_push(added, h);
+    }
+    for (i = 0; i < RARRAY_LEN(added); i++) {
+        VALUE ser = shoes_plot_add(load->self, rb_ary_entry(added, i));
+        rb_ary_store(added, i, ser);
+        if (keyed && nrows > 0) {
+            shoes_chart_series *cs;
+            double *keys = SHOE_ALLOC_N(double, nrows);
+            if (keys == NULL)
+                rb_raise(rb_eNoMemError, "plot.load_csv: out of memory");
+            SHOE_MEMCPY(keys, load->keys.data, double, nrows);
+            Data_Get_Struct(ser, shoes_chart_series, cs);
+            shoes_chart_series_keys(cs, keys, nrows, datefmt ? load->labelfmt : NULL);
+        }
+    }
+    return added;
+}
+
+static VALUE shoes_csv_done(VALUE data) {
+    shoes_csv_load *load = (shoes_csv_load *) data;
+    int i;
+    shoes_image_file_close(&load->f);
+    if (load->cols != NULL) {
+        for (i = 0; i < load->nseries; i++)
+            if (load->cols[i].data != NULL) SHOE_FREE(load->cols[i].data);
+        SHOE_FREE(load->cols);
+    }
+    if (load->keys.data != NULL) SHOE_FREE(load->keys.data);
+    if (load->slot != NULL) SHOE_FREE(load->slot);
+    if (load->colof != NULL) SHOE_FREE(load->colof);
+    return Qnil;
+}
+
+VALUE shoes_plot_load_csv(int argc, VALUE *argv, VALUE self) {
+    shoes_plot *self_t;
+    VALUE path, opts = Qnil;
+    VALUE rbx = Qnil, rby = Qnil, rbsep = Qnil, rbheader = Qnil, rbdate = Qnil, rblabel = Qnil;
+    Data_Get_Struct(self, shoes_plot, self_t);
+    rb_scan_args(argc, argv, "11", &path, &opts);
+    Check_Type(path, T_STRING);
+    if (!NIL_P(opts)) {
+        Check_Type(opts, T_HASH);
+        rbx = shoes_hash_get(opts, rb_intern("x"));
+        rby = shoes_hash_get(opts, rb_intern("y"));
+        rbsep = shoes_hash_get(opts, rb_intern("sep"));
+        rbheader = shoes_hash_get(opts, rb_intern("header"));
+        rbdate = shoes_hash_get(opts, rb_intern("date"));
+        rblabel = shoes_hash_get(opts, rb_intern("date_label"));
+    }
+    if (!NIL_P(rbsep) && (TYPE(rbsep) != T_STRING || RSTRING_LEN(rbsep) != 1))
+        rb_raise(rb_eArgError, "plot.load_csv: sep: must be one character");
+    if (!NIL_P(rbdate)) Check_Type(rbdate, T_STRING);
+    if (!NIL_P(rblabel)) Check_Type(rblabel, T_STRING);
+    if (!NIL_P(rby) && TYPE(rby) != T_ARRAY)
+        rby = rb_ary_new3(1, rby);
+    int scatter = (self_t->chart_type == SCATTER_CHART);
+    if (scatter && NIL_P(rbx))
+        rb_raise(rb_eArgError, "plot.load_csv: a scatter chart needs x:");
+    int header = NIL_P(rbheader) || RTEST(rbheader);
+    char *datefmt = NIL_P(rbdate) ? NULL : RSTRING_PTR(rbdate);
+    char *labelfmt = NIL_P(rblabel) ?
+                     ((datefmt && strstr(datefmt, "%H")) ? "%Y-%m-%d %H:%M" : "%Y-%m-%d") : RSTRING_PTR(rblabel);
+
+    shoes_csv_load load;
+    load.self = self;
+    load.path = path;
+    load.rbx = rbx;
+    load.rby = rby;
+    load.rbsep = rbsep;
+    load.scatter = scatter;
+    load.header = header;
+    load.datefmt = datefmt;
+    load.labelfmt = labelfmt;
+    load.cols = NULL;
+    load.nseries = 0;
+    SHOE_MEMZERO(&load.keys, shoes_csv_column, 1);
+    load.slot = load.colof = NULL;
+    if (!shoes_image_file_open(RSTRING_PTR(path), &load.f))
+        rb_raise(rb_eArgError, "plot.load_csv: can't read %s", RSTRING_PTR(path));
+    return rb_ensure(shoes_csv_parse, (VALUE) &load, shoes_csv_done, (VALUE) &load);
+}
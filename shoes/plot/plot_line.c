@@ -4,6 +4,49 @@
 // forward declares in this file:
 void shoes_plot_line_nub(cairo_t *, int, int);
 
+/*
+ * With more points than pixels many of them land on the same x. All cairo
+ * can show of those is a vertical stroke from the lowest to the highest,
+ * entered at the first and left at the last, so that's all we send it.
+ * The path stays a few points per pixel column however long the series.
+ */
+typedef struct {
+    long x;
+    int n;
+    double first, lo, hi, last;
+} shoes_plot_column_pts;
+
+static void shoes_plot_line_flush(cairo_t *cr, shoes_plot_column_pts *col, int *brk,
+                                  int top, int height, double minimum, double vScale) {
+    if (col->n == 0) return;
+    long yfirst = top + height - roundl((col->first - minimum) * vScale);
+    long ylo = top + height - roundl((col->lo - minimum) * vScale);
+    long yhi = top + height - roundl((col->hi - minimum) * vScale);
+    long ylast = top + height - roundl((col->last - minimum) * vScale);
+    if (*brk) {
+        cairo_move_to(cr, col->x, yfirst);
+        *brk = 0;
+    } else {
+        cairo_line_to(cr, col->x, yfirst);
+    }
+    if (col->n > 1) {
+        cairo_line_to(cr, col->x, ylo);
+        cairo_line_to(cr, col->x, yhi);
+        cairo_line_to(cr, col->x, ylast);
+    }
+    col->n = 0;
+}
+
+static void shoes_plot_line_add(shoes_plot_column_pts *col, long x, double v) {
+    if (col->n == 0) {
+        col->x = x;
+        col->first = col->lo = col->hi = v;
+    }
+    if (v < col->lo) col->lo = v;
+    if (v > col->hi) col->hi = v;
+    col->last = v;
+    col->n++;
+}
 
 void shoes_plot_draw_datapts(cairo_t *cr, shoes_plot *plot) {
     int i;
@@ -16,11 +59,9 @@ void shoes_plot_draw_datapts(cairo_t *cr, shoes_plot *plot) {
         VALUE rbser = rb_ary_entry(plot->series, i);
         shoes_chart_series *cs;
         Data_Get_Struct(rbser, shoes_chart_series, cs);
-        VALUE rbvalues = cs->values;
-        VALUE rbmaxv = cs->maxv;
-        double maximum = NUM2DBL(rbmaxv);
-        VALUE rbminv = cs->minv;
-        double minimum = NUM2DBL(rbminv);
+        double *values = cs->data;
+        double maximum = shoes_chart_series_scale_max(cs);
+        double minimum = shoes_chart_series_scale_min(cs);
         int strokew = NUM2INT(cs->strokes);
         shoes_color *color;
         Data_Get_Struct(cs->color, shoes_color, color);
@@ -53,34 +94,87 @@ void shoes_plot_draw_datapts(cairo_t *cr, shoes_plot *plot) {
 
         int j;
         int brk = 0; // for missing value control
-        for (j = 0; j < range; j++) {
-            VALUE rbdp = rb_ary_entry(rbvalues, j + plot->beg_idx);
-            if (NIL_P(rbdp)) {
-                if (plot->missing == MISSING_MIN) {
-                    rbdp = rbminv;
-                } else if (plot->missing == MISSING_MAX) {
-                    rbdp = rbmaxv;
+        // nubs are never drawn this crowded, so only the line is decimated
+        int decimate = range > 2 * width;
+        if (decimate) {
+            // a pixel column at a time. With nothing missing in it, lo and
+            // hi come from the series' index and first and last are read
+            // directly, so a paint costs width * log(range), not range.
+            int colbrk = 1;
+            shoes_plot_column_pts col;
+            col.n = 0;
+            j = 0;
+            while (j < range) {
+                long px = roundl(j * hScale), je, missing, kb, ke;
+                double lo, hi;
+                je = (long)ceil((px + 0.5) / hScale);
+                if (je > range) je = range;
+                if (je <= j) je = j + 1;
+                while (je > j + 1 && roundl((je - 1) * hScale) != px) je--;
+                while (je < range && roundl(je * hScale) == px) je++;
+
+                kb = j + plot->beg_idx;
+                ke = je + plot->beg_idx;
+                shoes_chart_series_range(cs, kb, ke, &lo, &hi, &missing);
+                if (ke > cs->count) missing += ke - max(kb, cs->count);
+                if (missing == 0) {
+                    col.x = px + left;
+                    col.n = je - j;
+                    col.first = values[kb];
+                    col.last = values[ke - 1];
+                    col.lo = lo;
+                    col.hi = hi;
                 } else {
-                    brk = 1;
-                    continue;
+                    for (; j < je; j++) {
+                        long k = j + plot->beg_idx;
+                        double v = (k < cs->count) ? values[k] : NAN;
+                        if (isnan(v)) {
+                            if (plot->missing == MISSING_MIN) {
+                                v = minimum;
+                            } else if (plot->missing == MISSING_MAX) {
+                                v = maximum;
+                            } else {
+                                shoes_plot_line_flush(cr, &col, &colbrk, top, height, minimum, vScale);
+                                colbrk = 1;
+                                continue;
+                            }
+                        }
+                        shoes_plot_line_add(&col, px + left, v);
+                    }
                 }
+                shoes_plot_line_flush(cr, &col, &colbrk, top, height, minimum, vScale);
+                j = je;
             }
-            double v = NUM2DBL(rbdp);
-            long x = roundl(j * hScale);
-            long y = height - roundl((v - minimum) *vScale);
-            x += left;
-            y += top;
-            //printf("draw i: %i, x: %i, y: %i %f \n", j, (int) x, (int) y, hScale);
-            if (j == 0 || brk == 1) {
-                cairo_move_to(cr, x, y);
-                brk = 0;
-            } else {
-                cairo_line_to(cr, x, y);
-            }
-            if (nubs) {
-                //shoes_plot_line_nub(cr, x, y);
-                // TODO: shoes_plot_draw_nub(cr, plot, x, y, nubs, strokew + 2);
-                shoes_plot_draw_nub(cr, plot, x, y, 7, strokew + 2); // 7 will default to old code
+        } else {
+            for (j = 0; j < range; j++) {
+                long k = j + plot->beg_idx;
+                double v = (k < cs->count) ? values[k] : NAN;
+                if (isnan(v)) {
+                    if (plot->missing == MISSING_MIN) {
+                        v = minimum;
+                    } else if (plot->missing == MISSING_MAX) {
+                        v = maximum;
+                    } else {
+                        brk = 1;
+                        continue;
+                    }
+                }
+                long x = roundl(j * hScale);
+                long y = height - roundl((v - minimum) *vScale);
+                x += left;
+                y += top;
+                //printf("draw i: %i, x: %i, y: %i %f \n", j, (int) x, (int) y, hScale);
+                if (j == 0 || brk == 1) {
+                    cairo_move_to(cr, x, y);
+                    brk = 0;
+                } else {
+                    cairo_line_to(cr, x, y);
+                }
+                if (nubs) {
+                    //shoes_plot_line_nub(cr, x, y);
+                    // TODO: shoes_plot_draw_nub(cr, plot, x, y, nubs, strokew + 2);
+                    shoes_plot_draw_nub(cr, plot, x, y, 7, strokew + 2); // 7 will default to old code
+                }
             }
         }
         cairo_stroke(cr);
@@ -116,10 +210,14 @@ void shoes_plot_line_nub(cairo_t *cr, int x, int y) {
 // called at draw time.
 void shoes_plot_line_draw(cairo_t *cr, shoes_place *place, shoes_plot *self_t) {
     shoes_plot_util_adornments(cr, place, self_t, 50);
-    if (self_t->seriescnt) {
+    // a streaming series may not have two points to scale between yet
+    if (self_t->seriescnt && self_t->end_idx - self_t->beg_idx > 1) {
         // draw  ticks and x,y labels.
-        shoes_plot_draw_ticks_and_labels(cr, self_t);
-        shoes_plot_draw_legend(cr, self_t);
-        shoes_plot_draw_datapts(cr, self_t); // draw data
+        if (PLOT_STATIC(self_t)) {
+            shoes_plot_draw_ticks_and_labels(cr, self_t);
+            shoes_plot_draw_legend(cr, self_t);
+        }
+        if (PLOT_DATA(self_t))
+            shoes_plot_draw_datapts(cr, self_t); // draw data
     }
 }
@@ -0,0 +1,319 @@
+/*
+ * plot.near(x, y) - which value is drawn closest to a point, for tooltips
+ * from a motion handler.
+ *
+ * It redoes the screen math of the painters with the geometry they left
+ * behind at the last paint, so it only looks at what can be near:
+ * line and timeseries charts check the values drawn in the pixel column
+ * under x, column charts the bars of one observation, pie and radar
+ * charts their handful of slices or corners. Scatter points go into a
+ * grid of cells when the data (or the scale) changed and the search
+ * spirals out from the cell under the point.
+*/
+#include "shoes/plot/plot.h"
+
+typedef struct {
+    int series;       // -1 until something is found
+    long index;
+    double value;
+    double xvalue;    // scatter: value of the x series
+    char *label;
+    double x, y;      // where it's drawn, plot coordinates
+    double dist;      // squared, pixels
+} shoes_plot_hit;
+
+typedef struct {
+    long version[2];  // of the x and y series it was built from
+    long count;
+    double xmin, xmax, ymin, ymax;
+    int cells;        // per side
+    long *start;      // cells * cells + 1 offsets into points
+    long *points;     // indices, cell by cell
+} shoes_plot_near_grid;
+
+static void shoes_plot_near_try(shoes_plot_hit *hit, double dist, int series, long index,
+                                double value, double x, double y) {
+    if (hit->series >= 0 && dist >= hit->dist)
+        return;
+    hit->series = series;
+    hit->index = index;
+    hit->value = value;
+    hit->x = x;
+    hit->y = y;
+    hit->dist = dist;
+}
+
+static void shoes_plot_near_line(shoes_plot *plot, double px, double py, shoes_plot_hit *hit) {
+    int left = plot->graph_x, top = plot->graph_y;
+    int width = plot->graph_w - left, height = plot->graph_h - top;
+    long range = plot->end_idx - plot->beg_idx;
+    long lo, hi, j;
+    int i;
+    if (range < 1)
+        return;
+    double hScale = (range > 1) ? width / (double) (range - 1) : 0.0;
+    if (hScale == 0.0) {
+        lo = hi = 0;
+    } else {
+        // every index that lands in the pixel column under px, or the
+        // closest one when they're further apart than a pixel
+        double dx = px - left;
+        lo = ceil((dx - 0.5) / hScale);
+        hi = floor((dx + 0.5) / hScale);
+        if (lo > hi)
+            lo = hi = lround(dx / hScale);
+        lo = max(0, min(range - 1, lo));
+        hi = max(0, min(range - 1, hi));
+    }
+    for (i = 0; i < plot->seriescnt; i++) {
+        shoes_chart_series *cs;
+        Data_Get_Struct(rb_ary_entry(plot->series, i), shoes_chart_series, cs);
+        double minimum = shoes_chart_series_scale_min(cs);
+        double vScale = height / (shoes_chart_series_scale_max(cs) - minimum);
+        for (j = lo; j <= hi; j++) {
+            long k = j + plot->beg_idx;
+            if (k >= cs->count || isnan(cs->data[k]))
+                continue;
+            double x = left + roundl(j * hScale);
+            double y = top + height - roundl((cs->data[k] - minimum) * vScale);
+            shoes_plot_near_try(hit, (x - px) * (x - px) + (y - py) * (y - py), i, k, cs->data[k], x, y);
+        }
+    }
+}
+
+// the bars of the observation under px, closest bar by x
+static void shoes_plot_near_column(shoes_plot *plot, double px, double py, shoes_plot_hit *hit) {
+    int left = plot->graph_x, top = plot->graph_y;
+    int width = plot->graph_w - left, height = plot->graph_h - top;
+    int range = plot->end_idx - plot->beg_idx;
+    int i;
+    if (range < 1)
+        return;
+    int ncolsw = width / range;
+    long r = (ncolsw > 0) ? floor((px - left) / ncolsw) : floor((px - left) * range / width);
+    r = max(0, min(range - 1, r));
+    long k = r + plot->beg_idx;
+    double xpos = left + (ncolsw / 2) + ncolsw * r;
+    for (i = 0; i < plot->seriescnt; i++) {
+        shoes_chart_series *cs;
+        Data_Get_Struct(rb_ary_entry(plot->series, i), shoes_chart_series, cs);
+        if (k >= cs->count || isnan(cs->data[k]))
+            continue;   // no bar, and the next one isn't pushed over
+        double minimum = shoes_chart_series_scale_min(cs);
+        double vScale = height / (shoes_chart_series_scale_max(cs) - minimum);
+        double y = top + height - roundl((cs->data[k] - minimum) * vScale);
+        shoes_plot_near_try(hit, (xpos - px) * (xpos - px), i, k, cs->data[k], xpos, y);
+        int sw = NUM2INT(cs->strokes);
+        xpos += (sw < 4) ? 4 : sw;
+    }
+}
+
+void shoes_plot_near_free(shoes_plot *plot) {
+    shoes_plot_near_grid *grid = (shoes_plot_near_grid *) plot->near_grid;
+    if (grid == NULL)
+        return;
+    free(grid->start);
+    free(grid->points);
+    free(grid);
+    plot->near_grid = NULL;
+}
+
+static int shoes_plot_near_cell(double v, double lo, double hi, int cells) {
+    long c = floor((v - lo) / (hi - lo) * cells);
+    return max(0, min(cells - 1, c));
+}
+
+// the cells are in data space so the grid survives a resize
+static shoes_plot_near_grid *shoes_plot_near_grid_for(shoes_plot *plot, shoes_chart_series *serx,
+        shoes_chart_series *sery, double xmin, double xmax, double ymin, double ymax) {
+    shoes_plot_near_grid *grid = (shoes_plot_near_grid *) plot->near_grid;
+    long i, n = min(serx->count, sery->count);
+    if (grid && grid->version[0] == serx->version && grid->version[1] == sery->version &&
+            grid->count == n && grid->xmin == xmin && grid->xmax == xmax &&
+            grid->ymin == ymin && grid->ymax == ymax)
+        return grid;
+    shoes_plot_near_free(plot);
+    grid = SHOE_ALLOC(shoes_plot_near_grid);
+    grid->version[0] = serx->version;
+    grid->version[1] = sery->version;
+    grid->count = n;
+    grid->xmin = xmin;
+    grid->xmax = xmax;
+    grid->ymin = ymin;
+    grid->ymax = ymax;
+    // about 8 points a cell
+    grid->cells = max(1, min(1024, (int) sqrt(n / 8.0)));
+    long ncells = (long) grid->cells * grid->cells;
+    grid->start = SHOE_ALLOC_N(long, ncells + 1);
+    grid->points = SHOE_ALLOC_N(long, max(1, n));
+    SHOE_MEMZERO(grid->start, long, ncells + 1);
+    for (i = 0; i < n; i++) {
+        if (isnan(serx->data[i]) || isnan(sery->data[i]))
+            continue;
+        int cx = shoes_plot_near_cell(serx->data[i], xmin, xmax, grid->cells);
+        int cy = shoes_plot_near_cell(sery->data[i], ymin, ymax, grid->cells);
+        grid->start[cy * grid->cells + cx + 1]++;
+    }
+    for (i = 0; i < ncells; i++)
+        grid->start[i + 1] += grid->start[i];
+    long *fill = SHOE_ALLOC_N(long, ncells);
+    SHOE_MEMCPY(fill, grid->start, long, ncells);
+    for (i = 0; i < n; i++) {
+        if (isnan(serx->data[i]) || isnan(sery->data[i]))
+            continue;
+        int cx = shoes_plot_near_cell(serx->data[i], xmin, xmax, grid->cells);
+        int cy = shoes_plot_near_cell(sery->data[i], ymin, ymax, grid->cells);
+        grid->points[fill[cy * grid->cells + cx]++] = i;
+    }
+    SHOE_FREE(fill);
+    plot->near_grid = grid;
+    return grid;
+}
+
+static void shoes_plot_near_scatter(shoes_plot *plot, double px, double py, shoes_plot_hit *hit) {
+    if (plot->seriescnt != 2)
+        return;
+    int left = plot->graph_x, top = plot->graph_y;
+    int width = plot->graph_w - left, height = plot->graph_h - top;
+    if (width < 1 || height < 1)
+        return;
+    shoes_chart_series *serx, *sery;
+    Data_Get_Struct(rb_ary_entry(plot->series, 0), shoes_chart_series, serx);
+    Data_Get_Struct(rb_ary_entry(plot->series, 1), shoes_chart_series, sery);
+    double xmin = shoes_chart_series_scale_min(serx);
+    double xmax = shoes_chart_series_scale_max(serx);
+    double ymin = shoes_chart_series_scale_min(sery);
+    double ymax = shoes_chart_series_scale_max(sery);
+    double xScale = width / (xmax - xmin);
+    double yScale = height / (ymax - ymin);
+    shoes_plot_near_grid *grid = shoes_plot_near_grid_for(plot, serx, sery, xmin, xmax, ymin, ymax);
+    int cells = grid->cells;
+    int qx = shoes_plot_near_cell(xmin + (px - left) / xScale, xmin, xmax, cells);
+    int qy = shoes_plot_near_cell(ymin + (top + height - py) / yScale, ymin, ymax, cells);
+    // nothing beyond ring r is closer than r cells
+    double step = min(width, height) / (double) cells;
+    int r, cx, cy;
+    for (r = 0; r < cells; r++) {
+        for (cy = qy - r; cy <= qy + r; cy++) {
+            if (cy < 0 || cy >= cells)
+                continue;
+            int edge = (cy == qy - r || cy == qy + r);
+            for (cx = qx - r; cx <= qx + r; cx += (edge || r == 0) ? 1 : 2 * r) {
+                if (cx < 0 || cx >= cells)
+                    continue;
+                long c = cy * cells + cx, p;
+                for (p = grid->start[c]; p < grid->start[c + 1]; p++) {
+                    long i = grid->points[p];
+                    double x = left + roundl((serx->data[i] - xmin) * xScale);
+                    double y = top + height - roundl((sery->data[i] - ymin) * yScale);
+                    double d = (x - px) * (x - px) + (y - py) * (y - py);
+                    if (hit->series < 0 || d < hit->dist)
+                        hit->xvalue = serx->data[i];
+                    shoes_plot_near_try(hit, d, 1, i, sery->data[i], x, y);
+                }
+            }
+        }
+        if (hit->series >= 0 && hit->dist <= (r * step) * (r * step))
+            break;
+    }
+}
+
+// the slice under the point, reported at the middle of the slice
+static void shoes_plot_near_pie(shoes_plot *plot, double px, double py, shoes_plot_hit *hit) {
+    pie_chart_t *chart = (pie_chart_t *) plot->c_things;
+    int i;
+    if (plot->seriescnt != 1 || chart == NULL)
+        return;
+    double dx = px - chart->centerx, dy = py - chart->centery;
+    if (dx * dx + dy * dy > chart->radius * chart->radius)
+        return;
+    // slices are drawn counter clockwise from 3 o'clock, y grows down
+    double a = atan2(-dy, dx);
+    if (a < 0)
+        a += SHOES_PIM2;
+    for (i = 0; i < chart->count; i++) {
+        pie_slice_t *slice = &chart->slices[i];
+        if (a >= slice->startAngle && a < slice->endAngle) {
+            double mid = (slice->startAngle + slice->endAngle) / 2;
+            shoes_plot_near_try(hit, 0.0, 0, i, slice->value,
+                                chart->centerx + cos(mid) * chart->radius / 2,
+                                chart->centery - sin(mid) * chart->radius / 2);
+            return;
+        }
+    }
+}
+
+static void shoes_plot_near_radar(shoes_plot *plot, double px, double py, shoes_plot_hit *hit) {
+    radar_chart_t *chart = (radar_chart_t *) plot->c_things;
+    int i, j;
+    if (chart == NULL)
+        return;
+    for (i = 0; i < plot->seriescnt; i++) {
+        shoes_chart_series *cs;
+        Data_Get_Struct(rb_ary_entry(plot->series, i), shoes_chart_series, cs);
+        for (j = 0; j < chart->count && j < cs->count; j++) {
+            if (isnan(cs->data[j]))
+                continue;
+            double sv = (cs->data[j] - chart->colmin[j]) / (chart->colmax[j] - chart->colmin[j]);
+            double rad_pos = j * SHOES_PI * 2 / chart->count;
+            double x = chart->centerx + sin(rad_pos) * sv * chart->radius;
+            double y = chart->centery - cos(rad_pos) * sv * chart->radius;
+            shoes_plot_near_try(hit, (x - px) * (x - px) + (y - py) * (y - py), i, j, cs->data[j], x, y);
+        }
+    }
+    if (hit->series >= 0)
+        hit->label = chart->labels[hit->index];
+}
+
+// near(x, y) => {series:, index:, value:, label:, x:, y:} or nil
+VALUE shoes_plot_nearest(VALUE self, VALUE xpos, VALUE ypos) {
+    shoes_plot *self_t;
+    Data_Get_Struct(self, shoes_plot, self_t);
+    if (self_t->seriescnt < 1 || self_t->place.iw <= 0 || self_t->place.ih <= 0)
+        return Qnil;   // nothing drawn yet
+    double ox = self_t->place.ix + self_t->place.dx;
+    double oy = self_t->place.iy + self_t->place.dy;
+    double px = NUM2DBL(xpos) - ox;
+    double py = NUM2DBL(ypos) - oy;
+    shoes_plot_hit hit;
+    char lblbuf[24];
+    hit.series = -1;
+    hit.label = NULL;
+    hit.xvalue = NAN;
+    switch (self_t->chart_type) {
+        case LINE_CHART:
+        case TIMESERIES_CHART:
+            shoes_plot_near_line(self_t, px, py, &hit);
+            break;
+        case COLUMN_CHART:
+            shoes_plot_near_column(self_t, px, py, &hit);
+            break;
+        case SCATTER_CHART:
+            shoes_plot_near_scatter(self_t, px, py, &hit);
+            break;
+        case PIE_CHART:
+            shoes_plot_near_pie(self_t, px, py, &hit);
+            break;
+        case RADAR_CHART:
+            shoes_plot_near_radar(self_t, px, py, &hit);
+            break;
+    }
+    if (hit.series < 0)
+        return Qnil;
+    if (hit.label == NULL) {
+        // observations are labeled by the first series
+        shoes_chart_series *cs;
+        Data_Get_Struct(rb_ary_entry(self_t->series, 0), shoes_chart_series, cs);
+        hit.label = shoes_chart_series_label(cs, hit.index, lblbuf, sizeof(lblbuf));
+    }
+    VALUE h = rb_hash_new();
+    rb_hash_aset(h, ID2SYM(rb_intern("series")), INT2NUM(hit.series));
+    rb_hash_aset(h, ID2SYM(rb_intern("index")), LONG2NUM(hit.index));
+    rb_hash_aset(h, ID2SYM(rb_intern("value")), rb_float_new(hit.value));
+    if (!isnan(hit.xvalue))
+        rb_hash_aset(h, ID2SYM(rb_intern("x_value")), rb_float_new(hit.xvalue));
+    rb_hash_aset(h, ID2SYM(rb_intern("label")), hit.label ? rb_str_new2(hit.label) : Qnil);
+    rb_hash_aset(h, ID2SYM(rb_intern("x")), INT2NUM(lround(hit.x + ox)));
+    rb_hash_aset(h, ID2SYM(rb_intern("y")), INT2NUM(lround(hit.y + oy)));
+    return h;
+}
@@ -17,7 +17,7 @@ void shoes_plot_pie_init(shoes_plot *plot) {
     VALUE cs = rb_ary_entry(plot->series, 0);
     shoes_chart_series *ser;
     Data_Get_Struct(cs, shoes_chart_series, ser);
-    int numobs = RARRAY_LEN(ser->values);
+    int numobs = ser->count;
     piechart->count = numobs;
     pie_slice_t *slices = (pie_slice_t *)malloc(sizeof(pie_slice_t) * numobs);
     piechart->slices = slices;
@@ -28,8 +28,7 @@ void shoes_plot_pie_init(shoes_plot *plot) {
     // sum the values
     for (i = 0; i <numobs; i++) {
         pie_slice_t *slice = &slices[i];
-        VALUE rbv = rb_ary_entry(ser->values, i);
-        double v = NUM2DBL(rbv);
+        double v = isnan(ser->data[i]) ? 0.0 : ser->data[i];
         slice->value = v;
         if (v < piechart->minv) piechart->minv = v;
         piechart->maxv += v;
@@ -97,7 +96,8 @@ void shoes_plot_draw_pie_chart(cairo_t *cr, shoes_plot *plot) {
     cairo_restore(cr);
 #endif
 
-    for (i = 0; i < chart->count; i++) {
+    // the geometry above is needed by the ticks, the wedges are the data
+    for (i = 0; i < chart->count && PLOT_DATA(plot); i++) {
         pie_slice_t *slice = &chart->slices[i];
         if (fabs(slice->startAngle - slice->endAngle) > 0.001) { // bigEnough?
             shoes_color *color = slice->color;
@@ -138,15 +138,16 @@ void shoes_plot_draw_pie_legend(cairo_t *cr, shoes_plot *self_t) {
     VALUE cs = rb_ary_entry(self_t->series, 0);
     shoes_chart_series *ser;
     Data_Get_Struct(cs, shoes_chart_series, ser);
-    int numstrs = RARRAY_LEN(ser->labels);
-    VALUE rbobs = ser->labels;
+    int numstrs = ser->count;
+    char lblbuf[24];
     PangoLayout *layouts[numstrs];
     char *strary[numstrs];
     char strh[numstrs];
     int boxh = 0, boxw = 0;
     // compute layouts for each string. Don't forget to g_unref them!
     for (i = 0; i < numstrs; i++) {
-        strary[i] = RSTRING_PTR(rb_ary_entry(rbobs, i));
+        strary[i] = shoes_chart_series_label(ser, i, lblbuf, sizeof(lblbuf));
+        if (strary[i] == NULL) strary[i] = " ";
         layouts[i] = pango_cairo_create_layout (cr);
         pango_layout_set_font_description (layouts[i], self_t->caption_pfd);
         pango_layout_set_text (layouts[i], strary[i], -1);
@@ -293,7 +294,9 @@ void shoes_plot_pie_draw(cairo_t *cr, shoes_place *place, shoes_plot *self_t) {
     shoes_plot_util_adornments(cr, place, self_t, 20);
     if (self_t->seriescnt) {
         shoes_plot_draw_pie_chart(cr, self_t);
-        shoes_plot_draw_pie_ticks(cr, self_t);
-        shoes_plot_draw_pie_legend(cr, self_t);
+        if (PLOT_STATIC(self_t)) {
+            shoes_plot_draw_pie_ticks(cr, self_t);
+            shoes_plot_draw_pie_legend(cr, self_t);
+        }
     }
 }
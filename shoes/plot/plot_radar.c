@@ -118,9 +118,13 @@ void shoes_plot_draw_radar_chart(cairo_t *cr, shoes_plot *plot) {
     chart->angle = (2 * SHOES_PI) / count;
     chart->rotation = 0.0;
 
-    shoes_plot_radar_draw_radials(cr, plot, chart);
-    shoes_plot_radar_draw_ticks(cr, plot, chart);
-    shoes_plot_radar_draw_rings(cr, plot, chart);
+    if (PLOT_STATIC(plot)) {
+        shoes_plot_radar_draw_radials(cr, plot, chart);
+        shoes_plot_radar_draw_ticks(cr, plot, chart);
+        shoes_plot_radar_draw_rings(cr, plot, chart);
+    }
+    if (!PLOT_DATA(plot))
+        return;
 
     // draw the data points -
     for (i = 0; i < plot->seriescnt; i++) {
@@ -140,9 +144,8 @@ void shoes_plot_draw_radar_chart(cairo_t *cr, shoes_plot *plot) {
         int j;
         for (j = 0; j < count; j++) {
             // scale the value (aka normalize) for the column min/max
-            VALUE rbval = rb_ary_entry(cs->values, j);
-            double val = NUM2DBL(rbval);
             double minv = chart->colmin[j];
+            double val = (j < cs->count && !isnan(cs->data[j])) ? cs->data[j] : minv;
             double maxv = chart->colmax[j];
             double spread = maxv - minv;
             double sv = (val - minv) / spread;
@@ -381,7 +384,9 @@ void shoes_plot_radar_draw(cairo_t *cr, shoes_place *place, shoes_plot *self_t)
     shoes_plot_util_adornments(cr, place, self_t, 20);
     if (self_t->seriescnt) {
         shoes_plot_draw_radar_chart(cr, self_t);
-        shoes_plot_draw_radar_outer_labels(cr, self_t);
-        shoes_plot_draw_legend(cr, self_t);
+        if (PLOT_STATIC(self_t)) {
+            shoes_plot_draw_radar_outer_labels(cr, self_t);
+            shoes_plot_draw_legend(cr, self_t);
+        }
     }
 }
@@ -2,11 +2,74 @@
 #include "shoes/plot/plot.h"
 
 
+// Too many points to stroke one by one: count them per pixel of the graph
+// area and paint the counts as an image. Opacity follows log(count) so a
+// few stray points stay visible next to the dense cluster.
+static void shoes_plot_scatter_density(cairo_t *cr, shoes_plot *plot,
+                                       shoes_chart_series *serx, shoes_chart_series *sery, long obvs,
+                                       double xmin, double xScale, double ymin, double yScale,
+                                       shoes_color *color) {
+    int width = plot->graph_w - plot->graph_x;
+    int height = plot->graph_h - plot->graph_y;
+    if (width < 1 || height < 1)
+        return;
+    unsigned int *bins = SHOE_ALLOC_N(unsigned int, width * height);
+    SHOE_MEMZERO(bins, unsigned int, width * height);
+    unsigned int most = 0;
+    long i;
+    for (i = 0; i < obvs; i++) {
+        double xval = serx->data[i];
+        double yval = sery->data[i];
+        if (isnan(xval) || isnan(yval))
+            continue;
+        long x = roundl((xval - xmin) * xScale);
+        long y = height - roundl((yval - ymin) * yScale);
+        // the max value rounds onto the far edge
+        if (x == width) x--;
+        if (y == height) y--;
+        if (x < 0 || x >= width || y < 0 || y >= height)
+            continue;
+        unsigned int n = ++bins[y * width + x];
+        if (n > most) most = n;
+    }
+
+    cairo_surface_t *img = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    if (most > 0 && cairo_surface_status(img) == CAIRO_STATUS_SUCCESS) {
+        unsigned char *pixels = cairo_image_surface_get_data(img);
+        int stride = cairo_image_surface_get_stride(img);
+        double scale = 1.0 / log1p((double)most);
+        double alpha = color->a / 255.0;
+        int x, y;
+        cairo_surface_flush(img);
+        for (y = 0; y < height; y++) {
+            uint32_t *row = (uint32_t *)(pixels + y * stride);
+            unsigned int *bin = bins + y * width;
+            for (x = 0; x < width; x++) {
+                if (bin[x] == 0) {
+                    row[x] = 0;
+                    continue;
+                }
+                // ARGB32 is premultiplied, native endian
+                double a = alpha * (0.25 + 0.75 * log1p((double)bin[x]) * scale);
+                row[x] = ((uint32_t)(a * 255) << 24) |
+                         ((uint32_t)(color->r * a) << 16) |
+                         ((uint32_t)(color->g * a) << 8) |
+                         (uint32_t)(color->b * a);
+            }
+        }
+        cairo_surface_mark_dirty(img);
+        cairo_set_source_surface(cr, img, plot->graph_x, plot->graph_y);
+        cairo_paint(cr);
+    }
+    cairo_surface_destroy(img);
+    SHOE_FREE(bins);
+}
+
 void shoes_plot_draw_scatter_pts(cairo_t *cr, shoes_plot *plot) {
     // first series (x) controls graphical settings.
     if (plot->seriescnt !=  2)
         return; // we don't have just two series
-    int i;
+    long i;
     int top,left,bottom,right;
     left = plot->graph_x;
     top = plot->graph_y;
@@ -21,10 +84,10 @@ void shoes_plot_draw_scatter_pts(cairo_t *cr, shoes_plot *plot) {
     rbyser = rb_ary_entry(plot->series, 1);
     Data_Get_Struct(rbyser, shoes_chart_series, sery);
 
-    double xmax = NUM2DBL(serx->maxv);
-    double ymax = NUM2DBL(sery->maxv);
-    double xmin = NUM2DBL(serx->minv);
-    double ymin = NUM2DBL(sery->minv);
+    double xmax = shoes_chart_series_scale_max(serx);
+    double ymax = shoes_chart_series_scale_max(sery);
+    double xmin = shoes_chart_series_scale_min(serx);
+    double ymin = shoes_chart_series_scale_min(sery);
     int nubs = NUM2INT(serx->point_type);
     VALUE shcolor = serx->color;
     VALUE rbstroke = serx->strokes;
@@ -33,23 +96,22 @@ void shoes_plot_draw_scatter_pts(cairo_t *cr, shoes_plot *plot) {
     shoes_color *color;
     Data_Get_Struct(shcolor, shoes_color, color);
 
-    int obvs = RARRAY_LEN(serx->values);
-    for (i = 0; i < obvs; i++) {
-        double xval, yval;
-        xval = NUM2DBL(rb_ary_entry(serx->values, i));
-        yval = NUM2DBL(rb_ary_entry(sery->values, i));
-        //printf("scatter x: %f, y: %f\n", xval, yval);
-    }
+    long obvs = min(serx->count, sery->count);
 
     double yScale = height / (ymax - ymin);
     double xScale = width / (xmax - xmin);
+    if (plot->density > 0 && obvs >= plot->density) {
+        shoes_plot_scatter_density(cr, plot, serx, sery, obvs, xmin, xScale, ymin, yScale, color);
+        shoes_plot_set_cairo_default(cr, plot);
+        return;
+    }
     cairo_set_source_rgba(cr, color->r / 255.0, color->g / 255.0,
                           color->b / 255.0, color->a / 255.0);
     for (i = 0; i < obvs; i++) {
-        VALUE rbx = rb_ary_entry(serx->values, i);
-        double xval = NUM2DBL(rbx);
-        VALUE rby = rb_ary_entry(sery->values, i);
-        double yval = NUM2DBL(rby);
+        double xval = serx->data[i];
+        double yval = sery->data[i];
+        if (isnan(xval) || isnan(yval))
+            continue;
         long x = roundl((xval - xmin) * xScale);
         long y = height - roundl((yval - ymin) * yScale);
         x += left;
@@ -85,10 +147,10 @@ static void shoes_plot_scatter_ticks_and_labels(cairo_t *cr, shoes_plot *plot) {
     rbsery = rb_ary_entry(plot->series, 1);
     Data_Get_Struct(rbserx, shoes_chart_series, serx);
     Data_Get_Struct(rbsery, shoes_chart_series, sery);
-    double xmax = NUM2DBL(serx->maxv);
-    double ymax = NUM2DBL(sery->maxv);
-    double xmin = NUM2DBL(serx->minv);
-    double ymin = NUM2DBL(sery->minv);
+    double xmax = shoes_chart_series_scale_max(serx);
+    double ymax = shoes_chart_series_scale_max(sery);
+    double xmin = shoes_chart_series_scale_min(serx);
+    double ymin = shoes_chart_series_scale_min(sery);
     /*
     VALUE rbxmax = rb_ary_entry(plot->maxvs, 0);
     VALUE rbymax = rb_ary_entry(plot->maxvs, 1);
@@ -221,8 +283,11 @@ void shoes_plot_scatter_draw(cairo_t *cr, shoes_place *place, shoes_plot *self_t
     shoes_plot_util_adornments(cr, place, self_t, 70);
     if (self_t->seriescnt) {
         // draw  box, ticks and x,y labels.
-        shoes_plot_scatter_ticks_and_labels(cr, self_t);
-        shoes_plot_scatter_legend(cr, self_t);
-        shoes_plot_draw_scatter_pts(cr, self_t);
+        if (PLOT_STATIC(self_t)) {
+            shoes_plot_scatter_ticks_and_labels(cr, self_t);
+            shoes_plot_scatter_legend(cr, self_t);
+        }
+        if (PLOT_DATA(self_t))
+            shoes_plot_draw_scatter_pts(cr, self_t);
     }
 }
@@ -70,7 +70,7 @@ void shoes_plot_draw_ticks_and_labels(cairo_t *cr, shoes_plot *plot) {
     double h_scale;
     int h_interval;
     h_scale = width / (double) (range -1);
-    h_interval = (int) ceil(h_padding / h_scale);
+    h_interval = max(1, (int) ceil(h_padding / h_scale));
 
     // draw x axis - labels and tick mark uses series[0]->labels[*] - assumes it's strings
     // in the array -- TODO: allow a proc to be called to create the string. at 'i'
@@ -79,26 +79,20 @@ void shoes_plot_draw_ticks_and_labels(cairo_t *cr, shoes_plot *plot) {
     shoes_chart_series *serx;
     rbxser = rb_ary_entry(plot->series, 0);
     Data_Get_Struct(rbxser, shoes_chart_series, serx);
-    VALUE xobs = serx->labels;
-    if (NIL_P(xobs) || TYPE(xobs) != T_ARRAY) rb_raise (rb_eArgError, "xobs must be an array");
+    char lblbuf[24];
 
-    for (i = 0 ; i < range; i++ ) {
+    // only every h_interval'th observation gets a tick; don't walk the rest
+    for (i = 0 ; i < range; i += h_interval) {
         int x = (int) roundl(i * h_scale);
         x += left;
         long y = bottom;
-        if ((i % h_interval) == 0) {
-            char *rawstr;
-            VALUE rbstr = rb_ary_entry(xobs, i + plot->beg_idx);
-            if (NIL_P(rbstr)) {
-                rawstr = " ";
-            } else {
-                rawstr = RSTRING_PTR(rbstr);
-            }
-            //printf("x label i: %i, x: %i, y: %i, \"%s\" %i %f \n", i, (int) x, (int) y, rawstr, h_interval, h_scale);
-            shoes_plot_draw_tick(cr, plot, x, y, VERTICALLY);
-            if (plot->chart_type == LINE_CHART || plot->chart_type == TIMESERIES_CHART)
-                shoes_plot_draw_label(cr, plot, x, y, rawstr, BELOW);
-        }
+        char *rawstr = shoes_chart_series_label(serx, i + plot->beg_idx, lblbuf, sizeof(lblbuf));
+        if (rawstr == NULL)
+            rawstr = " ";
+        //printf("x label i: %i, x: %i, y: %i, \"%s\" %i %f \n", i, (int) x, (int) y, rawstr, h_interval, h_scale);
+        shoes_plot_draw_tick(cr, plot, x, y, VERTICALLY);
+        if (plot->chart_type == LINE_CHART || plot->chart_type == TIMESERIES_CHART)
+            shoes_plot_draw_label(cr, plot, x, y, rawstr, BELOW);
     }
 
     int j;
@@ -106,8 +100,8 @@ void shoes_plot_draw_ticks_and_labels(cairo_t *cr, shoes_plot *plot) {
         VALUE rbser = rb_ary_entry(plot->series, j);
         shoes_chart_series *cs;
         Data_Get_Struct(rbser, shoes_chart_series, cs);
-        double maximum = NUM2DBL(cs->maxv);
-        double minimum = NUM2DBL(cs->minv);
+        double maximum = shoes_chart_series_scale_max(cs);
+        double minimum = shoes_chart_series_scale_min(cs);
         double v_scale = height / (maximum - minimum);
         int v_interval = (int) ceil(v_padding / v_scale);
         char tstr[16];
@@ -389,15 +383,18 @@ int shoes_plot_util_quadrant(double angle) {
 */
 void shoes_plot_util_adornments(cairo_t *cr , shoes_place *place, shoes_plot *self_t, int tweak ) {
     // draw widget box and fill with color (nearly white).
-    shoes_plot_set_cairo_default(cr, self_t);
-    shoes_plot_draw_fill(cr, self_t);
-    shoes_plot_draw_title(cr, self_t);
-    shoes_plot_draw_caption(cr, self_t);
+    if (PLOT_STATIC(self_t)) {
+        shoes_plot_set_cairo_default(cr, self_t);
+        shoes_plot_draw_fill(cr, self_t);
+        shoes_plot_draw_title(cr, self_t);
+        shoes_plot_draw_caption(cr, self_t);
+    }
+    // the data layer needs the geometry too
     self_t->graph_h = self_t->place.h - (self_t->title_h + self_t->caption_h);
     self_t->graph_y = self_t->title_h + 3;
     self_t->yaxis_offset = tweak;
     self_t->graph_w = self_t->place.w - self_t->yaxis_offset;
     self_t->graph_x = self_t->yaxis_offset;
-    if (self_t->boundbox)
+    if (self_t->boundbox && PLOT_STATIC(self_t))
         shoes_plot_draw_boundbox(cr, self_t);
 }
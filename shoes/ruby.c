@@ -690,6 +690,14 @@ VALUE shoes_log(VALUE self) {
     return shoes_world->msgs;
 }
 
+// Shoes::Worker threads call this when they have news; the worker's notified
+// method then runs on the GUI thread. A worker has at most one queued (see
+// Worker#post) and keeps itself alive until it arrives.
+VALUE shoes_notify_worker(VALUE self, VALUE worker) {
+    shoes_post_message(SHOES_WORKER_EVENT, worker, NULL, SHOES_MSG_POST);
+    return Qnil;
+}
+
 VALUE shoes_font(VALUE self, VALUE path) {
     StringValue(path);
     return shoes_load_font(RSTRING_PTR(path));
@@ -805,6 +813,8 @@ void shoes_ruby_init() {
     rb_define_method(cApp, "cache", CASTHOOK(shoes_app_get_cache), 0);
     rb_define_method(cApp, "cache=", CASTHOOK(shoes_app_set_cache), 1);
     rb_define_method(cApp, "cache_clear", CASTHOOK(shoes_app_clear_cache), 1);
+    rb_define_method(cApp, "cache_budget", CASTHOOK(shoes_app_get_cache_budget), 0);
+    rb_define_method(cApp, "cache_budget=", CASTHOOK(shoes_app_set_cache_budget), 1);
 
     cDialog = rb_define_class_under(cTypes, "Dialog", cApp);
 
@@ -828,6 +838,7 @@ void shoes_ruby_init() {
     rb_define_singleton_method(cShoes, "app", CASTHOOK(shoes_app_main), -1);
     rb_define_singleton_method(cShoes, "p", CASTHOOK(shoes_p), 1);
     rb_define_singleton_method(cShoes, "log", CASTHOOK(shoes_log), 0);
+    rb_define_singleton_method(cShoes, "notify_worker", CASTHOOK(shoes_notify_worker), 1);
     rb_define_singleton_method(cShoes, "show_console", CASTHOOK(shoes_app_console), 0); // New in 3.2.23
     rb_define_singleton_method(cShoes, "terminal", CASTHOOK(shoes_app_terminal), -1); // New in 3.3.2 replaces console
     rb_define_singleton_method(cShoes, "quit", CASTHOOK(shoes_app_quit), 0); // Shoes 3.3.2
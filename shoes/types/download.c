@@ -1,4 +1,6 @@
 #include "shoes/types/download.h"
+#include <unistd.h>
+#include <sys/stat.h>
 
 // ruby
 VALUE cDownload, cResponse;
@@ -30,6 +32,11 @@ void shoes_download_init() {
     rb_define_method(cResponse, "text", CASTHOOK(shoes_response_body), 0);
 
     RUBY_M("+download", download, -1);
+
+#if defined(SHOES_GTK) && !defined(RUBY_HTTP) && !defined(SHOES_GTK_WIN32)
+    // downloads go through the libcurl engine in shoes/http/curl.c
+    rb_define_const(cDownload, "ENGINE", rb_str_new2("curl"));
+#endif
 }
 
 // ruby (download)
@@ -103,6 +110,18 @@ int shoes_message_download(VALUE self, void *data) {
                 shoes_canvas_error(self, shoes_http_err(de->error));
             return 0;
 
+        case SHOES_HTTP_DATA: {
+                VALUE chunk = shoes_hash_get(dl->attr, rb_intern("chunk"));
+                VALUE str = rb_str_new(de->body, de->bodylen);
+                dl->transferred = de->transferred;
+                dl->total = de->total;
+                if (rb_obj_is_kind_of(chunk, rb_cProc))
+                    shoes_safe_block(dl->parent, chunk, rb_ary_new3(2, self, str));
+                else if (rb_respond_to(chunk, rb_intern("write")))
+                    rb_funcall(chunk, rb_intern("write"), 1, str);
+            }
+            return dl->state;
+
         case SHOES_HTTP_COMPLETED:
             if (de->body != NULL) rb_iv_set(dl->response, "body", rb_str_new(de->body, de->total));
     }
@@ -128,11 +147,55 @@ int shoes_message_download(VALUE self, void *data) {
     return dl->state;
 }
 
+// Runs on the download thread. Nothing here waits for the GUI thread: events
+// are posted with whatever they point into (body chunks, the finished body,
+// headers) copied along, and progress is coalesced. Abort is read straight
+// from the download below, so no handler's result is needed.
 int shoes_doth_handler(shoes_http_event *de, void *data) {
     shoes_doth_data *doth = (shoes_doth_data *)data;
-    shoes_http_event *de2 = SHOE_ALLOC(shoes_http_event);
-    SHOE_MEMCPY(de2, de, shoes_http_event, 1);
-    return shoes_throw_message(SHOES_THREAD_DOWNLOAD, doth->download, de2);
+    shoes_http_klass *dl;
+    shoes_http_event *de2;
+
+    switch (de->stage) {
+        case SHOES_HTTP_DATA:
+        case SHOES_HTTP_COMPLETED: {
+                unsigned long long len = 0;
+                if (de->body != NULL)
+                    len = de->stage == SHOES_HTTP_DATA ? de->bodylen : de->total;
+                de2 = (shoes_http_event *)malloc(sizeof(shoes_http_event) + len);
+                SHOE_MEMCPY(de2, de, shoes_http_event, 1);
+                if (de->body != NULL) {
+                    char *body = (char *)(de2 + 1);
+                    SHOE_MEMCPY(body, de->body, char, len);
+                    de2->body = body;
+                }
+                shoes_post_message(SHOES_THREAD_DOWNLOAD, doth->download, de2, SHOES_MSG_POST);
+            }
+            break;
+
+        case SHOES_HTTP_HEADER: {
+                char *str;
+                de2 = (shoes_http_event *)malloc(sizeof(shoes_http_event) + de->hkeylen + de->hvallen);
+                SHOE_MEMCPY(de2, de, shoes_http_event, 1);
+                str = (char *)(de2 + 1);
+                SHOE_MEMCPY(str, de->hkey, char, de->hkeylen);
+                SHOE_MEMCPY(str + de->hkeylen, de->hval, char, de->hvallen);
+                de2->hkey = str;
+                de2->hval = str + de->hkeylen;
+                shoes_post_message(SHOES_THREAD_DOWNLOAD, doth->download, de2, SHOES_MSG_POST);
+            }
+            break;
+
+        default:
+            de2 = SHOE_ALLOC(shoes_http_event);
+            SHOE_MEMCPY(de2, de, shoes_http_event, 1);
+            shoes_post_message(SHOES_THREAD_DOWNLOAD, doth->download, de2,
+                               de->stage == SHOES_HTTP_TRANSFER ? SHOES_MSG_COALESCE : SHOES_MSG_POST);
+    }
+
+    // abort is set on the GUI thread, checking it here is enough to stop
+    Data_Get_Struct(doth->download, shoes_http_klass, dl);
+    return dl->state;
 }
 
 void shoes_http_request_free(shoes_http_request *req) {
@@ -145,6 +208,7 @@ void shoes_http_request_free(shoes_http_request *req) {
     if (req->body != NULL) free(req->body);
     if (req->headers != NULL) shoes_http_headers_free(req->headers);
     if (req->mem != NULL) free(req->mem);
+    if (req->flags & SHOES_DL_UPLOAD_FD) close(req->upload_fd);
 }
 
 VALUE shoes_http_threaded(VALUE self, VALUE url, VALUE attr) {
@@ -152,6 +216,29 @@ VALUE shoes_http_threaded(VALUE self, VALUE url, VALUE attr) {
     GET_STRUCT(canvas, self_t);
     char *url_string = NULL;
 
+    // :upload_io can raise, so it is settled before anything is allocated
+    int upload_fd = -1;
+    LONG_LONG upload_size = -1;
+    VALUE upload = shoes_hash_get(attr, rb_intern("upload_io"));
+    if (!NIL_P(upload)) {
+        struct stat st;
+        int fd;
+        if (!rb_respond_to(upload, rb_intern("fileno")))
+            rb_raise(rb_eArgError, "download :upload_io needs an IO with a file descriptor");
+        fd = NUM2INT(rb_funcall(upload, rb_intern("fileno"), 0));
+        // the descriptor is read directly, so put it where Ruby's buffered
+        // pos says the IO is (seeking also flushes any pending writes)
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+            rb_funcall(upload, rb_intern("seek"), 1, rb_funcall(upload, rb_intern("pos"), 0));
+        else if (rb_respond_to(upload, rb_intern("flush")))
+            rb_funcall(upload, rb_intern("flush"), 0);
+        upload_fd = dup(fd);
+        if (upload_fd < 0)
+            rb_raise(rb_eArgError, "download :upload_io can't be read");
+        if (fstat(upload_fd, &st) == 0 && S_ISREG(st.st_mode))
+            upload_size = st.st_size - lseek(upload_fd, 0, SEEK_CUR);
+    }
+
     if (!rb_respond_to(url, s_host)) {
         url_string = strdup(RSTRING_PTR(url));
         url = rb_funcall(rb_mKernel, s_URI, 1, url);
@@ -192,8 +279,24 @@ VALUE shoes_http_threaded(VALUE self, VALUE url, VALUE attr) {
     if (!NIL_P(method))  req->method = strdup(RSTRING_PTR(method));
     if (!NIL_P(headers)) req->headers = shoes_http_headers(headers);
 
+    VALUE priority = shoes_hash_get(attr, rb_intern("priority"));
+    req->priority = SHOES_HTTP_PRIORITY_NORMAL;
+    if (priority == ID2SYM(rb_intern("high")))
+        req->priority = SHOES_HTTP_PRIORITY_VISIBLE;
+    else if (priority == ID2SYM(rb_intern("low")))
+        req->priority = SHOES_HTTP_PRIORITY_LOW;
+
+    if (upload_fd >= 0) {
+        req->upload_fd = upload_fd;
+        req->upload_size = upload_size;
+        req->flags |= SHOES_DL_UPLOAD_FD;
+    }
+
     VALUE save = ATTR(attr, save);
-    if (req->method == NULL || strcmp(req->method, "HEAD") != 0) {
+    VALUE chunk = shoes_hash_get(attr, rb_intern("chunk"));
+    if (NIL_P(save) && !NIL_P(chunk)) {
+        req->flags |= SHOES_DL_STREAM;
+    } else if (req->method == NULL || strcmp(req->method, "HEAD") != 0) {
         if (NIL_P(save)) {
             req->mem = SHOE_ALLOC_N(char, SHOES_BUFSIZE);
             req->memlen = SHOES_BUFSIZE;
@@ -257,6 +360,17 @@ VALUE shoes_response_status(VALUE self) {
  */ 
 extern void shoes_cache_delete(char *); // in image.c
 
+// on_* blocks can raise more than the StandardError Worker#call rescues,
+// and nothing may unwind out of the message dispatch
+static VALUE shoes_worker_notified(VALUE worker) {
+    return rb_funcall(worker, rb_intern("notified"), 0);
+}
+
+static VALUE shoes_worker_exception(VALUE worker, VALUE e) {
+    shoes_canvas_error(worker, e);
+    return Qnil;
+}
+
 int shoes_catch_message(unsigned int name, VALUE obj, void *data) {
     int ret = SHOES_DOWNLOAD_CONTINUE;
     switch (name) {
@@ -264,23 +378,40 @@ int shoes_catch_message(unsigned int name, VALUE obj, void *data) {
         ret = shoes_message_download(obj, data);
         free(data);
         break;
+      case SHOES_WORKER_EVENT:
+        rb_rescue2(CASTHOOK(shoes_worker_notified), obj,
+                   CASTHOOK(shoes_worker_exception), obj, rb_cObject, 0);
+        break;
+      case SHOES_SVG_PARSED:
+        shoes_svgdoc_parsed((shoes_svgdoc *)data);
+        break;
+      case SHOES_TILE_DECODED:
+        shoes_tiled_image_decoded(data);
+        break;
       case SHOES_IMAGE_DOWNLOAD: {
-        VALUE hash, etag = Qnil, uri, uext, path, realpath;
+        VALUE hash, etag = Qnil, uri, realpath;
         shoes_image_download_event *side = (shoes_image_download_event *)data;
         if (shoes_image_downloaded(side)) {
             shoes_canvas_repaint_all(side->slot);
-            path = rb_str_new2(side->filepath);
             uri = rb_str_new2(side->uripath);
             hash = rb_str_new2(side->hexdigest);
             if (side->etag != NULL)
               etag = rb_str_new2(side->etag);
             if (shoes_cache_setting) {
-              uext = rb_funcall(rb_cFile, rb_intern("extname"), 1, path);
-              rb_funcall(rb_const_get(rb_cObject, rb_intern("DATABASE")),
-                     rb_intern("notify_cache_of"), 3, uri, etag, hash);
-              if (side->status != 304) {
-                realpath = rb_funcall(cShoes, rb_intern("image_cache_path"), 2, hash, uext);
-                rename(side->filepath, RSTRING_PTR(realpath));
+              if (side->hexdigest[0] != '\0') {
+                struct stat st;
+                VALUE size = Qnil;
+                if (stat(side->filepath, &st) == 0)
+                  size = LL2NUM(st.st_size);
+                // the index names the file after the url's extension, not the temp file's
+                realpath = rb_funcall(rb_const_get(rb_cObject, rb_intern("DATABASE")),
+                       rb_intern("notify_cache_of"), 4, uri, etag, hash, size);
+                if (side->status != 304) {
+                  if (NIL_P(realpath))
+                    unlink(side->filepath);
+                  else
+                    rename(side->filepath, RSTRING_PTR(realpath));
+                }
               }
             } else {
 				// remove from cache - crash 
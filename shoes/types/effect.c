@@ -18,8 +18,11 @@ void shoes_effect_init() {
 VALUE shoes_effect_draw(VALUE self, VALUE c, VALUE actual) {
     SETUP_DRAWING(shoes_effect, REL_TILE, canvas->width, canvas->height);
 
-    if (RTEST(actual) && self_t->filter != NULL)
-        self_t->filter(CCR(canvas), self_t->attr, &self_t->place);
+    if (RTEST(actual) && self_t->filter != NULL) {
+        shoes_place region;
+        if (shoes_effect_region(self, self_t, canvas, &region))
+            self_t->filter(CCR(canvas), self_t->attr, &region, &self_t->cache);
+    }
 
     self_t->place = place;
     return self;
@@ -57,6 +60,8 @@ void shoes_effect_mark(shoes_effect *fx) {
 }
 
 void shoes_effect_free(shoes_effect *fx) {
+    if (fx->cache.result != NULL)
+        cairo_surface_destroy(fx->cache.result);
     RUBY_CRITICAL(free(fx));
 }
 
@@ -76,7 +81,8 @@ VALUE shoes_add_effect(VALUE self, ID name, VALUE attr) {
         shoes_effect_filter filter = shoes_effect_for_type(name);
         SETUP_IMAGE();
         if (filter == NULL) return self;
-        filter(image->cr, attr, &place);
+        shoes_effect_full_region(image->cr, &place);
+        filter(image->cr, attr, &place, NULL);
         return self;
     }
 
@@ -102,53 +108,143 @@ VALUE shoes_canvas_shadow(int argc, VALUE *argv, VALUE self) {
 
 // shoes/effect.c
 
-static unsigned char *box_run(unsigned int size) {
+#define BOX_H 1
+#define BOX_V 2
+
+// below this many pixels a pass isn't worth handing to the pool
+#define BLUR_MIN_PARALLEL (256 * 256)
+#define BLUR_RUNS 6
+
+// Scratch space is kept between paints, blurs happen on the GUI thread only.
+static unsigned char *blur_tmp = NULL;
+static unsigned int blur_tmp_len = 0;
+static GThreadPool *blur_pool = NULL;
+
+#ifndef __SSE2__
+static struct {
+    unsigned int size;
+    unsigned char *run;
+} blur_runs[BLUR_RUNS];
+static int blur_runs_next = 0;
+
+// lookup from a box sum to its average, one table per box size
+static const unsigned char *box_run(unsigned int size) {
     int i;
-    unsigned char *tmp = SHOE_ALLOC_N(unsigned char, size * 256);
+    unsigned char *tmp;
+    for (i = 0; i < BLUR_RUNS; i++)
+        if (blur_runs[i].run != NULL && blur_runs[i].size == size)
+            return blur_runs[i].run;
+
+    tmp = blur_runs[blur_runs_next].run;
+    if (tmp != NULL) SHOE_FREE(tmp);
+    tmp = SHOE_ALLOC_N(unsigned char, size * 256);
     for (i = 0; i < 256; i++)
         memset(tmp + i * size, i, size);
+    blur_runs[blur_runs_next].size = size;
+    blur_runs[blur_runs_next].run = tmp;
+    blur_runs_next = (blur_runs_next + 1) % BLUR_RUNS;
     return tmp;
 }
+#endif
 
-#define BOX_H 1
-#define BOX_V 2
+static unsigned char *blur_scratch(unsigned int len) {
+    if (len > blur_tmp_len) {
+        if (blur_tmp != NULL) SHOE_FREE(blur_tmp);
+        blur_tmp = SHOE_ALLOC_N(unsigned char, len);
+        blur_tmp_len = len;
+    }
+    return blur_tmp;
+}
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+// all four channels of one pixel as 32 bit lanes
+static inline __m128i box_px(const unsigned char *p) {
+    int v;
+    __m128i zero = _mm_setzero_si128();
+    memcpy(&v, p, 4);
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+}
+#endif
 
+// Blur lines from..to (rows for BOX_H, columns for BOX_V) of place.
 static void box_blur(unsigned char *in, unsigned char *out,
                      int stride, shoes_place *place,
                      unsigned int edge1, unsigned int edge2,
-                     const unsigned char *run, int dir) {
-    int i, j1, j2, l = 0, l2, l3, l4, lx = 0, c1, c2, c3, c4, start;
+                     const unsigned char *run, int dir, int from, int to) {
+    int i, j1, j2, l = 0, l2, l3, l4, lx = 0, c3, c4, start;
     int boxSize = edge1 + edge2 + 1;
     if (dir == BOX_H) {
-        c1 = place->y;
-        c2 = place->y + place->h;
         c3 = place->x;
         c4 = place->x + place->w;
     } else {
-        c1 = place->x;
-        c2 = place->x + place->w;
         c3 = place->y;
         c4 = place->y + place->h;
     }
 
+#ifdef __SSE2__
+    const __m128 inv = _mm_set1_ps(1.0f / boxSize);
+    const __m128 half = _mm_set1_ps(0.5f);
+#endif
+
     start = c3 - edge1;
-    for (j1 = c1; j1 < c2; j1++) {
-        unsigned int sums[4] = {0, 0, 0, 0};
+    for (j1 = from; j1 < to; j1++) {
         if (dir == BOX_H)
             l = stride * j1;
         else
             lx = j1 << 2;
+#ifdef __SSE2__
+        __m128i sums = _mm_setzero_si128();
+        for (i = 0; i < boxSize; i++) {
+            int pos = start + i;
+            pos = max(pos, c3);
+            pos = min(pos, c4 - 1);
+            sums = _mm_add_epi32(sums, box_px(in + (dir == BOX_H ? l + (pos << 2) : stride * pos + lx)));
+        }
+        for (j2 = c3; j2 < c4; j2++) {
+            __m128i avg;
+            int v;
+            if (dir == BOX_H)
+                l2 = l + (j2 << 2);
+            else
+                l2 = stride * j2 + lx;
+            // (sum + 0.5) / size truncated is the same floor the run tables gave
+            avg = _mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(sums), half), inv));
+            avg = _mm_packs_epi32(avg, avg);
+            avg = _mm_packus_epi16(avg, avg);
+            v = _mm_cvtsi128_si32(avg);
+            memcpy(out + l2, &v, 4);
+
+            int tmp = j2 - edge1;
+            int last = max(tmp, c3);
+            int next = min(tmp + boxSize, c4 - 1);
+            if (dir == BOX_H) {
+                l3 = l + (next << 2);
+                l4 = l + (last << 2);
+            } else {
+                l3 = stride * next + lx;
+                l4 = stride * last + lx;
+            }
+            sums = _mm_add_epi32(sums, _mm_sub_epi32(box_px(in + l3), box_px(in + l4)));
+        }
+#else
+        unsigned int sums[4] = {0, 0, 0, 0};
         for (i = 0; i < boxSize; i++) {
             int pos = start + i;
             pos = max(pos, c3);
             pos = min(pos, c4 - 1);
             if (dir == BOX_V)
                 l = stride * pos + lx;
+            else
+                l = stride * j1 + (pos << 2);
             sums[0] += in[l];
             sums[1] += in[l + 1];
             sums[2] += in[l + 2];
             sums[3] += in[l + 3];
         }
+        if (dir == BOX_H)
+            l = stride * j1;
         for (j2 = c3; j2 < c4; j2++) {
             if (dir == BOX_H)
                 l2 = l + (j2 << 2);
@@ -175,83 +271,380 @@ static void box_blur(unsigned char *in, unsigned char *out,
             sums[2] += in[l3 + 2] - in[l4 + 2];
             sums[3] += in[l3 + 3] - in[l4 + 3];
         }
+#endif
     }
 }
 
-void shoes_gaussian_blur_filter(cairo_t *cr, VALUE attr, shoes_place *place) {
-    double blur_d = ATTR2(dbl, attr, radius, 2.);
-    double blur_x = blur_d, blur_y = blur_d;
+//
+// A pass is split into bands of rows (horizontal) or columns (vertical)
+// handed to a GLib thread pool. The GUI thread takes the last band itself
+// and waits for the others.
+//
+typedef struct {
+    GMutex lock;
+    GCond done;
+    int pending;
+} box_blur_batch;
+
+typedef struct {
+    box_blur_batch *batch;
+    unsigned char *in, *out;
+    int stride;
+    shoes_place *place;
+    unsigned int edge1, edge2;
+    const unsigned char *run;
+    int dir, from, to;
+} box_blur_job;
+
+static void box_blur_worker(gpointer data, gpointer user_data) {
+    box_blur_job *job = (box_blur_job *)data;
+    box_blur(job->in, job->out, job->stride, job->place, job->edge1, job->edge2,
+             job->run, job->dir, job->from, job->to);
+    g_mutex_lock(&job->batch->lock);
+    if (--job->batch->pending == 0)
+        g_cond_signal(&job->batch->done);
+    g_mutex_unlock(&job->batch->lock);
+}
+
+static void box_blur_pass(unsigned char *in, unsigned char *out,
+                          int stride, shoes_place *place,
+                          unsigned int edge1, unsigned int edge2, int dir) {
+    const unsigned char *run = NULL;
+    int c1, c2, n = 1, k, band;
+#ifndef __SSE2__
+    run = box_run(edge1 + edge2 + 1);
+#endif
+    if (dir == BOX_H) {
+        c1 = place->y;
+        c2 = place->y + place->h;
+    } else {
+        c1 = place->x;
+        c2 = place->x + place->w;
+    }
 
-    RAW_FILTER_START(place);
-    if (blur_x < 0 || blur_y < 0)
+    if (place->w * place->h >= BLUR_MIN_PARALLEL) {
+        if (blur_pool == NULL)
+            blur_pool = g_thread_pool_new(box_blur_worker, NULL,
+                                          max(1, (int)g_get_num_processors() - 1), FALSE, NULL);
+        if (blur_pool != NULL)
+            n = g_thread_pool_get_max_threads(blur_pool) + 1;
+    }
+    if (n <= 1 || c2 - c1 < n) {
+        box_blur(in, out, stride, place, edge1, edge2, run, dir, c1, c2);
         return;
+    }
+
+    box_blur_batch batch;
+    box_blur_job *jobs = SHOE_ALLOC_N(box_blur_job, n);
+    g_mutex_init(&batch.lock);
+    g_cond_init(&batch.done);
+    batch.pending = n - 1;
+    band = (c2 - c1 + n - 1) / n;
+    for (k = 0; k < n; k++) {
+        box_blur_job *job = &jobs[k];
+        job->batch = &batch;
+        job->in = in;
+        job->out = out;
+        job->stride = stride;
+        job->place = place;
+        job->edge1 = edge1;
+        job->edge2 = edge2;
+        job->run = run;
+        job->dir = dir;
+        job->from = min(c2, c1 + k * band);
+        job->to = min(c2, c1 + (k + 1) * band);
+        if (k < n - 1)
+            g_thread_pool_push(blur_pool, job, NULL);
+    }
+    box_blur(in, out, stride, place, edge1, edge2, run, dir, jobs[n - 1].from, jobs[n - 1].to);
+
+    g_mutex_lock(&batch.lock);
+    while (batch.pending > 0)
+        g_cond_wait(&batch.done, &batch.lock);
+    g_mutex_unlock(&batch.lock);
+    g_mutex_clear(&batch.lock);
+    g_cond_clear(&batch.done);
+    SHOE_FREE(jobs);
+}
+
+//
+// Effects only work on a region of the target: the elements drawn before
+// them in the same slot, grown by as far as the effect spreads. Big radii
+// are blurred on a copy shrunk by a power of two and scaled back up, the
+// result is all low frequencies anyway.
+//
+#define EFFECT_DOWNSAMPLE_RADIUS 8.
+#define EFFECT_DOWNSAMPLE_MAX    8
+
+// three box passes of about 1.88 * radius each
+static int shoes_effect_reach(double radius) {
+    return (int)ceil(radius * 3.) + 1;
+}
+
+static int shoes_effect_scale(double radius) {
+    int scale = 1;
+    while (scale < EFFECT_DOWNSAMPLE_MAX && radius / scale > EFFECT_DOWNSAMPLE_RADIUS)
+        scale <<= 1;
+    return scale;
+}
+
+void shoes_effect_full_region(cairo_t *cr, shoes_place *region) {
+    cairo_surface_t *surface = cairo_get_target(cr);
+    region->x = region->y = 0;
+    region->w = cairo_image_surface_get_width(surface);
+    region->h = cairo_image_surface_get_height(surface);
+}
+
+// returns 0 if there is nothing under the effect
+int shoes_effect_region(VALUE self, shoes_effect *fx, shoes_canvas *canvas, shoes_place *region) {
+    long i;
+    int found = 0, grow;
+    double x1 = 0., y1 = 0., x2 = 0., y2 = 0.;
+    cairo_t *cr = CCR(canvas);
+    shoes_place full;
+
+    for (i = 0; i < RARRAY_LEN(canvas->contents); i++) {
+        int k;
+        shoes_element *element;
+        VALUE ele = rb_ary_entry(canvas->contents, i);
+        if (ele == self) break;
+        if (!shoes_is_element(ele) || RDATA(ele)->dmark == shoes_effect_mark) continue;
+        Data_Get_Struct(ele, shoes_element, element);
+        if (element->place.w <= 0 || element->place.h <= 0) continue;
+
+        for (k = 0; k < 4; k++) {
+            double x = element->place.x + element->place.dx + ((k & 1) ? element->place.w : 0);
+            double y = element->place.y + element->place.dy + ((k & 2) ? element->place.h : 0);
+            cairo_user_to_device(cr, &x, &y);
+            if (!found) {
+                x1 = x2 = x;
+                y1 = y2 = y;
+                found = 1;
+            }
+            x1 = min(x1, x);
+            y1 = min(y1, y);
+            x2 = max(x2, x);
+            y2 = max(y2, y);
+        }
+    }
+    if (!found) return 0;
+
+    // same defaults as the filters, a shadow is 4px off unless told otherwise
+    grow = shoes_effect_reach(ATTR2(dbl, fx->attr, radius, 2.)) +
+           abs(ATTR2(int, fx->attr, distance, fx->filter == shoes_shadow_filter ? 4 : 0)) +
+           max(abs(ATTR2(int, fx->attr, displace_left, 0)), abs(ATTR2(int, fx->attr, displace_top, 0)));
+    shoes_effect_full_region(cr, &full);
+    region->x = max(0, (int)floor(x1) - grow);
+    region->y = max(0, (int)floor(y1) - grow);
+    region->w = min(full.w, (int)ceil(x2) + grow) - region->x;
+    region->h = min(full.h, (int)ceil(y2) + grow) - region->y;
+    return region->w > 0 && region->h > 0;
+}
+
+// a copy of the region of source, offset by (dx, dy) and shrunk by scale
+static cairo_surface_t *shoes_effect_grab(cairo_surface_t *source, shoes_place *region,
+                                          int scale, int dx, int dy) {
+    cairo_surface_t *layer = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                             (region->w + scale - 1) / scale, (region->h + scale - 1) / scale);
+    cairo_t *cr = cairo_create(layer);
+    cairo_scale(cr, 1. / scale, 1. / scale);
+    cairo_set_source_surface(cr, source, dx - region->x, dy - region->y);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+    return layer;
+}
+
+// paints an effect result back over its region, scaled up again
+static void shoes_effect_paint(cairo_t *cr, cairo_surface_t *result, shoes_place *region,
+                               int scale, cairo_operator_t op, int clear) {
+    cairo_save(cr);
+    cairo_identity_matrix(cr);
+    cairo_rectangle(cr, region->x, region->y, region->w, region->h);
+    cairo_clip(cr);
+    if (clear) {
+        cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+        cairo_paint(cr);
+    }
+    cairo_set_operator(cr, op);
+    cairo_translate(cr, region->x, region->y);
+    cairo_scale(cr, scale, scale);
+    cairo_set_source_surface(cr, result, 0, 0);
+    cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_PAD);
+    if (scale > 1)
+        cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_BILINEAR);
+    cairo_paint(cr);
+    cairo_restore(cr);
+}
+
+//
+// Effect cache. The version of a layer is a hash of the pixels the effect
+// reads mixed with its attributes and region. Hashing is one linear read,
+// far cheaper than blurring, so when nothing under an effect changed we
+// just composite the last result again. The steps are xxHash64's tail
+// steps, which mix every bit of a word into the whole hash.
+//
+#define FX_P1 11400714785092567825ULL
+#define FX_P2 14029467366897019727ULL
+#define FX_P3 1609587929392839161ULL
+#define FX_P4 9650029242287828579ULL
+#define FX_ROTL(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline unsigned long long shoes_effect_mix(unsigned long long h, unsigned long long v) {
+    v *= FX_P2;
+    v = FX_ROTL(v, 31) * FX_P1;
+    h ^= v;
+    return FX_ROTL(h, 27) * FX_P1 + FX_P4;
+}
+
+static unsigned long long shoes_effect_version(cairo_surface_t *source, shoes_place *region, VALUE attr) {
+    int y, stride;
+    unsigned long long h = FX_P1 + FX_P2;
+    unsigned char *data;
+
+    cairo_surface_flush(source);
+    data = cairo_image_surface_get_data(source);
+    stride = cairo_image_surface_get_stride(source);
+
+    for (y = region->y; y < region->y + region->h; y++) {
+        const unsigned char *row = data + (size_t)y * stride + region->x * 4;
+        int x, n = (region->w * 4) / 8;
+        for (x = 0; x < n; x++) {
+            unsigned long long v;
+            memcpy(&v, row + x * 8, 8);
+            h = shoes_effect_mix(h, v);
+        }
+        if (region->w & 1) {
+            unsigned int v;
+            memcpy(&v, row + n * 8, 4);
+            h ^= (unsigned long long)v * FX_P1;
+            h = FX_ROTL(h, 23) * FX_P2 + FX_P3;
+        }
+    }
+    h = shoes_effect_mix(h, (unsigned long long)NUM2LONG(rb_hash(attr)));
+    h = shoes_effect_mix(h, ((unsigned long long)region->x << 32) | (unsigned int)region->y);
+    h = shoes_effect_mix(h, ((unsigned long long)region->w << 32) | (unsigned int)region->h);
+    h ^= h >> 33;
+    h *= FX_P2;
+    h ^= h >> 29;
+    h *= FX_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+// the cached result if still good, NULL otherwise (after noting the new
+// version and dropping the stale result)
+static cairo_surface_t *shoes_effect_cache_get(shoes_effect_cache *cache, cairo_surface_t *source,
+                                               shoes_place *region, VALUE attr) {
+    unsigned long long version;
+    if (cache == NULL) return NULL;
+    version = shoes_effect_version(source, region, attr);
+    if (cache->result != NULL && cache->version == version)
+        return cache->result;
+    if (cache->result != NULL) {
+        cairo_surface_destroy(cache->result);
+        cache->result = NULL;
+    }
+    cache->version = version;
+    return NULL;
+}
+
+static void shoes_effect_cache_put(shoes_effect_cache *cache, cairo_surface_t *result) {
+    if (cache == NULL) return;
+    if (cache->result != NULL) cairo_surface_destroy(cache->result);
+    cache->result = cairo_surface_reference(result);
+}
+
+// returns a new surface with a blurred copy of the whole of source
+static cairo_surface_t *shoes_blur_surface(cairo_surface_t *source, double radius) {
+    shoes_place whole, *place = &whole;
+    double blur_x = radius, blur_y = radius;
+
+    cairo_surface_flush(source);
+    RAW_FILTER_START(source, place);
     if (blur_x == 0 || blur_y == 0)
         memset(out, 0, len);
     unsigned int dX, dY;
     dX = (unsigned int) floor(blur_x * 3*sqrt(2*SHOES_PI)/4 + 0.5);
     dY = (unsigned int) floor((blur_y * 3*sqrt(2*SHOES_PI)/4) + 0.5);
 
-    unsigned char *tmp = SHOE_ALLOC_N(unsigned char, len);
+    unsigned char *tmp = blur_scratch(len);
 
     if (dX & 1) {    // odd dX
-        unsigned char *run = box_run(2 * (dX / 2) + 1);
-        box_blur(in, tmp,  stride, place, dX/2, dX/2, run, BOX_H);
-        box_blur(tmp, out, stride, place, dX/2, dX/2, run, BOX_H);
-        box_blur(out, tmp, stride, place, dX/2, dX/2, run, BOX_H);
-        SHOE_FREE(run);
+        box_blur_pass(in, tmp,  stride, place, dX/2, dX/2, BOX_H);
+        box_blur_pass(tmp, out, stride, place, dX/2, dX/2, BOX_H);
+        box_blur_pass(out, tmp, stride, place, dX/2, dX/2, BOX_H);
     } else {        // even dX
         if (dX == 0) {
             memcpy(tmp, in, len);
         } else {
-            unsigned char *run1 = box_run(2 * (dX / 2) + 1);
-            unsigned char *run2 = box_run(2 * (dX / 2));
-            box_blur(in, tmp,  stride, place, dX/2,     dX/2 - 1, run2, BOX_H);
-            box_blur(tmp, out, stride, place, dX/2 - 1, dX/2,     run2, BOX_H);
-            box_blur(out, tmp, stride, place, dX/2,     dX/2,     run1, BOX_H);
-            SHOE_FREE(run1);
-            SHOE_FREE(run2);
+            box_blur_pass(in, tmp,  stride, place, dX/2,     dX/2 - 1, BOX_H);
+            box_blur_pass(tmp, out, stride, place, dX/2 - 1, dX/2,     BOX_H);
+            box_blur_pass(out, tmp, stride, place, dX/2,     dX/2,     BOX_H);
         }
     }
     if (dY & 1) {
-        unsigned char *run = box_run(2 * (dY / 2) + 1);
-        box_blur(tmp, out, stride, place, dY/2, dY/2, run, BOX_V);
-        box_blur(out, tmp, stride, place, dY/2, dY/2, run, BOX_V);
-        box_blur(tmp, out, stride, place, dY/2, dY/2, run, BOX_V);
-        SHOE_FREE(run);
+        box_blur_pass(tmp, out, stride, place, dY/2, dY/2, BOX_V);
+        box_blur_pass(out, tmp, stride, place, dY/2, dY/2, BOX_V);
+        box_blur_pass(tmp, out, stride, place, dY/2, dY/2, BOX_V);
     } else {
         if (dY == 0) {
             memcpy(out, tmp, len);
         } else {
-            unsigned char *run1 = box_run(2 * (dY / 2) + 1);
-            unsigned char *run2 = box_run(2 * (dY / 2));
-            box_blur(tmp, out, stride, place, dY/2,     dY/2 - 1, run2, BOX_V);
-            box_blur(out, tmp, stride, place, dY/2 - 1, dY/2,     run2, BOX_V);
-            box_blur(tmp, out, stride, place, dY/2,     dY/2,     run1, BOX_V);
-            SHOE_FREE(run1);
-            SHOE_FREE(run2);
+            box_blur_pass(tmp, out, stride, place, dY/2,     dY/2 - 1, BOX_V);
+            box_blur_pass(out, tmp, stride, place, dY/2 - 1, dY/2,     BOX_V);
+            box_blur_pass(tmp, out, stride, place, dY/2,     dY/2,     BOX_V);
         }
     }
 
-    SHOE_FREE(tmp);
-    RAW_FILTER_END();
+    cairo_surface_mark_dirty(target);
+    return target;
+}
+
+void shoes_gaussian_blur_filter(cairo_t *cr, VALUE attr, shoes_place *place, shoes_effect_cache *cache) {
+    double radius = ATTR2(dbl, attr, radius, 2.);
+    int scale = shoes_effect_scale(radius);
+    cairo_surface_t *source = cairo_get_target(cr);
+    cairo_surface_t *target, *layer;
+
+    if (radius < 0) return;
+    target = shoes_effect_cache_get(cache, source, place, attr);
+    if (target != NULL) {
+        shoes_effect_paint(cr, target, place, scale, CAIRO_OPERATOR_OVER, 1);
+        return;
+    }
+
+    layer = shoes_effect_grab(source, place, scale, 0, 0);
+    target = shoes_blur_surface(layer, radius / scale);
+    cairo_surface_destroy(layer);
+    shoes_effect_cache_put(cache, target);
+    shoes_effect_paint(cr, target, place, scale, CAIRO_OPERATOR_OVER, 1);
+    cairo_surface_destroy(target);
 }
 
 static void shoes_layer_blur_filter(cairo_t *cr, VALUE attr, shoes_place *place,
-                                    cairo_operator_t blur_op, cairo_operator_t merge_op, int distance) {
+                                    cairo_operator_t blur_op, cairo_operator_t merge_op, int distance,
+                                    shoes_effect_cache *cache) {
+    double radius = ATTR2(dbl, attr, radius, 2.);
+    int scale = shoes_effect_scale(radius);
     cairo_surface_t *source = cairo_get_target(cr);
-    int width  = cairo_image_surface_get_width(source);
-    int height = cairo_image_surface_get_height(source);
+    cairo_surface_t *blurred, *target;
+
+    if (radius < 0) return;
+    blurred = shoes_effect_cache_get(cache, source, place, attr);
+    if (blurred != NULL) {
+        shoes_effect_paint(cr, blurred, place, scale, merge_op, 0);
+        return;
+    }
+
     VALUE fill = ATTR(attr, fill);
     int dx = ATTR2(int, attr, displace_left, 0);
     int dy = ATTR2(int, attr, displace_top, 0);
 
-    cairo_surface_t *target = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
-    cairo_t *cr2 = cairo_create(target);
     if (dx != 0 || dy != 0)
-        cairo_set_source_surface(cr2, source, dx, dy);
+        target = shoes_effect_grab(source, place, scale, dx, dy);
     else
-        cairo_set_source_surface(cr2, source, distance, distance);
-    cairo_paint(cr2);
+        target = shoes_effect_grab(source, place, scale, distance, distance);
+    cairo_t *cr2 = cairo_create(target);
     cairo_set_operator(cr2, blur_op);
     if (NIL_P(fill))
         cairo_set_source_rgb(cr2, 0., 0., 0.);
@@ -262,28 +655,31 @@ static void shoes_layer_blur_filter(cairo_t *cr, VALUE attr, shoes_place *place,
     } else {
         shoes_pattern *pattern;
         Data_Get_Struct(fill, shoes_pattern, pattern);
+        cairo_scale(cr2, 1. / scale, 1. / scale);
+        cairo_translate(cr2, -place->x, -place->y);
         cairo_set_source(cr2, PATTERN(pattern));
     }
-    cairo_rectangle(cr2, 0, 0, width, height);
     cairo_paint(cr2);
-    shoes_gaussian_blur_filter(cr2, attr, place);
-    cairo_set_operator(cr, merge_op);
-    cairo_set_source_surface(cr, target, 0, 0);
-    cairo_paint(cr);
     cairo_destroy(cr2);
+
+    blurred = shoes_blur_surface(target, radius / scale);
+    cairo_surface_destroy(target);
+    shoes_effect_cache_put(cache, blurred);
+    shoes_effect_paint(cr, blurred, place, scale, merge_op, 0);
+    cairo_surface_destroy(blurred);
 }
 
-void shoes_shadow_filter(cairo_t *cr, VALUE attr, shoes_place *place) {
+void shoes_shadow_filter(cairo_t *cr, VALUE attr, shoes_place *place, shoes_effect_cache *cache) {
     int distance = ATTR2(int, attr, distance, 4);
-    shoes_layer_blur_filter(cr, attr, place, CAIRO_OPERATOR_IN, CAIRO_OPERATOR_DEST_OVER, distance);
+    shoes_layer_blur_filter(cr, attr, place, CAIRO_OPERATOR_IN, CAIRO_OPERATOR_DEST_OVER, distance, cache);
 }
 
-void shoes_glow_filter(cairo_t *cr, VALUE attr, shoes_place *place) {
+void shoes_glow_filter(cairo_t *cr, VALUE attr, shoes_place *place, shoes_effect_cache *cache) {
     cairo_operator_t blur_op = CAIRO_OPERATOR_IN;
     cairo_operator_t merge_op = CAIRO_OPERATOR_DEST_OVER;
     if (RTEST(ATTR(attr, inner))) {
         blur_op = CAIRO_OPERATOR_OUT;
         merge_op = CAIRO_OPERATOR_ATOP;
     }
-    shoes_layer_blur_filter(cr, attr, place, blur_op, merge_op, 0);
+    shoes_layer_blur_filter(cr, attr, place, blur_op, merge_op, 0, cache);
 }
@@ -13,22 +13,30 @@
 extern VALUE cShoes, cApp, cTypes, cCanvas, cWidget;
 extern shoes_app _shoes_app;
 
-typedef void (*shoes_effect_filter)(cairo_t *, VALUE attr, shoes_place *);
+// The last result of an effect, reused for as long as the pixels under
+// it and its attributes stay the same (same version).
+typedef struct {
+    cairo_surface_t *result;
+    unsigned long long version;
+} shoes_effect_cache;
+
+// filters work on the region given in place, in device pixels
+typedef void (*shoes_effect_filter)(cairo_t *, VALUE attr, shoes_place *, shoes_effect_cache *);
 
 typedef struct {
     VALUE parent;
     VALUE attr;
     shoes_place place;
     shoes_effect_filter filter;
+    shoes_effect_cache cache;
 } shoes_effect;
 
 // TODO: this needs refactoring, perhaps should go to native directory?
 #ifdef GTK3
-#define RAW_FILTER_START(place) \
+#define RAW_FILTER_START(source, place) \
   int width, height, stride; \
   guchar *out; \
   static const cairo_user_data_key_t key; \
-  cairo_surface_t *source = cairo_get_target(cr); \
   cairo_surface_t *target; \
   unsigned char *in = cairo_image_surface_get_data(source); \
   \
@@ -44,11 +52,10 @@ typedef struct {
   cairo_surface_set_user_data(target, &key, out, (cairo_destroy_func_t)g_free); \
   unsigned int len = 4 * width * height
 #else
-#define RAW_FILTER_START(place) \
+#define RAW_FILTER_START(source, place) \
   int width, height, stride; \
   guchar *out; \
   static const cairo_user_data_key_t key; \
-  cairo_surface_t *source = cairo_get_target(cr); \
   cairo_surface_t *target; \
   unsigned char *in = cairo_image_surface_get_data(source); \
   \
@@ -65,14 +72,6 @@ typedef struct {
   unsigned int len = 4 * width * height
 #endif
 
-#define RAW_FILTER_END() \
-  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR); \
-  cairo_paint(cr); \
-  cairo_set_operator(cr, CAIRO_OPERATOR_OVER); \
-  cairo_set_source_surface(cr, target, 0, 0); \
-  cairo_paint(cr); \
-  cairo_surface_destroy(target);
-
 /* each widget should have its own init function */
 void shoes_effect_init();
 
@@ -84,10 +83,12 @@ VALUE shoes_effect_draw(VALUE self, VALUE c, VALUE actual);
 void shoes_effect_mark(shoes_effect *fx);
 void shoes_effect_free(shoes_effect *fx);
 shoes_effect_filter shoes_effect_for_type(ID name);
+int shoes_effect_region(VALUE self, shoes_effect *fx, shoes_canvas *canvas, shoes_place *region);
+void shoes_effect_full_region(cairo_t *cr, shoes_place *region);
 
-void shoes_gaussian_blur_filter(cairo_t *, VALUE, shoes_place *);
-void shoes_shadow_filter(cairo_t *, VALUE, shoes_place *);
-void shoes_glow_filter(cairo_t *, VALUE, shoes_place *);
+void shoes_gaussian_blur_filter(cairo_t *, VALUE, shoes_place *, shoes_effect_cache *);
+void shoes_shadow_filter(cairo_t *, VALUE, shoes_place *, shoes_effect_cache *);
+void shoes_glow_filter(cairo_t *, VALUE, shoes_place *, shoes_effect_cache *);
 
 // canvas
 VALUE shoes_add_effect(VALUE self, ID name, VALUE attr);
@@ -4,6 +4,7 @@
 #include "shoes/types/pattern.h"
 #include "shoes/types/shape.h"
 #include "shoes/types/image.h"
+#include "shoes/http.h"
 
 // ruby
 VALUE cImage;
@@ -48,6 +49,13 @@ void shoes_image_init() {
 
     rb_define_method(cImage, "[]", CASTHOOK(shoes_image_get_pixel), 2);
     rb_define_method(cImage, "[]=", CASTHOOK(shoes_image_set_pixel), 3);
+    rb_define_method(cImage, "pixels", CASTHOOK(shoes_image_get_pixels), 0);
+    rb_define_method(cImage, "pixels=", CASTHOOK(shoes_image_set_pixels), 1);
+    rb_define_method(cImage, "stride", CASTHOOK(shoes_image_get_stride), 0);
+    rb_define_method(cImage, "fill_rect", CASTHOOK(shoes_image_fill_rect), 5);
+    rb_define_method(cImage, "blit", CASTHOOK(shoes_image_blit), -1);
+    rb_define_method(cImage, "map_channels", CASTHOOK(shoes_image_map_channels), -1);
+    rb_define_method(cImage, "convolve", CASTHOOK(shoes_image_convolve), -1);
     rb_define_method(cImage, "nostroke", CASTHOOK(shoes_canvas_nostroke), 0);
     rb_define_method(cImage, "stroke", CASTHOOK(shoes_canvas_stroke), -1);
     rb_define_method(cImage, "strokewidth", CASTHOOK(shoes_canvas_strokewidth), 1);
@@ -228,15 +236,260 @@ void shoes_image_ensure_dup(shoes_image *image) {
     image->type = SHOES_CACHE_MEM;
 }
 
+// the surface is flushed first, so pending cairo drawing lands before a
+// caller reads the pixel or writes it and marks it dirty
 unsigned char *shoes_image_surface_get_pixel(shoes_cached_image *cached, int x, int y) {
     if (x >= 0 && y >= 0 && x < cached->width && y < cached->height) {
-        unsigned char* pixels = cairo_image_surface_get_data(cached->surface);
-        if (cairo_image_surface_get_format(cached->surface) == CAIRO_FORMAT_ARGB32)
-            return pixels + (y * (4 * cached->width)) + (4 * x);
+        unsigned char* pixels;
+        if (cairo_image_surface_get_format(cached->surface) != CAIRO_FORMAT_ARGB32)
+            return NULL;
+        cairo_surface_flush(cached->surface);
+        pixels = cairo_image_surface_get_data(cached->surface);
+        return pixels + ((size_t)y * cairo_image_surface_get_stride(cached->surface)) + (4 * x);
     }
     return NULL;
 }
 
+// Bulk pixel access. Callers bracket direct writes to the surface data with
+// begin/end so cairo sees one flush and one mark_dirty per operation instead
+// of per pixel.
+static unsigned char *shoes_image_pixels_begin(shoes_image *image, int *stride) {
+    shoes_image_ensure_dup(image);
+    cairo_surface_flush(image->cached->surface);
+    if (cairo_image_surface_get_format(image->cached->surface) != CAIRO_FORMAT_ARGB32)
+        rb_raise(rb_eArgError, "image pixels are only available for ARGB32 surfaces");
+    *stride = cairo_image_surface_get_stride(image->cached->surface);
+    return cairo_image_surface_get_data(image->cached->surface);
+}
+
+static void shoes_image_pixels_end(shoes_image *image) {
+    cairo_surface_mark_dirty(image->cached->surface);
+}
+
+// clip a rectangle to the image, returns 0 if nothing is left
+static int shoes_image_clip_rect(shoes_cached_image *cached, int *x, int *y, int *w, int *h) {
+    if (*x < 0) { *w += *x; *x = 0; }
+    if (*y < 0) { *h += *y; *y = 0; }
+    if (*x + *w > cached->width)  *w = cached->width - *x;
+    if (*y + *h > cached->height) *h = cached->height - *y;
+    return (*w > 0 && *h > 0);
+}
+
+static void shoes_image_color_bytes(VALUE col, unsigned char *px) {
+    shoes_color *color;
+    if (TYPE(col) == T_STRING)
+        col = shoes_color_parse(cColor, col);
+    if (!rb_obj_is_kind_of(col, cColor))
+        rb_raise(rb_eArgError, "expecting a Shoes::Color or a color string");
+    Data_Get_Struct(col, shoes_color, color);
+    // cairo wants premultiplied alpha
+    px[0] = (color->b * color->a + 127) / 255;
+    px[1] = (color->g * color->a + 127) / 255;
+    px[2] = (color->r * color->a + 127) / 255;
+    px[3] = color->a;
+}
+
+// 256 entry translation table from a String, an Array or nil (identity)
+static void shoes_image_channel_table(VALUE tbl, unsigned char *map) {
+    int i;
+    if (NIL_P(tbl)) {
+        for (i = 0; i < 256; i++) map[i] = (unsigned char)i;
+    } else if (TYPE(tbl) == T_STRING) {
+        if (RSTRING_LEN(tbl) != 256)
+            rb_raise(rb_eArgError, "channel table must be 256 bytes long");
+        SHOE_MEMCPY(map, RSTRING_PTR(tbl), unsigned char, 256);
+    } else if (TYPE(tbl) == T_ARRAY) {
+        if (RARRAY_LEN(tbl) != 256)
+            rb_raise(rb_eArgError, "channel table must have 256 entries");
+        for (i = 0; i < 256; i++) {
+            int v = NUM2INT(rb_ary_entry(tbl, i));
+            map[i] = (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+        }
+    } else
+        rb_raise(rb_eArgError, "channel table must be a String, an Array or nil");
+}
+
+VALUE shoes_image_get_stride(VALUE self) {
+    GET_STRUCT(image, image);
+    return INT2NUM(cairo_image_surface_get_stride(image->cached->surface));
+}
+
+VALUE shoes_image_get_pixels(VALUE self) {
+    GET_STRUCT(image, image);
+    cairo_surface_t *surf = image->cached->surface;
+    if (cairo_image_surface_get_format(surf) != CAIRO_FORMAT_ARGB32)
+        rb_raise(rb_eArgError, "image pixels are only available for ARGB32 surfaces");
+    cairo_surface_flush(surf);
+    return rb_str_new((char *)cairo_image_surface_get_data(surf),
+                      (long)cairo_image_surface_get_stride(surf) * cairo_image_surface_get_height(surf));
+}
+
+VALUE shoes_image_set_pixels(VALUE self, VALUE str) {
+    int stride;
+    long len;
+    GET_STRUCT(image, image);
+    StringValue(str);
+    unsigned char *pixels = shoes_image_pixels_begin(image, &stride);
+    len = (long)stride * cairo_image_surface_get_height(image->cached->surface);
+    if (RSTRING_LEN(str) != len)
+        rb_raise(rb_eArgError, "pixel data must be %ld bytes (stride %d), got %ld",
+                 len, stride, (long)RSTRING_LEN(str));
+    SHOE_MEMCPY(pixels, RSTRING_PTR(str), unsigned char, len);
+    shoes_image_pixels_end(image);
+    return str;
+}
+
+VALUE shoes_image_fill_rect(VALUE self, VALUE _x, VALUE _y, VALUE _w, VALUE _h, VALUE col) {
+    int x = NUM2INT(_x), y = NUM2INT(_y), w = NUM2INT(_w), h = NUM2INT(_h);
+    int i, j, stride;
+    unsigned char px[4];
+    GET_STRUCT(image, image);
+    shoes_image_color_bytes(col, px);
+    unsigned char *pixels = shoes_image_pixels_begin(image, &stride);
+    if (shoes_image_clip_rect(image->cached, &x, &y, &w, &h)) {
+        for (j = y; j < y + h; j++) {
+            unsigned char *row = pixels + (j * stride) + (4 * x);
+            for (i = 0; i < w; i++, row += 4)
+                SHOE_MEMCPY(row, px, unsigned char, 4);
+        }
+    }
+    shoes_image_pixels_end(image);
+    return self;
+}
+
+// blit(src, x, y, [sx, sy, w, h]) copies raw pixels from another image, no blending
+VALUE shoes_image_blit(int argc, VALUE *argv, VALUE self) {
+    VALUE src, _x, _y, _sx, _sy, _w, _h;
+    int x, y, sx, sy, w, h, j, stride, sstride;
+    shoes_image *simg;
+    GET_STRUCT(image, image);
+
+    rb_scan_args(argc, argv, "34", &src, &_x, &_y, &_sx, &_sy, &_w, &_h);
+    if (!rb_obj_is_kind_of(src, cImage))
+        rb_raise(rb_eArgError, "blit expects a Shoes::Image as its source");
+    Data_Get_Struct(src, shoes_image, simg);
+
+    x = NUM2INT(_x);
+    y = NUM2INT(_y);
+    sx = NIL_P(_sx) ? 0 : NUM2INT(_sx);
+    sy = NIL_P(_sy) ? 0 : NUM2INT(_sy);
+    w = NIL_P(_w) ? simg->cached->width : NUM2INT(_w);
+    h = NIL_P(_h) ? simg->cached->height : NUM2INT(_h);
+
+    // clip against the source first, then the destination
+    if (sx < 0) { x -= sx; w += sx; sx = 0; }
+    if (sy < 0) { y -= sy; h += sy; sy = 0; }
+    if (sx + w > simg->cached->width)  w = simg->cached->width - sx;
+    if (sy + h > simg->cached->height) h = simg->cached->height - sy;
+    if (x < 0) { sx -= x; w += x; x = 0; }
+    if (y < 0) { sy -= y; h += y; y = 0; }
+
+    unsigned char *pixels = shoes_image_pixels_begin(image, &stride);
+    if (shoes_image_clip_rect(image->cached, &x, &y, &w, &h)) {
+        cairo_surface_flush(simg->cached->surface);
+        unsigned char *spixels = cairo_image_surface_get_data(simg->cached->surface);
+        sstride = cairo_image_surface_get_stride(simg->cached->surface);
+        for (j = 0; j < h; j++)
+            SHOE_MEMMOVE(pixels + ((y + j) * stride) + (4 * x),
+                         spixels + ((sy + j) * sstride) + (4 * sx), unsigned char, 4 * w);
+    }
+    shoes_image_pixels_end(image);
+    return self;
+}
+
+// map_channels(red, green, blue, alpha) runs every pixel through lookup tables
+VALUE shoes_image_map_channels(int argc, VALUE *argv, VALUE self) {
+    VALUE r, g, b, a;
+    unsigned char rmap[256], gmap[256], bmap[256], amap[256];
+    int i, j, stride;
+    GET_STRUCT(image, image);
+
+    rb_scan_args(argc, argv, "13", &r, &g, &b, &a);
+    shoes_image_channel_table(r, rmap);
+    shoes_image_channel_table(g, gmap);
+    shoes_image_channel_table(b, bmap);
+    shoes_image_channel_table(a, amap);
+
+    unsigned char *pixels = shoes_image_pixels_begin(image, &stride);
+    for (j = 0; j < image->cached->height; j++) {
+        unsigned char *row = pixels + (j * stride);
+        for (i = 0; i < image->cached->width; i++, row += 4) {
+            row[0] = bmap[row[0]];
+            row[1] = gmap[row[1]];
+            row[2] = rmap[row[2]];
+            row[3] = amap[row[3]];
+        }
+    }
+    shoes_image_pixels_end(image);
+    return self;
+}
+
+// convolve(kernel, divisor = sum of kernel, bias = 0) with a square kernel
+// given as a flat array. Edges are clamped.
+VALUE shoes_image_convolve(int argc, VALUE *argv, VALUE self) {
+    VALUE kern, _div, _bias, kbuf;
+    int i, j, k, n, half, stride, klen;
+    size_t len;
+    double div = 0.0, bias;
+    GET_STRUCT(image, image);
+
+    rb_scan_args(argc, argv, "12", &kern, &_div, &_bias);
+    Check_Type(kern, T_ARRAY);
+    klen = (int)RARRAY_LEN(kern);
+    for (n = 1; n * n < klen; n += 2);
+    if (n * n != klen)
+        rb_raise(rb_eArgError, "convolve needs an odd, square kernel (9, 25, 49... entries)");
+    half = n / 2;
+
+    // Ruby owns the kernel copy, so it isn't lost if NUM2DBL or
+    // shoes_image_pixels_begin raises
+    double *kv = ALLOCV_N(double, kbuf, klen);
+    for (k = 0; k < klen; k++) {
+        kv[k] = NUM2DBL(rb_ary_entry(kern, k));
+        div += kv[k];
+    }
+    if (!NIL_P(_div)) div = NUM2DBL(_div);
+    if (div == 0.0) div = 1.0;
+    bias = NIL_P(_bias) ? 0.0 : NUM2DBL(_bias);
+
+    int w = image->cached->width, h = image->cached->height;
+    unsigned char *pixels = shoes_image_pixels_begin(image, &stride);
+    len = (size_t)stride * h;
+    unsigned char *src = SHOE_ALLOC_N(unsigned char, len);
+    SHOE_MEMCPY(src, pixels, unsigned char, len);
+
+    for (j = 0; j < h; j++) {
+        unsigned char *out = pixels + ((size_t)j * stride);
+        for (i = 0; i < w; i++, out += 4) {
+            double acc[4] = {0.0, 0.0, 0.0, 0.0};
+            int kx, ky, c;
+            for (ky = 0; ky < n; ky++) {
+                int yy = j + ky - half;
+                yy = yy < 0 ? 0 : (yy >= h ? h - 1 : yy);
+                for (kx = 0; kx < n; kx++) {
+                    int xx = i + kx - half;
+                    xx = xx < 0 ? 0 : (xx >= w ? w - 1 : xx);
+                    unsigned char *in = src + ((size_t)yy * stride) + (4 * xx);
+                    double f = kv[ky * n + kx];
+                    for (c = 0; c < 4; c++) acc[c] += in[c] * f;
+                }
+            }
+            for (c = 0; c < 4; c++) {
+                double v = acc[c] / div + bias;
+                out[c] = (unsigned char)(v < 0.0 ? 0 : (v > 255.0 ? 255 : v + 0.5));
+            }
+            // keep the premultiplied invariant
+            for (c = 0; c < 3; c++)
+                if (out[c] > out[3]) out[c] = out[3];
+        }
+    }
+
+    SHOE_FREE(src);
+    ALLOCV_END(kbuf);
+    shoes_image_pixels_end(image);
+    return self;
+}
+
 VALUE shoes_image_get_pixel(VALUE self, VALUE _x, VALUE _y) {
     VALUE color = Qnil;
     int x = NUM2INT(_x), y = NUM2INT(_y);
@@ -262,6 +515,7 @@ VALUE shoes_image_set_pixel(VALUE self, VALUE _x, VALUE _y, VALUE col) {
             pixels[1] = color->g;
             pixels[2] = color->r;
             pixels[3] = color->a;
+            cairo_surface_mark_dirty_rectangle(image->cached->surface, x, y, 1, 1);
         }
     }
     return self;
@@ -292,16 +546,27 @@ static void shoes_image_draw_surface(cairo_t *cr, shoes_image *self_t, shoes_pla
     self_t->place = *place;
 }
 
-#define SHOES_IMAGE_PLACE(type, imw, imh, surf) \
-  SETUP_DRAWING(shoes_##type, (REL_CANVAS | REL_SCALE), imw, imh); \
-  VALUE ck = rb_obj_class(c); \
-  if (RTEST(actual)) \
-    shoes_image_draw_surface(CCR(canvas), self_t, &place, surf, imw, imh); \
-  FINISH(); \
-  return self;
+// a remote image still downloading that has come into view goes to the
+// front of the download queue
+static void shoes_image_prioritize(shoes_image *image, shoes_canvas *canvas, shoes_place *place) {
+    int top = canvas->slot != NULL ? canvas->slot->scrolly : 0;
+    if (image->cached->surface != shoes_world->blank_image || TYPE(image->path) != T_STRING)
+        return;
+    if (place->iy + place->ih < top || place->iy > top + canvas->app->height)
+        return;
+    shoes_http_prioritize(RSTRING_PTR(image->path), SHOES_HTTP_PRIORITY_VISIBLE);
+}
 
 VALUE shoes_image_draw(VALUE self, VALUE c, VALUE actual) {
-    SHOES_IMAGE_PLACE(image, self_t->cached->width, self_t->cached->height, self_t->cached->surface);
+    SETUP_DRAWING(shoes_image, (REL_CANVAS | REL_SCALE), self_t->cached->width, self_t->cached->height);
+    VALUE ck = rb_obj_class(c);
+    if (RTEST(actual)) {
+        shoes_image_prioritize(self_t, canvas, &place);
+        shoes_image_draw_surface(CCR(canvas), self_t, &place, self_t->cached->surface,
+                                 self_t->cached->width, self_t->cached->height);
+    }
+    FINISH();
+    return self;
 }
 
 void shoes_image_image(VALUE parent, VALUE path, VALUE attr) {
@@ -34,6 +34,13 @@ void shoes_image_ensure_dup(shoes_image *image);
 unsigned char *shoes_image_surface_get_pixel(shoes_cached_image *cached, int x, int y);
 VALUE shoes_image_get_pixel(VALUE self, VALUE _x, VALUE _y);
 VALUE shoes_image_set_pixel(VALUE self, VALUE _x, VALUE _y, VALUE col);
+VALUE shoes_image_get_stride(VALUE self);
+VALUE shoes_image_get_pixels(VALUE self);
+VALUE shoes_image_set_pixels(VALUE self, VALUE str);
+VALUE shoes_image_fill_rect(VALUE self, VALUE _x, VALUE _y, VALUE _w, VALUE _h, VALUE col);
+VALUE shoes_image_blit(int argc, VALUE *argv, VALUE self);
+VALUE shoes_image_map_channels(int argc, VALUE *argv, VALUE self);
+VALUE shoes_image_convolve(int argc, VALUE *argv, VALUE self);
 VALUE shoes_image_get_path(VALUE self);
 VALUE shoes_image_set_path(VALUE self, VALUE path);
 VALUE shoes_image_draw(VALUE self, VALUE c, VALUE actual);
@@ -76,13 +83,4 @@ VALUE shoes_canvas_blur(int, VALUE *, VALUE);
 VALUE shoes_canvas_glow(int, VALUE *, VALUE);
 VALUE shoes_canvas_shadow(int, VALUE *, VALUE);
 
-
-#define SHOES_IMAGE_PLACE(type, imw, imh, surf) \
-  SETUP_DRAWING(shoes_##type, (REL_CANVAS | REL_SCALE), imw, imh); \
-  VALUE ck = rb_obj_class(c); \
-  if (RTEST(actual)) \
-    shoes_image_draw_surface(CCR(canvas), self_t, &place, surf, imw, imh); \
-  FINISH(); \
-  return self;
-
 #endif
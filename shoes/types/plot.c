@@ -17,6 +17,7 @@ void shoes_plot_init() {
 
     // methods unique to plot
     rb_define_method(cPlot, "add", CASTHOOK(shoes_plot_add), 1);
+    rb_define_method(cPlot, "load_csv", CASTHOOK(shoes_plot_load_csv), -1);
     rb_define_method(cPlot, "redraw_to", CASTHOOK(shoes_plot_redraw_to), 1);
     rb_define_method(cPlot, "delete", CASTHOOK(shoes_plot_delete), 1);
     rb_define_method(cPlot, "id",  CASTHOOK(shoes_plot_find_name), 1);
@@ -25,9 +26,11 @@ void shoes_plot_init() {
     rb_define_method(cPlot, "set_first", CASTHOOK(shoes_plot_set_first), 1);
     rb_define_method(cPlot, "last", CASTHOOK(shoes_plot_get_last), 0);
     rb_define_method(cPlot, "set_last", CASTHOOK(shoes_plot_set_last), 1);
-    rb_define_method(cPlot, "zoom", CASTHOOK(shoes_plot_zoom), 2);
+    rb_define_method(cPlot, "zoom", CASTHOOK(shoes_plot_zoom), -1);
+    rb_define_method(cPlot, "pan", CASTHOOK(shoes_plot_pan), 1);
     rb_define_method(cPlot, "save_as", CASTHOOK(shoes_plot_save_as), -1);
     rb_define_method(cPlot, "near_x", CASTHOOK(shoes_plot_near), 1);
+    rb_define_method(cPlot, "near", CASTHOOK(shoes_plot_nearest), 2);
 
     // methods commom to many Shoes widgets
     rb_define_method(cPlot, "draw", CASTHOOK(shoes_plot_draw), 2);
@@ -59,6 +62,11 @@ void shoes_plot_init() {
 
     //  simple getters/setters
     rb_define_method(cChartSeries, "values", CASTHOOK(shoes_chart_series_values), 0);
+    rb_define_method(cChartSeries, "values=", CASTHOOK(shoes_chart_series_values_set), 1);
+    rb_define_method(cChartSeries, "size", CASTHOOK(shoes_chart_series_size), 0);
+    rb_define_method(cChartSeries, "push", CASTHOOK(shoes_chart_series_push), 1);
+    rb_define_method(cChartSeries, "<<", CASTHOOK(shoes_chart_series_push), 1);
+    rb_define_method(cChartSeries, "push_many", CASTHOOK(shoes_chart_series_push_many), 1);
     rb_define_method(cChartSeries, "labels", CASTHOOK(shoes_chart_series_labels), 0);
     rb_define_method(cChartSeries, "min", CASTHOOK(shoes_chart_series_min), 0);
     rb_define_method(cChartSeries, "min=", CASTHOOK(shoes_chart_series_min_set), 1);
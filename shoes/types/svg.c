@@ -4,6 +4,7 @@
 */
 
 #include <math.h>
+#include <sys/stat.h>
 #include <cairo.h>
 #include <cairo-svg.h>
 #include <rsvg.h>
@@ -98,7 +99,15 @@ VALUE shoes_canvas_svghandle(int argc, VALUE *argv, VALUE self) {
 // svg
 
 // forward declares in this file
-static int shoes_svg_draw_surface(cairo_t *, shoes_svg *, shoes_place *, int, int);
+static int shoes_svg_draw_surface(cairo_t *, shoes_svg *, shoes_place *, int, int, int);
+static int shoes_svghandle_ready(shoes_svghandle *, int);
+static void shoes_svghandle_detach(shoes_svghandle *);
+static void shoes_svgdoc_rasters_clear(shoes_svgdoc *);
+
+// biggest rendering (in pixels) kept around between paints
+#define SHOES_SVG_RASTER_MAX (4096 * 4096)
+// and all of them together, in bytes
+#define SHOES_SVG_RASTER_BUDGET (256 * 1024 * 1024)
 
 // alloc some memory for a shoes_svg; We'll protect it from gc
 // out of caution. fingers crossed.
@@ -193,6 +202,8 @@ VALUE shoes_svg_new(int argc, VALUE *argv, VALUE parent) {
 
     // we couldn't find the width/height of the parent canvas, now that we have a rsvg handle,
     // fallback to original size as defined in the svg file but no more than Shoes.app size
+    if (widthObj == Qnil || heightObj == Qnil)
+        shoes_svghandle_ready(shandle, 1);
     if (widthObj == Qnil) {
         widthObj = INT2NUM(shandle->svghdim.width);
         widthObj = (shandle->svghdim.width >= canvas->app->width) ?
@@ -231,10 +242,141 @@ VALUE shoes_svg_new(int argc, VALUE *argv, VALUE parent) {
     return obj;
 }
 
-static int shoes_svg_draw_surface(cairo_t *cr, shoes_svg *self_t, shoes_place *place, int imw, int imh) {
+/*
+ * Rendering a big SVG takes a while, so screen paints keep the result as an
+ * image and put that back up until the handle, the scale or the dpi change.
+ * The images belong to the parsed document, by group and scale, so a deck of
+ * cards drawn many times over renders each card once. Together they stay
+ * under SHOES_SVG_RASTER_BUDGET; the ones drawn least recently go first.
+ * Rotated or skewed elements, vector targets (pdf, ps and svg exports) and
+ * svg(..., cache: false) render the SVG itself every time.
+ */
+typedef struct _shoes_svgraster {
+    char *key;                  // group and scale, in doc->rasters
+    shoes_svgdoc *doc;
+    cairo_surface_t *surface;
+    long bytes;
+    struct _shoes_svgraster *newer, *older;
+} shoes_svgraster;
+
+static shoes_svgraster *svgraster_newest = NULL, *svgraster_oldest = NULL;
+static long svgraster_bytes = 0;
+
+static void shoes_svgraster_unlink(shoes_svgraster *r) {
+    if (r->newer != NULL) r->newer->older = r->older;
+    else svgraster_newest = r->older;
+    if (r->older != NULL) r->older->newer = r->newer;
+    else svgraster_oldest = r->newer;
+    r->newer = r->older = NULL;
+}
+
+static void shoes_svgraster_link(shoes_svgraster *r) {
+    r->older = svgraster_newest;
+    r->newer = NULL;
+    if (svgraster_newest != NULL) svgraster_newest->newer = r;
+    else svgraster_oldest = r;
+    svgraster_newest = r;
+}
+
+// doc->rasters' value destroy function
+static void shoes_svgraster_free(gpointer data) {
+    shoes_svgraster *r = (shoes_svgraster *)data;
+    shoes_svgraster_unlink(r);
+    svgraster_bytes -= r->bytes;
+    cairo_surface_destroy(r->surface);
+    free(r->key);
+    SHOE_FREE(r);
+}
+
+static void shoes_svgdoc_rasters_clear(shoes_svgdoc *doc) {
+    if (doc->rasters != NULL)
+        g_hash_table_remove_all(doc->rasters);
+}
+
+static int shoes_svg_draw_raster(cairo_t *cr, shoes_svg *self_t, shoes_svghandle *svghan) {
+    cairo_matrix_t m;
+    cairo_surface_t *target = cairo_get_target(cr);
+    double dsx = 1.0, dsy = 1.0;
+    shoes_svgdoc *doc = svghan->doc;
+    shoes_svgraster *r;
+    char key[256];
+
+    switch (cairo_surface_get_type(target)) {
+        case CAIRO_SURFACE_TYPE_PDF:
+        case CAIRO_SURFACE_TYPE_PS:
+        case CAIRO_SURFACE_TYPE_SVG:
+        case CAIRO_SURFACE_TYPE_RECORDING:
+        case CAIRO_SURFACE_TYPE_SCRIPT:
+            return 0;
+        default:
+            break;
+    }
+    cairo_get_matrix(cr, &m);
+    if (m.xy != 0.0 || m.yx != 0.0 || m.xx <= 0.0 || m.yy <= 0.0)
+        return 0;
+    // HiDPI: render at the device's resolution, not the user space one
+    cairo_surface_get_device_scale(target, &dsx, &dsy);
+    double sx = self_t->scalew * m.xx, sy = self_t->scaleh * m.yy;
+    int pw = (int)ceil(svghan->svghdim.width * sx * dsx);
+    int ph = (int)ceil(svghan->svghdim.height * sy * dsy);
+    if (doc == NULL || pw < 1 || ph < 1 || (double)pw * ph > SHOES_SVG_RASTER_MAX)
+        return 0;
+    if (snprintf(key, sizeof(key), "%s %.17g %.17g %g %g", svghan->subid != NULL ? svghan->subid : "",
+                 sx, sy, dsx, dsy) >= (int)sizeof(key))
+        return 0;
+
+    if (doc->rasters == NULL)
+        doc->rasters = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, shoes_svgraster_free);
+    r = (shoes_svgraster *)g_hash_table_lookup(doc->rasters, key);
+    if (r != NULL) {
+        shoes_svgraster_unlink(r);
+        shoes_svgraster_link(r);
+    } else {
+        cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, pw, ph);
+        if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+            cairo_surface_destroy(surface);
+            return 0;
+        }
+        cairo_surface_set_device_scale(surface, dsx, dsy);
+        cairo_t *rcr = cairo_create(surface);
+        cairo_scale(rcr, sx, sy);
+        if (svghan->subid != NULL)
+            cairo_translate(rcr, -svghan->svghpos.x, -svghan->svghpos.y);
+        rsvg_handle_render_cairo_sub(svghan->handle, rcr, svghan->subid);
+        cairo_destroy(rcr);
+
+        r = SHOE_ALLOC(shoes_svgraster);
+        SHOE_MEMZERO(r, shoes_svgraster, 1);
+        r->key = strdup(key);
+        r->doc = doc;
+        r->surface = surface;
+        r->bytes = (long)cairo_image_surface_get_stride(surface) * ph;
+        g_hash_table_insert(doc->rasters, r->key, r);
+        shoes_svgraster_link(r);
+        svgraster_bytes += r->bytes;
+        while (svgraster_bytes > SHOES_SVG_RASTER_BUDGET && svgraster_oldest != r)
+            g_hash_table_remove(svgraster_oldest->doc->rasters, svgraster_oldest->key);
+    }
+
+    cairo_save(cr);
+    cairo_identity_matrix(cr);
+    cairo_set_source_surface(cr, r->surface, round(m.x0), round(m.y0));
+    cairo_paint(cr);
+    cairo_restore(cr);
+    return 1;
+}
+
+static int shoes_svg_draw_surface(cairo_t *cr, shoes_svg *self_t, shoes_place *place, int imw, int imh, int cached) {
     shoes_svghandle *svghan;
+    int result;
     Data_Get_Struct(self_t->svghandle, shoes_svghandle, svghan);
 
+    // still parsing: the element keeps its place, blank until shoes_svgdoc_parsed repaints
+    if (!shoes_svghandle_ready(svghan, !cached)) {
+        self_t->place = *place;
+        return 0;
+    }
+
     // calculate aspect ratio only once at initialization
     if (self_t->scalew == 0.0 && self_t->scaleh == 0.0) {
         svg_aspect_ratio(imw, imh, self_t, svghan);
@@ -246,14 +388,18 @@ static int shoes_svg_draw_surface(cairo_t *cr, shoes_svg *self_t, shoes_place *p
 
     cairo_translate(cr, place->ix + place->dx, place->iy + place->dy);
 
-    if (svghan->subid == NULL) {
-        cairo_scale(cr, self_t->scalew, self_t->scaleh);
+    if (cached && ATTR(self_t->attr, cache) != Qfalse && shoes_svg_draw_raster(cr, self_t, svghan)) {
+        result = 1;
     } else {
-        cairo_scale(cr, self_t->scalew, self_t->scaleh);          // order of scaling + translate matters !!!
-        cairo_translate(cr, -svghan->svghpos.x, -svghan->svghpos.y);
-    }
+        if (svghan->subid == NULL) {
+            cairo_scale(cr, self_t->scalew, self_t->scaleh);
+        } else {
+            cairo_scale(cr, self_t->scalew, self_t->scaleh);          // order of scaling + translate matters !!!
+            cairo_translate(cr, -svghan->svghpos.x, -svghan->svghpos.y);
+        }
 
-    int result = rsvg_handle_render_cairo_sub(svghan->handle, cr, svghan->subid);
+        result = rsvg_handle_render_cairo_sub(svghan->handle, cr, svghan->subid);
+    }
 
     shoes_undo_transformation(cr, self_t->st, place, 0); // doing cairo_restore(cr)
 
@@ -262,7 +408,7 @@ static int shoes_svg_draw_surface(cairo_t *cr, shoes_svg *self_t, shoes_place *p
     return result;
 }
 
-// This gets called very often by Shoes. May be slow for large SVG?
+// This gets called very often by Shoes, shoes_svg_draw_raster keeps it quick.
 VALUE shoes_svg_draw(VALUE self, VALUE c, VALUE actual) {
     shoes_svg *self_t;
     shoes_place place;
@@ -274,7 +420,7 @@ VALUE shoes_svg_draw(VALUE self, VALUE c, VALUE actual) {
     shoes_place_decide(&place, c, self_t->attr, self_t->place.w, self_t->place.h, rel, REL_COORDS(rel) == REL_CANVAS);
 
     if (RTEST(actual))
-        shoes_svg_draw_surface( CCR(canvas), self_t, &place, place.w, place.h);
+        shoes_svg_draw_surface( CCR(canvas), self_t, &place, place.w, place.h, 1);
 
     if (!ABSY(place)) {
         canvas->cx += place.w;
@@ -302,11 +448,10 @@ VALUE shoes_svg_set_handle(VALUE self, VALUE han) {
 
     if ( !NIL_P(han) && (rb_obj_is_kind_of(han, cSvgHandle)) ) {
         self_t->svghandle = han;
-        // force a garbage collection, cSvgHandles could pile up if set at a fast rate
-        rb_gc();
 
         shoes_svghandle *svghan;
         Data_Get_Struct(self_t->svghandle, shoes_svghandle, svghan);
+        shoes_svghandle_ready(svghan, 1);
         svg_aspect_ratio(ATTR(self_t->attr, width), ATTR(self_t->attr, height), self_t, svghan);
         self_t->scalew = self_t->scalew/2;
         self_t->scaleh = self_t->scaleh/2;
@@ -342,6 +487,7 @@ VALUE shoes_svg_get_dpi(VALUE self) {
     Data_Get_Struct(self, shoes_svg, self_t);
     shoes_svghandle *svghan;
     Data_Get_Struct(self_t->svghandle, shoes_svghandle, svghan);
+    if (!shoes_svghandle_ready(svghan, 1)) return Qnil;
     double dpix, dpiy;
     g_object_get(svghan->handle, "dpi-x", &dpix, NULL);
     g_object_get(svghan->handle, "dpi-y", &dpiy, NULL);
@@ -360,7 +506,11 @@ VALUE shoes_svg_set_dpi(VALUE self, VALUE dpi) {
      * provide twice the number of pixels in x, twice in y,
      * IF at any moment it has a meaning inside the Shoes environment !!!
      */
-    rsvg_handle_set_dpi(svghan->handle, NUM2DBL(dpi));
+    if (!shoes_svghandle_ready(svghan, 1)) return Qnil;
+    shoes_svghandle_detach(svghan);
+    if (svghan->handle != NULL)
+        rsvg_handle_set_dpi(svghan->handle, NUM2DBL(dpi));
+    shoes_svgdoc_rasters_clear(svghan->doc);
     //shoes_canvas_repaint_all(self_t->parent); // no meaning at the moment !
 
     return Qnil;
@@ -411,7 +561,7 @@ static cairo_surface_t *buid_surface(VALUE self, VALUE docanvas, double scale, i
 
         if (scale != 1.0) cairo_scale(cr, scale, scale);
         cairo_translate(cr, -(place.ix + place.dx), -(place.iy + place.dy));
-        *result = shoes_svg_draw_surface(cr, self_t, &place, w, h);
+        *result = shoes_svg_draw_surface(cr, self_t, &place, w, h, 0);
     }
     if (format != NULL) cairo_show_page(cr);
     cairo_destroy(cr);
@@ -475,6 +625,7 @@ VALUE shoes_svg_get_actual_width(VALUE self) {
     GET_STRUCT(svg, self_t);
     shoes_svghandle *svghan;
     Data_Get_Struct(self_t->svghandle, shoes_svghandle, svghan);
+    shoes_svghandle_ready(svghan, 1);
     return INT2NUM((int)floor(svghan->svghdim.width*self_t->scalew));
 }
 
@@ -482,6 +633,7 @@ VALUE shoes_svg_get_actual_height(VALUE self) {
     GET_STRUCT(svg, self_t);
     shoes_svghandle *svghan;
     Data_Get_Struct(self_t->svghandle, shoes_svghandle, svghan);
+    shoes_svghandle_ready(svghan, 1);
     return INT2NUM((int)floor(svghan->svghdim.height*self_t->scaleh));
 }
 
@@ -500,6 +652,7 @@ VALUE shoes_svg_preferred_width(VALUE self) {
     GET_STRUCT(svg, self_t);
     shoes_svghandle *svghan;
     Data_Get_Struct(self_t->svghandle, shoes_svghandle, svghan);
+    shoes_svghandle_ready(svghan, 1);
     w = svghan->svghdim.width;
     return INT2NUM(w);
 }
@@ -509,6 +662,7 @@ VALUE shoes_svg_preferred_height(VALUE self) {
     GET_STRUCT(svg, self_t);
     shoes_svghandle *svghan;
     Data_Get_Struct(self_t->svghandle, shoes_svghandle, svghan);
+    shoes_svghandle_ready(svghan, 1);
     h = svghan->svghdim.height;
     return INT2NUM(h);
 }
@@ -517,6 +671,7 @@ VALUE shoes_svg_get_offsetX(VALUE self) {
     GET_STRUCT(svg, self_t);
     shoes_svghandle *svghan;
     Data_Get_Struct(self_t->svghandle, shoes_svghandle, svghan);
+    shoes_svghandle_ready(svghan, 1);
     return INT2NUM(svghan->svghpos.x);
 }
 
@@ -524,6 +679,7 @@ VALUE shoes_svg_get_offsetY(VALUE self) {
     GET_STRUCT(svg, self_t);
     shoes_svghandle *svghan;
     Data_Get_Struct(self_t->svghandle, shoes_svghandle, svghan);
+    shoes_svghandle_ready(svghan, 1);
     return INT2NUM(svghan->svghpos.y);
 }
 
@@ -535,7 +691,8 @@ VALUE shoes_svg_has_group(VALUE self, VALUE group) {
     Data_Get_Struct(self_t->svghandle, shoes_svghandle, handle);
     if (!NIL_P(group) && (TYPE(group) == T_STRING)) {
         char *grp = RSTRING_PTR(group);
-        result = rsvg_handle_has_sub(handle->handle, grp);
+        if (shoes_svghandle_ready(handle, 1))
+            result = rsvg_handle_has_sub(handle->handle, grp);
     } else {
         rb_raise(rb_eArgError, "bad argument, expecting a String \n");
     }
@@ -617,14 +774,221 @@ void shoes_svg_send_release(VALUE self, int button, int x, int y) {
     }
 }
 
+// svg documents
+
+/*
+ * Parsing is the slow part of an svg, and a sprite sheet like a deck of cards
+ * is shown many times over, so parsed documents are kept in
+ * shoes_world->svg_cache by file (path, mtime and size) or by the SHA1 of the
+ * content and shared by every svghandle, whatever group it shows. Big ones
+ * are parsed on a worker thread; their svg elements keep their place but stay
+ * blank until the document is ready. Anything that needs the size before then
+ * waits for it.
+ */
+#ifdef SHOES_GTK
+// cocoa's shoes_post_message runs the handler on the posting thread, so
+// there every document is parsed right away
+#define SHOES_SVG_ASYNC_MIN (64 * 1024)   // smaller ones parse before a thread would start
+#endif
+
+static GThreadPool *svgdoc_pool = NULL;
+static GMutex svgdoc_lock;
+static GCond svgdoc_done;
+
+static shoes_svgdoc *shoes_svgdoc_alloc(char *key, const char *path, const char *data, long len) {
+    shoes_svgdoc *doc = SHOE_ALLOC(shoes_svgdoc);
+    SHOE_MEMZERO(doc, shoes_svgdoc, 1);
+    doc->key = key;
+    if (path != NULL) {
+        doc->path = strdup(path);
+    } else {
+        doc->data = SHOE_ALLOC_N(char, len + 1);
+        SHOE_MEMCPY(doc->data, data, char, len);
+        doc->data[len] = '\0';
+        doc->len = len;
+    }
+    doc->handle = NULL;
+    doc->state = SHOES_SVGDOC_PARSING;
+    doc->refs = 1;
+    return doc;
+}
+
+// runs on either thread, touches nothing but doc
+static void shoes_svgdoc_parse(shoes_svgdoc *doc) {
+    GError *gerror = NULL;
+    RsvgHandle *handle;
+    if (doc->path != NULL)
+        handle = rsvg_handle_new_from_file(doc->path, &gerror);
+    else
+        // being Ruby, those are UTF-8, may not be what rsvg wants (const guint8 *)
+        // Problem for OSX ?
+        handle = rsvg_handle_new_from_data((const unsigned char *)doc->data, doc->len, &gerror);
+    if (handle == NULL) {
+        printf("Failed SVG: %s\n", gerror->message);
+        g_error_free(gerror);
+    }
+
+    g_mutex_lock(&svgdoc_lock);
+    doc->handle = handle;
+    g_atomic_int_set(&doc->state, handle != NULL ? SHOES_SVGDOC_READY : SHOES_SVGDOC_FAILED);
+    g_cond_broadcast(&svgdoc_done);
+    g_mutex_unlock(&svgdoc_lock);
+}
+
+static void shoes_svgdoc_worker(gpointer data, gpointer user) {
+    shoes_svgdoc_parse((shoes_svgdoc *)data);
+    shoes_post_message(SHOES_SVG_PARSED, Qnil, data, SHOES_MSG_POST);
+}
+
+static void shoes_svgdoc_release(shoes_svgdoc *doc) {
+    if (--doc->refs > 0) return;
+    if (doc->key != NULL) {
+        st_data_t key = (st_data_t)doc->key;
+        st_delete(shoes_world->svg_cache, &key, 0);
+        free(doc->key);
+    }
+    if (doc->rasters != NULL)
+        g_hash_table_destroy(doc->rasters);
+    if (doc->handle != NULL)
+        g_object_unref(doc->handle);
+    if (doc->path) free(doc->path);
+    if (doc->data) SHOE_FREE(doc->data);
+    SHOE_FREE(doc);
+}
+
+// the worker's message, on the GUI thread
+void shoes_svgdoc_parsed(shoes_svgdoc *doc) {
+    long i;
+    for (i = 0; i < RARRAY_LEN(shoes_world->apps); i++) {
+        shoes_app *app;
+        Data_Get_Struct(rb_ary_entry(shoes_world->apps, i), shoes_app, app);
+        shoes_canvas_repaint_all(app->canvas);
+    }
+    shoes_svgdoc_release(doc);
+}
+
+// returns the document with a reference for the caller, parsed or on its way
+static shoes_svgdoc *shoes_svgdoc_open(VALUE filename, VALUE content) {
+    shoes_svgdoc *doc;
+    char *key;
+    long size;
+    struct stat st;
+
+    if (!NIL_P(filename)) {
+        char *path = RSTRING_PTR(filename);
+        if (stat(path, &st) != 0) {
+            // let rsvg say what's wrong with it
+            doc = shoes_svgdoc_alloc(NULL, path, NULL, 0);
+            shoes_svgdoc_parse(doc);
+            return doc;
+        }
+        size = (long)st.st_size;
+        key = SHOE_ALLOC_N(char, RSTRING_LEN(filename) + 64);
+        sprintf(key, "file:%s:%ld:%ld", path, (long)st.st_mtime, size);
+    } else {
+        gchar *sha1 = g_compute_checksum_for_data(G_CHECKSUM_SHA1,
+                      (const guchar *)RSTRING_PTR(content), RSTRING_LEN(content));
+        size = RSTRING_LEN(content);
+        key = SHOE_ALLOC_N(char, strlen(sha1) + 6);
+        sprintf(key, "data:%s", sha1);
+        g_free(sha1);
+    }
+
+    if (st_lookup(shoes_world->svg_cache, (st_data_t)key, (st_data_t *)&doc)) {
+        SHOE_FREE(key);
+        doc->refs++;
+        return doc;
+    }
+
+    if (!NIL_P(filename))
+        doc = shoes_svgdoc_alloc(key, RSTRING_PTR(filename), NULL, 0);
+    else
+        doc = shoes_svgdoc_alloc(key, NULL, RSTRING_PTR(content), size);
+    st_insert(shoes_world->svg_cache, (st_data_t)key, (st_data_t)doc);
+#ifdef SHOES_SVG_ASYNC_MIN
+    if (size >= SHOES_SVG_ASYNC_MIN) {
+        if (svgdoc_pool == NULL)
+            svgdoc_pool = g_thread_pool_new(shoes_svgdoc_worker, NULL,
+                                            max(1, (int)g_get_num_processors() - 1), FALSE, NULL);
+        if (svgdoc_pool != NULL) {
+            doc->refs++;   // the worker's, dropped by shoes_svgdoc_parsed
+            g_thread_pool_push(svgdoc_pool, doc, NULL);
+            return doc;
+        }
+    }
+#endif
+    shoes_svgdoc_parse(doc);
+    return doc;
+}
+
 // svghandle
+
+// Fills in the handle's size and position once its document is parsed. With
+// wait set it blocks until then, otherwise it says 0 while parsing goes on.
+// Also 0 when the svg couldn't be parsed.
+static int shoes_svghandle_ready(shoes_svghandle *svghan, int wait) {
+    shoes_svgdoc *doc = svghan->doc;
+    if (svghan->ready)
+        return svghan->handle != NULL;
+    if (doc == NULL)
+        return 0;
+    if (g_atomic_int_get(&doc->state) == SHOES_SVGDOC_PARSING) {
+        if (!wait) return 0;
+        g_mutex_lock(&svgdoc_lock);
+        while (g_atomic_int_get(&doc->state) == SHOES_SVGDOC_PARSING)
+            g_cond_wait(&svgdoc_done, &svgdoc_lock);
+        g_mutex_unlock(&svgdoc_lock);
+    }
+
+    svghan->ready = 1;
+    svghan->handle = doc->handle;
+    if (svghan->handle == NULL)
+        return 0;
+    if (svghan->subid != NULL) {
+        if (rsvg_handle_has_sub(svghan->handle, svghan->subid)) {
+            if (!rsvg_handle_get_dimensions_sub(svghan->handle, &svghan->svghdim, svghan->subid))
+                printf("no dim for %s\n", svghan->subid);
+            if (!rsvg_handle_get_position_sub(svghan->handle, &svghan->svghpos, svghan->subid))
+                printf("no pos for %s\n", svghan->subid);
+        } else {
+            printf("not a valid id %s\n", svghan->subid);
+            free(svghan->subid);
+            svghan->subid = NULL;
+        }
+    }
+    if (svghan->subid == NULL) {
+        rsvg_handle_get_dimensions(svghan->handle, &svghan->svghdim);
+        svghan->svghpos.x = svghan->svghpos.y = 0;
+    }
+    return 1;
+}
+
+// dpi= changes the parsed document, so a handle sharing it gets its own first
+static void shoes_svghandle_detach(shoes_svghandle *svghan) {
+    shoes_svgdoc *doc = svghan->doc, *own;
+    if (doc->refs == 1) {
+        if (doc->key != NULL) {
+            st_data_t key = (st_data_t)doc->key;
+            st_delete(shoes_world->svg_cache, &key, 0);
+            free(doc->key);
+            doc->key = NULL;
+        }
+        return;
+    }
+    own = shoes_svgdoc_alloc(NULL, doc->path, doc->data, doc->len);
+    shoes_svgdoc_parse(own);
+    shoes_svgdoc_release(doc);
+    svghan->doc = own;
+    svghan->handle = own->handle;
+}
+
 void shoes_svghandle_mark(shoes_svghandle *handle) {
     // we don't have any Ruby objects to mark.
 }
 
 static void shoes_svghandle_free(shoes_svghandle *handle) {
-    if (handle->handle != NULL)
-        g_object_unref(handle->handle);
+    if (handle->doc != NULL)
+        shoes_svgdoc_release(handle->doc);
     if (handle->path) free(handle->path);
     if (handle->data) free(handle->data);
     if (handle->subid) free(handle->subid);
@@ -638,6 +1002,7 @@ VALUE shoes_svghandle_alloc(VALUE klass) {
     obj = Data_Wrap_Struct(klass, NULL, shoes_svghandle_free, handle);
     handle->handle = NULL;
     handle->subid = NULL;
+    handle->doc = NULL;
     return obj;
 }
 
@@ -653,48 +1018,23 @@ VALUE shoes_svghandle_new(int argc, VALUE *argv, VALUE parent) {
     shoes_svghandle *self_t;
     Data_Get_Struct(obj, shoes_svghandle, self_t);
 
-    GError *gerror = NULL;
     if (!NIL_P(filename)) {
         // load it from a file
-        char *path = RSTRING_PTR(filename);
-        self_t->handle = rsvg_handle_new_from_file (path, &gerror);
-        if (self_t->handle == NULL) {
-            self_t->path = NULL;
-            printf("Failed SVG: %s\n", gerror->message);
-        } else self_t->path = strdup(RSTRING_PTR(filename));
-
+        self_t->doc = shoes_svgdoc_open(filename, Qnil);
+        if (g_atomic_int_get(&self_t->doc->state) != SHOES_SVGDOC_FAILED)
+            self_t->path = strdup(RSTRING_PTR(filename));
     } else if (!NIL_P(fromstring)) {
         // load it from a string
-        char *data = RSTRING_PTR(fromstring);
-        int len = RSTRING_LEN(fromstring);
-        // being Ruby, those are UTF-8, may not be what rsvg wants (const guint8 *)
-        // Problem for OSX ?
-        self_t->handle = rsvg_handle_new_from_data ((const unsigned char *)data, len, &gerror);
-        if (self_t->handle == NULL) {
-            self_t->data = NULL;
-            printf("Failed SVG: %s\n", gerror->message);
-        } //else self_t->data = strdup(RSTRING_PTR(fromstring));
-
+        self_t->doc = shoes_svgdoc_open(Qnil, fromstring);
     } else {
         // never reached, handled by shoes_svg_new
     }
 
-    if (!NIL_P(subidObj) && (RSTRING_LEN(subidObj) > 0)) {
-        if (rsvg_handle_has_sub(self_t->handle, RSTRING_PTR(subidObj))) {
-            self_t->subid = strdup(RSTRING_PTR(subidObj));
-            if (!rsvg_handle_get_dimensions_sub(self_t->handle, &self_t->svghdim, self_t->subid))
-                printf("no dim for %s\n", self_t->subid);
-            if (!rsvg_handle_get_position_sub(self_t->handle, &self_t->svghpos, self_t->subid))
-                printf("no pos for %s\n",self_t->subid);
-        } else {
-            printf("not a valid id %s\n",self_t->subid);
-            self_t->subid = NULL;
-        }
-    } else {
-        rsvg_handle_get_dimensions(self_t->handle, &self_t->svghdim);
-        self_t->svghpos.x = self_t->svghpos.y = 0;
+    // checked against the document in shoes_svghandle_ready
+    if (!NIL_P(subidObj) && (RSTRING_LEN(subidObj) > 0))
+        self_t->subid = strdup(RSTRING_PTR(subidObj));
+    else
         self_t->subid = NULL;
-    }
 
     if (NIL_P(aspectObj) || (aspectObj == Qtrue)) {
         // :aspect => true or not specified, Keep aspect ratio
@@ -719,11 +1059,13 @@ VALUE shoes_svghandle_new(int argc, VALUE *argv, VALUE parent) {
 
 VALUE shoes_svghandle_get_width(VALUE self) {
     GET_STRUCT(svghandle, self_t);
+    shoes_svghandle_ready(self_t, 1);
     return INT2NUM(self_t->svghdim.width);
 }
 
 VALUE shoes_svghandle_get_height(VALUE self) {
     GET_STRUCT(svghandle, self_t);
+    shoes_svghandle_ready(self_t, 1);
     return INT2NUM(self_t->svghdim.height);
 }
 
@@ -733,7 +1075,7 @@ VALUE shoes_svghandle_has_group(VALUE self, VALUE group) {
     Data_Get_Struct(self, shoes_svghandle, handle);
     if (!NIL_P(group) && (TYPE(group) == T_STRING)) {
         char *grp = RSTRING_PTR(group);
-        int has = rsvg_handle_has_sub(handle->handle, grp);
+        int has = shoes_svghandle_ready(handle, 1) && rsvg_handle_has_sub(handle->handle, grp);
         if (has)
             return Qtrue;
         else
@@ -741,4 +1083,4 @@ VALUE shoes_svghandle_has_group(VALUE self, VALUE group) {
     } else {
         rb_raise(rb_eArgError, "bad argument, expecting a String \n");
     }
-}
\ No newline at end of file
+}
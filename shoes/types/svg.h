@@ -15,13 +15,15 @@ extern shoes_app _shoes_app;
 // SvgHandle struct - not a graphical widget
 // new in 3.3.0
 typedef struct _svghandle {
-    RsvgHandle *handle;
+    RsvgHandle *handle;       // doc's, once ready
     RsvgDimensionData svghdim;
     RsvgPositionData svghpos;
     char *path;
     char *data;
     char *subid;
     double aspect;
+    shoes_svgdoc *doc;
+    char ready;               // handle, svghdim and svghpos are filled in
 } shoes_svghandle;
 
 //
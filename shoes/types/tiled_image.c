@@ -0,0 +1,444 @@
+/*
+ * tiled_image - pan and zoom around JPEGs too big to load whole.
+ * Only the tiles under the view are decoded, at the smallest libjpeg scale
+ * that still covers the zoom, and the most recent ones are kept around.
+ * Tiles are decoded on a thread pool; the overview is painted under them
+ * until they come back, and on its own when it's detailed enough.
+*/
+#include <math.h>
+#include "shoes/app.h"
+#include "shoes/canvas.h"
+#include "shoes/ruby.h"
+#include "shoes/internal.h"
+#include "shoes/world.h"
+#include "shoes/types/tiled_image.h"
+
+#ifdef SHOES_GTK
+// cocoa's shoes_post_message runs the handler on the posting thread, so
+// there tiles are decoded as they are painted
+#define SHOES_TILE_ASYNC 1
+#endif
+
+#ifdef SHOES_TILE_ASYNC
+static GThreadPool *tile_pool = NULL;
+#endif
+
+// ruby
+VALUE cTiledImage;
+
+FUNC_M("+tiled_image", tiled_image, -1);
+
+PLACE_COMMON(tiled_image);
+CLASS_COMMON2(tiled_image);
+TRANS_COMMON(tiled_image, 1);
+
+void shoes_tiled_image_init() {
+    cTiledImage = rb_define_class_under(cTypes, "TiledImage", rb_cObject);
+    rb_define_alloc_func(cTiledImage, shoes_tiled_image_alloc);
+
+    rb_define_method(cTiledImage, "draw", CASTHOOK(shoes_tiled_image_draw), 2);
+    rb_define_method(cTiledImage, "path", CASTHOOK(shoes_tiled_image_get_path), 0);
+    rb_define_method(cTiledImage, "full_width", CASTHOOK(shoes_tiled_image_get_full_width), 0);
+    rb_define_method(cTiledImage, "full_height", CASTHOOK(shoes_tiled_image_get_full_height), 0);
+    rb_define_method(cTiledImage, "zoom", CASTHOOK(shoes_tiled_image_get_zoom), 0);
+    rb_define_method(cTiledImage, "zoom=", CASTHOOK(shoes_tiled_image_set_zoom), 1);
+    rb_define_method(cTiledImage, "zoom_to", CASTHOOK(shoes_tiled_image_zoom_to), -1);
+    rb_define_method(cTiledImage, "pan", CASTHOOK(shoes_tiled_image_pan), 2);
+    rb_define_method(cTiledImage, "scroll_to", CASTHOOK(shoes_tiled_image_scroll_to), 2);
+    rb_define_method(cTiledImage, "scroll_left", CASTHOOK(shoes_tiled_image_get_scroll_left), 0);
+    rb_define_method(cTiledImage, "scroll_top", CASTHOOK(shoes_tiled_image_get_scroll_top), 0);
+    rb_define_method(cTiledImage, "app", CASTHOOK(shoes_canvas_get_app), 0);
+    rb_define_method(cTiledImage, "parent", CASTHOOK(shoes_tiled_image_get_parent), 0);
+    rb_define_method(cTiledImage, "top", CASTHOOK(shoes_tiled_image_get_top), 0);
+    rb_define_method(cTiledImage, "left", CASTHOOK(shoes_tiled_image_get_left), 0);
+    rb_define_method(cTiledImage, "width", CASTHOOK(shoes_tiled_image_get_width), 0);
+    rb_define_method(cTiledImage, "height", CASTHOOK(shoes_tiled_image_get_height), 0);
+    rb_define_method(cTiledImage, "move", CASTHOOK(shoes_tiled_image_move), 2);
+    rb_define_method(cTiledImage, "displace", CASTHOOK(shoes_tiled_image_displace), 2);
+    rb_define_method(cTiledImage, "style", CASTHOOK(shoes_tiled_image_style), -1);
+    rb_define_method(cTiledImage, "remove", CASTHOOK(shoes_basic_remove), 0);
+    rb_define_method(cTiledImage, "hide", CASTHOOK(shoes_tiled_image_hide), 0);
+    rb_define_method(cTiledImage, "show", CASTHOOK(shoes_tiled_image_show), 0);
+    rb_define_method(cTiledImage, "toggle", CASTHOOK(shoes_tiled_image_toggle), 0);
+    rb_define_method(cTiledImage, "hidden?", CASTHOOK(shoes_tiled_image_is_hidden), 0);
+    rb_define_method(cTiledImage, "transform", CASTHOOK(shoes_tiled_image_transform), 1);
+    rb_define_method(cTiledImage, "translate", CASTHOOK(shoes_tiled_image_translate), 2);
+    rb_define_method(cTiledImage, "rotate", CASTHOOK(shoes_tiled_image_rotate), 1);
+    rb_define_method(cTiledImage, "scale", CASTHOOK(shoes_tiled_image_scale), -1);
+    rb_define_method(cTiledImage, "skew", CASTHOOK(shoes_tiled_image_skew), -1);
+
+    RUBY_M("+tiled_image", tiled_image, -1);
+}
+
+// canvas
+VALUE shoes_canvas_tiled_image(int argc, VALUE *argv, VALUE self) {
+    VALUE path, attr, ele;
+    SETUP_CANVAS();
+    rb_scan_args(argc, argv, "11", &path, &attr);
+    if (NIL_P(attr)) attr = rb_hash_new();
+    ele = shoes_tiled_image_new(path, attr, self);
+    shoes_add_ele(canvas, ele);
+    return ele;
+}
+
+// ruby
+void shoes_tiled_image_mark(shoes_tiled_image *tiled) {
+    rb_gc_mark_maybe(tiled->path);
+    rb_gc_mark_maybe(tiled->parent);
+    rb_gc_mark_maybe(tiled->attr);
+}
+
+static void shoes_tile_unlink(shoes_tiled_image *tiled, shoes_tile *tile) {
+    if (tile->prev) tile->prev->next = tile->next;
+    else tiled->head = tile->next;
+    if (tile->next) tile->next->prev = tile->prev;
+    else tiled->tail = tile->prev;
+    tile->prev = tile->next = NULL;
+}
+
+static void shoes_tile_push(shoes_tiled_image *tiled, shoes_tile *tile) {
+    tile->prev = NULL;
+    tile->next = tiled->head;
+    if (tiled->head) tiled->head->prev = tile;
+    tiled->head = tile;
+    if (tiled->tail == NULL) tiled->tail = tile;
+}
+
+// a tile still decoding is left to its job, which finds it gone
+static void shoes_tile_drop(shoes_tile *tile) {
+    if (tile->job != NULL) g_atomic_int_set(&tile->job->cancelled, 1);
+    if (tile->surface != NULL) cairo_surface_destroy(tile->surface);
+    tile->job = NULL;
+    tile->surface = NULL;
+}
+
+static void shoes_tiled_image_flush(shoes_tiled_image *tiled) {
+    shoes_tile *tile = tiled->head, *next;
+    while (tile != NULL) {
+        next = tile->next;
+        shoes_tile_drop(tile);
+        SHOE_FREE(tile);
+        tile = next;
+    }
+    tiled->head = tiled->tail = NULL;
+    tiled->ntiles = 0;
+}
+
+static void shoes_tiled_image_release(shoes_tiled_image *tiled) {
+    shoes_image_file_close(&tiled->file);
+    RUBY_CRITICAL(SHOE_FREE(tiled));
+}
+
+void shoes_tiled_image_free(shoes_tiled_image *tiled) {
+    shoes_tiled_image_flush(tiled);
+    if (tiled->overview != NULL) cairo_surface_destroy(tiled->overview);
+    tiled->overview = NULL;
+    shoes_transform_release(tiled->st);
+    // jobs still on the pool read the file, the last one back frees it
+    tiled->dead = 1;
+    if (tiled->pending == 0)
+        shoes_tiled_image_release(tiled);
+}
+
+VALUE shoes_tiled_image_alloc(VALUE klass) {
+    VALUE obj;
+    shoes_tiled_image *tiled = SHOE_ALLOC(shoes_tiled_image);
+    SHOE_MEMZERO(tiled, shoes_tiled_image, 1);
+    obj = Data_Wrap_Struct(klass, shoes_tiled_image_mark, shoes_tiled_image_free, tiled);
+    tiled->path = Qnil;
+    tiled->attr = Qnil;
+    tiled->parent = Qnil;
+    tiled->zoom = 1.0;
+    tiled->st = NULL;
+    return obj;
+}
+
+// one pass over the file at 1/8 scale, box-filtered down to the overview
+static void shoes_tiled_image_make_overview(shoes_tiled_image *tiled) {
+    tiled->overview = shoes_jpeg_load_thumbnail(tiled->file.data, tiled->file.len, SHOES_TILE_OVERVIEW);
+    if (tiled->overview != NULL)
+        tiled->overview_scale = (double)cairo_image_surface_get_width(tiled->overview) / tiled->width;
+}
+
+VALUE shoes_tiled_image_new(VALUE path, VALUE attr, VALUE parent) {
+    VALUE obj = shoes_tiled_image_alloc(cTiledImage);
+    shoes_tiled_image *tiled;
+    shoes_canvas *canvas;
+    Data_Get_Struct(obj, shoes_tiled_image, tiled);
+    Data_Get_Struct(parent, shoes_canvas, canvas);
+
+    path = shoes_native_to_s(path);
+    tiled->path = path;
+    tiled->attr = attr;
+    tiled->parent = parent;
+    tiled->st = shoes_transform_touch(canvas->st);
+    tiled->tilesize = max(16, shoes_hash_int(attr, rb_intern("tile"), SHOES_TILE_SIZE));
+    tiled->maxtiles = max(4, shoes_hash_int(attr, rb_intern("tiles"), SHOES_TILE_CACHE));
+
+    if (!shoes_image_file_open(RSTRING_PTR(path), &tiled->file))
+        rb_raise(rb_eArgError, "tiled_image could not open %s", RSTRING_PTR(path));
+    if (tiled->file.len < 3 || memcmp(tiled->file.data, "\xFF\xD8\xFF", 3) != 0 ||
+            !shoes_jpeg_dimensions(tiled->file.data, tiled->file.len, &tiled->width, &tiled->height))
+        rb_raise(rb_eArgError, "tiled_image needs a JPEG file, %s isn't one", RSTRING_PTR(path));
+
+    // start out showing the whole image
+    int w = ATTR2(int, attr, width, canvas->width);
+    int h = ATTR2(int, attr, height, canvas->height);
+    VALUE zoom = shoes_hash_get(attr, rb_intern("zoom"));
+    if (!NIL_P(zoom))
+        tiled->zoom = NUM2DBL(zoom);
+    else if (w > 0 && h > 0)
+        tiled->zoom = min((double)w / tiled->width, (double)h / tiled->height);
+    ATTRSET(attr, width, INT2NUM(w));
+    ATTRSET(attr, height, INT2NUM(h));
+
+    shoes_tiled_image_make_overview(tiled);
+    return obj;
+}
+
+static cairo_surface_t *shoes_tile_decode(shoes_tiled_image *tiled, int level, int col, int row) {
+    return shoes_jpeg_load_region(tiled->file.data, tiled->file.len, 1 << level,
+                                  col * tiled->tilesize, row * tiled->tilesize, tiled->tilesize, tiled->tilesize);
+}
+
+#ifdef SHOES_TILE_ASYNC
+// on the pool, touches nothing but the file and the job
+static void shoes_tile_worker(gpointer data, gpointer user) {
+    shoes_tile_job *job = (shoes_tile_job *)data;
+    if (!g_atomic_int_get(&job->cancelled))
+        job->surface = shoes_tile_decode(job->tiled, job->level, job->col, job->row);
+    shoes_post_message(SHOES_TILE_DECODED, Qnil, job, SHOES_MSG_POST);
+}
+#endif
+
+// the job's message, on the GUI thread
+void shoes_tiled_image_decoded(void *data) {
+    shoes_tile_job *job = (shoes_tile_job *)data;
+    shoes_tiled_image *tiled = job->tiled;
+    shoes_tile *tile;
+
+    tiled->pending--;
+    for (tile = tiled->head; tile != NULL; tile = tile->next)
+        if (tile->job == job) break;
+    if (tile != NULL) {
+        tile->surface = job->surface;
+        tile->job = NULL;
+    } else if (job->surface != NULL) {
+        cairo_surface_destroy(job->surface);
+    }
+    SHOE_FREE(job);
+
+    if (tiled->dead) {
+        if (tiled->pending == 0)
+            shoes_tiled_image_release(tiled);
+    } else if (tile != NULL && tile->surface != NULL) {
+        shoes_canvas_repaint_all(tiled->parent);
+    }
+}
+
+// find a tile or start decoding it, evicting the least recently used. A
+// tile that fails to decode is kept too, without a surface, so it isn't
+// retried on every paint.
+static shoes_tile *shoes_tiled_image_tile(shoes_tiled_image *tiled, int level, int col, int row) {
+    shoes_tile *tile;
+    for (tile = tiled->head; tile != NULL; tile = tile->next) {
+        if (tile->level == level && tile->col == col && tile->row == row) {
+            if (tile != tiled->head) {
+                shoes_tile_unlink(tiled, tile);
+                shoes_tile_push(tiled, tile);
+            }
+            return tile;
+        }
+    }
+
+    if (tiled->ntiles >= tiled->maxtiles) {
+        tile = tiled->tail;
+        shoes_tile_unlink(tiled, tile);
+        shoes_tile_drop(tile);
+    } else {
+        tile = SHOE_ALLOC(shoes_tile);
+        tile->surface = NULL;
+        tile->job = NULL;
+        tiled->ntiles++;
+    }
+    tile->level = level;
+    tile->col = col;
+    tile->row = row;
+    shoes_tile_push(tiled, tile);
+
+#ifdef SHOES_TILE_ASYNC
+    if (tile_pool == NULL)
+        tile_pool = g_thread_pool_new(shoes_tile_worker, NULL,
+                                      max(1, (int)g_get_num_processors() - 1), FALSE, NULL);
+    if (tile_pool != NULL) {
+        shoes_tile_job *job = SHOE_ALLOC(shoes_tile_job);
+        job->tiled = tiled;
+        job->level = level;
+        job->col = col;
+        job->row = row;
+        job->cancelled = 0;
+        job->surface = NULL;
+        tile->job = job;
+        tiled->pending++;
+        g_thread_pool_push(tile_pool, job, NULL);
+        return tile;
+    }
+#endif
+    tile->surface = shoes_tile_decode(tiled, level, col, row);
+    return tile;
+}
+
+// keep the view on the image, centering it when the image is smaller
+static void shoes_tiled_image_clamp(shoes_tiled_image *tiled) {
+    double vw = tiled->place.iw / tiled->zoom, vh = tiled->place.ih / tiled->zoom;
+    if (vw >= tiled->width) tiled->left = (tiled->width - vw) / 2.;
+    else tiled->left = max(0.0, min(tiled->left, tiled->width - vw));
+    if (vh >= tiled->height) tiled->top = (tiled->height - vh) / 2.;
+    else tiled->top = max(0.0, min(tiled->top, tiled->height - vh));
+}
+
+static void shoes_tiled_image_paint(cairo_t *cr, shoes_tiled_image *self_t, shoes_place *place) {
+    int level = 0, scale, ts = self_t->tilesize, col, row, c0, c1, r0, r1, need;
+    double vw = place->iw / self_t->zoom, vh = place->ih / self_t->zoom;
+
+    // the smallest decode that still gives a source pixel per screen pixel
+    while (level < SHOES_TILE_LEVELS - 1 && self_t->zoom * (1 << (level + 1)) <= 1.0)
+        level++;
+    scale = 1 << level;
+
+    shoes_apply_transformation(cr, self_t->st, place, 0);
+    cairo_rectangle(cr, place->ix + place->dx, place->iy + place->dy, place->iw, place->ih);
+    cairo_clip(cr);
+    cairo_translate(cr, place->ix + place->dx, place->iy + place->dy);
+    cairo_scale(cr, self_t->zoom, self_t->zoom);
+    cairo_translate(cr, -self_t->left, -self_t->top);
+
+    // the overview covers any tile still decoding or that failed to
+    if (self_t->overview != NULL) {
+        cairo_save(cr);
+        cairo_scale(cr, 1. / self_t->overview_scale, 1. / self_t->overview_scale);
+        cairo_set_source_surface(cr, self_t->overview, 0, 0);
+        cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+        cairo_paint(cr);
+        cairo_restore(cr);
+    }
+
+    // zoomed out to the overview's own detail, it is all there is to draw
+    if (self_t->overview != NULL && self_t->zoom <= self_t->overview_scale) {
+        shoes_undo_transformation(cr, self_t->st, place, 0);
+        return;
+    }
+
+    c0 = max(0, (int)floor(self_t->left / scale / ts));
+    r0 = max(0, (int)floor(self_t->top / scale / ts));
+    // libjpeg rounds scaled sizes up
+    c1 = min(((self_t->width + scale - 1) / scale - 1) / ts, (int)floor((self_t->left + vw) / scale / ts));
+    r1 = min(((self_t->height + scale - 1) / scale - 1) / ts, (int)floor((self_t->top + vh) / scale / ts));
+
+    // never evict a tile this same paint needs, and keep a margin for panning
+    need = max(0, c1 - c0 + 1) * max(0, r1 - r0 + 1);
+    if (self_t->maxtiles < need + need / 4 + 4)
+        self_t->maxtiles = need + need / 4 + 4;
+
+    cairo_scale(cr, scale, scale);
+    for (row = r0; row <= r1; row++) {
+        for (col = c0; col <= c1; col++) {
+            shoes_tile *tile = shoes_tiled_image_tile(self_t, level, col, row);
+            if (tile->surface == NULL) continue;
+            cairo_set_source_surface(cr, tile->surface, col * ts, row * ts);
+            if (self_t->zoom * scale != 1.0)
+                cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+            cairo_paint(cr);
+        }
+    }
+
+    shoes_undo_transformation(cr, self_t->st, place, 0);
+}
+
+VALUE shoes_tiled_image_draw(VALUE self, VALUE c, VALUE actual) {
+    SETUP_DRAWING(shoes_tiled_image, REL_CANVAS, ATTR2(int, self_t->attr, width, 0),
+                  ATTR2(int, self_t->attr, height, 0));
+    VALUE ck = rb_obj_class(c);
+    self_t->place = place;
+    shoes_tiled_image_clamp(self_t);
+    if (RTEST(actual))
+        shoes_tiled_image_paint(CCR(canvas), self_t, &place);
+    FINISH();
+    return self;
+}
+
+VALUE shoes_tiled_image_get_path(VALUE self) {
+    GET_STRUCT(tiled_image, self_t);
+    return self_t->path;
+}
+
+VALUE shoes_tiled_image_get_full_width(VALUE self) {
+    GET_STRUCT(tiled_image, self_t);
+    return INT2NUM(self_t->width);
+}
+
+VALUE shoes_tiled_image_get_full_height(VALUE self) {
+    GET_STRUCT(tiled_image, self_t);
+    return INT2NUM(self_t->height);
+}
+
+VALUE shoes_tiled_image_get_zoom(VALUE self) {
+    GET_STRUCT(tiled_image, self_t);
+    return DBL2NUM(self_t->zoom);
+}
+
+VALUE shoes_tiled_image_set_zoom(VALUE self, VALUE zoom) {
+    VALUE args[1] = { zoom };
+    return shoes_tiled_image_zoom_to(1, args, self);
+}
+
+// zoom_to(zoom, x = center, y = center) keeps the point x, y of the
+// element (screen pixels, relative to it) fixed while zooming
+VALUE shoes_tiled_image_zoom_to(int argc, VALUE *argv, VALUE self) {
+    VALUE _z, _x, _y;
+    double z, x, y;
+    GET_STRUCT(tiled_image, self_t);
+    rb_scan_args(argc, argv, "12", &_z, &_x, &_y);
+
+    z = NUM2DBL(_z);
+    if (z <= 0.0) rb_raise(rb_eArgError, "zoom must be greater than 0");
+    x = NIL_P(_x) ? self_t->place.iw / 2. : NUM2DBL(_x);
+    y = NIL_P(_y) ? self_t->place.ih / 2. : NUM2DBL(_y);
+
+    self_t->left += x / self_t->zoom - x / z;
+    self_t->top += y / self_t->zoom - y / z;
+    self_t->zoom = z;
+    shoes_tiled_image_clamp(self_t);
+    shoes_canvas_repaint_all(self_t->parent);
+    return self;
+}
+
+// pan(dx, dy) moves the view by screen pixels
+VALUE shoes_tiled_image_pan(VALUE self, VALUE dx, VALUE dy) {
+    GET_STRUCT(tiled_image, self_t);
+    self_t->left += NUM2DBL(dx) / self_t->zoom;
+    self_t->top += NUM2DBL(dy) / self_t->zoom;
+    shoes_tiled_image_clamp(self_t);
+    shoes_canvas_repaint_all(self_t->parent);
+    return self;
+}
+
+// scroll_to(left, top) puts a source pixel at the top left of the view
+VALUE shoes_tiled_image_scroll_to(VALUE self, VALUE left, VALUE top) {
+    GET_STRUCT(tiled_image, self_t);
+    self_t->left = NUM2DBL(left);
+    self_t->top = NUM2DBL(top);
+    shoes_tiled_image_clamp(self_t);
+    shoes_canvas_repaint_all(self_t->parent);
+    return self;
+}
+
+VALUE shoes_tiled_image_get_scroll_left(VALUE self) {
+    GET_STRUCT(tiled_image, self_t);
+    return DBL2NUM(self_t->left);
+}
+
+VALUE shoes_tiled_image_get_scroll_top(VALUE self) {
+    GET_STRUCT(tiled_image, self_t);
+    return DBL2NUM(self_t->top);
+}
@@ -0,0 +1,85 @@
+#include "shoes/ruby.h"
+#include "shoes/canvas.h"
+#include "shoes/app.h"
+#include "shoes/internal.h"
+#include "shoes/world.h"
+#include "shoes/native/native.h"
+
+#ifndef SHOES_TILED_IMAGE_TYPE_H
+#define SHOES_TILED_IMAGE_TYPE_H
+
+/* extern variables necessary to communicate with other parts of Shoes */
+extern VALUE cShoes, cApp, cTypes, cCanvas, cWidget;
+extern shoes_app _shoes_app;
+
+// libjpeg can decode at 1, 1/2, 1/4 and 1/8 scale
+#define SHOES_TILE_LEVELS    4
+#define SHOES_TILE_SIZE      256
+#define SHOES_TILE_CACHE     96
+#define SHOES_TILE_OVERVIEW  1024
+
+// a tile on its way from the decode pool. The worker only reads the file
+// and fills in surface, everything else belongs to the GUI thread.
+typedef struct {
+    struct _shoes_tiled_image *tiled;
+    int level, col, row;
+    volatile gint cancelled;    // evicted meanwhile, don't bother decoding
+    cairo_surface_t *surface;
+} shoes_tile_job;
+
+// one decoded tile, kept in a most recently used list
+typedef struct _shoes_tile {
+    int level, col, row;
+    cairo_surface_t *surface;   // NULL while decoding or if that failed
+    shoes_tile_job *job;        // set while decoding
+    struct _shoes_tile *prev, *next;
+} shoes_tile;
+
+//
+// TiledImage struct - a viewport onto a very large JPEG
+//
+typedef struct _shoes_tiled_image {
+    VALUE parent;
+    VALUE attr;
+    shoes_place place;
+    VALUE path;
+    shoes_image_file file;
+    int width, height;          // full size of the source image
+    int tilesize;
+    double zoom;                // screen pixels per source pixel
+    double left, top;           // source pixel at the top left corner of the view
+    cairo_surface_t *overview;  // whole image, small, drawn under missing tiles
+    double overview_scale;
+    shoes_tile *head, *tail;
+    int ntiles, maxtiles;
+    int pending;                // jobs out on the pool, they hold the file
+    char dead;                  // collected, freed when the last job is back
+    shoes_transform *st;
+} shoes_tiled_image;
+
+VALUE cTiledImage;
+
+/* each widget should have its own init function */
+void shoes_tiled_image_init();
+
+// ruby
+void shoes_tiled_image_mark(shoes_tiled_image *);
+void shoes_tiled_image_free(shoes_tiled_image *);
+VALUE shoes_tiled_image_new(VALUE, VALUE, VALUE);
+VALUE shoes_tiled_image_alloc(VALUE);
+VALUE shoes_tiled_image_draw(VALUE, VALUE, VALUE);
+VALUE shoes_tiled_image_get_path(VALUE);
+VALUE shoes_tiled_image_get_full_width(VALUE);
+VALUE shoes_tiled_image_get_full_height(VALUE);
+VALUE shoes_tiled_image_get_zoom(VALUE);
+VALUE shoes_tiled_image_set_zoom(VALUE, VALUE);
+VALUE shoes_tiled_image_zoom_to(int, VALUE *, VALUE);
+VALUE shoes_tiled_image_pan(VALUE, VALUE, VALUE);
+VALUE shoes_tiled_image_scroll_to(VALUE, VALUE, VALUE);
+VALUE shoes_tiled_image_get_scroll_left(VALUE);
+VALUE shoes_tiled_image_get_scroll_top(VALUE);
+
+// canvas
+VALUE shoes_canvas_tiled_image(int, VALUE *, VALUE);
+
+#endif
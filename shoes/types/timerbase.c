@@ -38,9 +38,8 @@ VALUE shoes_timer_draw(VALUE self, VALUE c, VALUE actual) {
     return self;
 }
 
-void shoes_timer_call(VALUE self) {
-    GET_STRUCT(timer, timer);
-    shoes_safe_block(timer->parent, timer->block, rb_ary_new3(1, INT2NUM(timer->frame)));
+static void shoes_timer_fire(VALUE self, shoes_timer *timer, VALUE args) {
+    shoes_safe_block(timer->parent, timer->block, args);
     timer->frame++;
 
     if (rb_obj_is_kind_of(self, cTimer)) {
@@ -49,6 +48,26 @@ void shoes_timer_call(VALUE self) {
     }
 }
 
+void shoes_timer_call(VALUE self) {
+    GET_STRUCT(timer, timer);
+    shoes_timer_fire(self, timer, rb_ary_new3(1, INT2NUM(timer->frame)));
+}
+
+// called from a frame clock: stamp is the frame time in seconds, dropped
+// how many times the timer should have fired since it last did
+void shoes_timer_call_at(VALUE self, double stamp, unsigned int dropped) {
+    VALUE args;
+    int arity = 1;
+    GET_STRUCT(timer, timer);
+    if (rb_obj_is_proc(timer->block))
+        arity = rb_proc_arity(timer->block);
+    if (arity == 0 || arity == 1)
+        args = rb_ary_new3(1, INT2NUM(timer->frame));
+    else
+        args = rb_ary_new3(3, INT2NUM(timer->frame), rb_float_new(stamp), UINT2NUM(dropped));
+    shoes_timer_fire(self, timer, args);
+}
+
 void shoes_timer_mark(shoes_timer *timer) {
     rb_gc_mark_maybe(timer->block);
     rb_gc_mark_maybe(timer->parent);
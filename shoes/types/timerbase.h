@@ -39,6 +39,7 @@ VALUE shoes_timer_start(VALUE self);
 VALUE shoes_timer_toggle(VALUE self);
 
 void shoes_timer_call(VALUE self);
+void shoes_timer_call_at(VALUE self, double stamp, unsigned int dropped);
 void shoes_timer_mark(shoes_timer *timer);
 void shoes_timer_free(shoes_timer *timer);
 VALUE shoes_timer_new(VALUE klass, VALUE rate, VALUE block, VALUE parent);
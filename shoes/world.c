@@ -35,6 +35,7 @@ shoes_world_t *shoes_world_alloc() {
     world->msgs = rb_ary_new();
     world->mainloop = FALSE;
     world->image_cache = st_init_strtable();
+    world->svg_cache = st_init_strtable();
     world->blank_image = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
     world->blank_cache = SHOE_ALLOC(shoes_cached_image);
     world->blank_cache->surface = world->blank_image;
@@ -63,10 +64,25 @@ int shoes_world_free_image_cache(char *key, shoes_cache_entry *cached, char *arg
     return ST_CONTINUE;
 }
 
+// a document still being parsed belongs to its worker, leave it be
+int shoes_world_free_svg_cache(char *key, shoes_svgdoc *doc, char *arg) {
+    if (g_atomic_int_get(&doc->state) == SHOES_SVGDOC_PARSING)
+        return ST_CONTINUE;
+    if (doc->handle != NULL)
+        g_object_unref(doc->handle);
+    if (doc->path) free(doc->path);
+    if (doc->data) SHOE_FREE(doc->data);
+    free(doc);
+    free(key);
+    return ST_CONTINUE;
+}
+
 void shoes_world_free(shoes_world_t *world) {
     shoes_native_cleanup(world);
     st_foreach(world->image_cache, CASTFOREACH(shoes_world_free_image_cache), 0);
     st_free_table(world->image_cache);
+    st_foreach(world->svg_cache, CASTFOREACH(shoes_world_free_svg_cache), 0);
+    st_free_table(world->svg_cache);
     SHOE_FREE(world->blank_cache);
     cairo_surface_destroy(world->blank_image);
     pango_font_description_free(world->default_font);